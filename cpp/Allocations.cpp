@@ -0,0 +1,48 @@
+#include "Allocations.h"
+
+
+////// Replacement of the global operator new, counting the allocations (see Allocations.h)
+//
+//  Only linked into the programs built with COUNT_ALLOCATIONS : a program can only replace
+//  operator new once.
+
+
+static void* countedAllocation(size_t size)
+{
+    g_Allocations.count.fetch_add(1, std::memory_order_relaxed);
+    g_Allocations.bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size != 0 ? size : 1);
+}
+
+// not inlined : GCC would see free called on the result of operator new
+[[gnu::noinline]] static void countedRelease(void* memory) { std::free(memory); }
+
+void* operator new(size_t size)
+{
+    void* memory = countedAllocation(size);
+    if(memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAllocation(size); }
+
+void operator delete(void* memory) noexcept { countedRelease(memory); }
+void operator delete(void* memory, size_t) noexcept { countedRelease(memory); }
+void operator delete(void* memory, const std::nothrow_t&) noexcept { countedRelease(memory); }
+
+// over-aligned types (the SIMD buffers), the size being rounded up for aligned_alloc
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    g_Allocations.count.fetch_add(1, std::memory_order_relaxed);
+    g_Allocations.bytes.fetch_add(size, std::memory_order_relaxed);
+
+    const size_t align = static_cast<size_t>(alignment);
+    void* memory = std::aligned_alloc(align, (size + align - 1) / align * align);
+    if(memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept { countedRelease(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { countedRelease(memory); }
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+
+////// Heap allocations
+//
+//  With COUNT_ALLOCATIONS, the global operator new is replaced by one counting the allocations
+//  and their bytes, so a simulation can check that its steps don't allocate anything once every
+//  buffer has its size (the arena of the Barnes-Hut tree, Arena.h, keeps its memory from one
+//  step to the next). The replacement is in Allocations.cpp, which CMake only links into rk4
+//  and the tests : this header, included by Simulation.h, only reads the counters.
+
+
+/// @brief allocations made through operator new since the start of the program
+struct AllocationCounters
+{
+    std::atomic<size_t> count{0};
+    std::atomic<size_t> bytes{0};
+};
+
+inline AllocationCounters g_Allocations;
+
+constexpr bool allocationsCounted()
+{
+#ifdef COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline size_t allocationCount() { return g_Allocations.count.load(std::memory_order_relaxed); }
+inline size_t allocatedBytes() { return g_Allocations.bytes.load(std::memory_order_relaxed); }
+
+
+/// @brief allocations made between Start and Stop, e.g. the steps after the first one
+class AllocationProbe {
+public :
+    void Start()
+    {
+        m_Count = allocationCount();
+        m_Bytes = allocatedBytes();
+    }
+
+    void Stop()
+    {
+        m_Count = allocationCount() - m_Count;
+        m_Bytes = allocatedBytes() - m_Bytes;
+    }
+
+    size_t GetCount() const { return m_Count; }
+    size_t GetBytes() const { return m_Bytes; }
+
+private :
+    size_t m_Count = 0;
+    size_t m_Bytes = 0;
+};
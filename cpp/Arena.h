@@ -0,0 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+/// @brief monotonic allocator : allocations are only released all at once by Reset
+///
+/// The memory blocks are kept between two Reset, so once the arena has grown to the size
+/// needed by one step, the following steps don't allocate anything from the heap.
+class MonotonicArena {
+public :
+    explicit MonotonicArena(size_t block_size = 1 << 20)
+        : m_Block_size(block_size)
+    {
+    }
+
+    ~MonotonicArena()
+    {
+        for(Block& block : m_Blocks)
+            std::free(block.data);
+    }
+
+    MonotonicArena(const MonotonicArena&) = delete;
+    MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+        while(m_Current < m_Blocks.size())
+        {
+            Block& block = m_Blocks[m_Current];
+            const size_t offset = (m_Offset + alignment - 1) & ~(alignment - 1);
+            if(offset + size <= block.size)
+            {
+                m_Offset = offset + size;
+                return block.data + offset;
+            }
+
+            m_Current++;
+            m_Offset = 0;
+        }
+
+        // no more room : new block, large enough for this allocation
+        const size_t block_size = std::max(m_Block_size, size + alignment);
+        char* data = static_cast<char*>(std::malloc(block_size));
+        if(data == nullptr)
+            throw std::bad_alloc();
+
+        m_Blocks.push_back({ data, block_size });
+        m_Current = m_Blocks.size() - 1;
+        m_Offset = 0;
+
+        return Allocate(size, alignment);
+    }
+
+    /// @brief construct an object in the arena, its destructor will never be called
+    template<typename T, typename... Args>
+    T* Create(Args&&... args)
+    {
+        return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// @brief release every allocation, keeping the blocks for the next ones
+    void Reset()
+    {
+        m_Current = 0;
+        m_Offset = 0;
+    }
+
+    size_t GetCapacity() const
+    {
+        size_t capacity = 0;
+        for(const Block& block : m_Blocks)
+            capacity += block.size;
+        return capacity;
+    }
+
+private :
+    struct Block
+    {
+        char* data;
+        size_t size;
+    };
+
+    size_t m_Block_size;
+    std::vector<Block> m_Blocks;
+    size_t m_Current = 0;
+    size_t m_Offset = 0;
+};
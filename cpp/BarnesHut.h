@@ -0,0 +1,324 @@
+#pragma once
+
+#include "System.h"
+#include "Constants.h"
+#include "Arena.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+
+
+/// @brief Barnes-Hut tree : accelerations in O(N log N) instead of O(N²)
+///
+/// Each cell is split in 2^D children (a quadtree in 2D, an octree in 3D). A cell seen from
+/// a body under an angle smaller than theta (cell width / distance < theta) attracts it as
+/// a single mass at its centre of mass. theta = 0 gives the direct summation.
+/// The tree is rebuilt at each evaluation, its nodes coming from an arena that is reset
+/// instead of freed. The potential of each body can be taken from the same walk, with
+/// the same approximation as its acceleration.
+template<typename T, int D = 2>
+class BarnesHutTree {
+public :
+    static constexpr int MaxDepth = 48;
+    static constexpr int NbChildren = 1 << D;
+
+    explicit BarnesHutTree(T theta = T(0.5), T softening = 0)
+        : m_Theta(theta), m_Softening_squared(softening * softening), m_Arena(1 << 16)
+    {
+    }
+
+    BarnesHutTree(const BarnesHutTree&) = delete;
+    BarnesHutTree& operator=(const BarnesHutTree&) = delete;
+
+    T GetTheta() const { return m_Theta; }
+    size_t GetNodeCount() const { return m_Node_count; }
+
+    void Build(const Bodies<T, D>& bodies)
+    {
+        const size_t n = bodies.Size();
+
+        m_Arena.Reset();
+        m_Next.assign(n, -1);
+        m_Node_count = 0;
+        m_Root = nullptr;
+
+        if(n == 0)
+            return;
+
+        // bounding cube of all the bodies
+        T center[D];
+        T size = 0;
+        for(int d = 0; d < D; d++)
+        {
+            const T* p = bodies.pos[d].data();
+            const auto bounds = std::minmax_element(p, p + n);
+            center[d] = (*bounds.first + *bounds.second) * T(0.5);
+            size = std::max(size, *bounds.second - *bounds.first);
+        }
+
+        const T half = size * T(0.5) * T(1.0001) + std::numeric_limits<T>::min();
+        m_Root = NewNode(center, half);
+
+        for(int d = 0; d < D; d++)
+            m_Pos[d] = bodies.pos[d].data();
+        for(size_t i = 0; i < n; i++)
+            Insert(static_cast<int>(i));
+
+        ComputeMass(m_Root, bodies);
+    }
+
+    /// @brief build the tree on the bodies and fill bodies.acc, the walks being shared between the threads of the pool,
+    /// and the potential of each body if `potential` (n scalars) is not null
+    void ComputeAccelerations(Bodies<T, D>& bodies, ThreadPool* pool = nullptr, T* const potential = nullptr)
+    {
+        Build(bodies);
+
+        const auto walk = [this, &bodies, potential](size_t begin, size_t end, size_t) {
+            const ScopedPhase phase(Phase::ForceChunk);
+            uint64_t interactions = 0;
+            for(size_t i = begin; i < end; i++)
+            {
+                T acceleration[D];
+                interactions += AccelerationOn(bodies, static_cast<int>(i), acceleration, potential != nullptr ? &potential[i] : nullptr);
+                for(int d = 0; d < D; d++)
+                    bodies.acc[d][i] = acceleration[d];
+            }
+            profileCount(Counter::Interactions, interactions);
+        };
+
+        if(pool != nullptr)
+            pool->ParallelFor(bodies.Size(), walk);
+        else
+            walk(0, bodies.Size(), 0);
+    }
+
+    /// @brief acceleration of body i (and its potential if not null), the tree must have been built on these bodies;
+    /// returns the number of bodies and cells attracting it
+    size_t AccelerationOn(const Bodies<T, D>& bodies, const int i, T (&acceleration)[D], T* const potential = nullptr) const
+    {
+        const T* m = bodies.mass.data();
+        const T theta_squared = m_Theta * m_Theta;
+
+        T position[D];
+        for(int d = 0; d < D; d++)
+        {
+            position[d] = bodies.pos[d][i];
+            acceleration[d] = 0;
+        }
+        if(potential != nullptr)
+            *potential = 0;
+
+        size_t interactions = 0;
+        if(m_Root == nullptr)
+            return interactions;
+
+        const Node* stack[(NbChildren - 1) * MaxDepth + NbChildren];
+        int top = 0;
+        stack[top++] = m_Root;
+
+        while(top > 0)
+        {
+            const Node* node = stack[--top];
+
+            if(node->first != Internal)
+            {
+                // leaf : direct summation over its bodies
+                for(int j = node->first; j >= 0; j = m_Next[j])
+                {
+                    if(j == i)
+                        continue;
+
+                    T delta[D];
+                    for(int d = 0; d < D; d++)
+                        delta[d] = bodies.pos[d][j] - position[d];
+                    Attract(delta, m[j], acceleration, potential);
+                    interactions++;
+                }
+                continue;
+            }
+
+            T delta[D];
+            T distance_squared = 0;
+            bool inside = true;
+            for(int d = 0; d < D; d++)
+            {
+                delta[d] = node->com[d] - position[d];
+                distance_squared += delta[d] * delta[d];
+                inside = inside && abs(position[d] - node->center[d]) <= node->half;
+            }
+            distance_squared += m_Softening_squared;
+            const T width = 2 * node->half;
+
+            if(!inside && width * width < theta_squared * distance_squared)
+            {
+                Attract(delta, node->mass, acceleration, potential);
+                interactions++;
+            }
+            else
+            {
+                for(const Node* child : node->children)
+                {
+                    if(child != nullptr)
+                        stack[top++] = child;
+                }
+            }
+        }
+        return interactions;
+    }
+
+private :
+    static constexpr int Empty = -1;        // leaf without body
+    static constexpr int Internal = -2;     // node with children
+
+    struct Node
+    {
+        T center[D];
+        T half;
+        T mass;
+        T com[D];
+        Node* children[NbChildren];
+        int first;          // first body of a leaf (the others are chained in m_Next), or Empty / Internal
+        int depth;
+    };
+
+    T m_Theta;
+    T m_Softening_squared;
+    MonotonicArena m_Arena;
+    Node* m_Root = nullptr;
+    std::vector<int> m_Next;
+    size_t m_Node_count = 0;
+
+    // positions of the bodies being inserted
+    const T* m_Pos[D] = {};
+
+
+    /// @brief acceleration += G m delta / |delta|³ (softened), potential -= G m / |delta|
+    void Attract(const T (&delta)[D], T mass, T (&acceleration)[D], T* const potential) const
+    {
+        T distance_squared = 0;
+        for(int d = 0; d < D; d++)
+            distance_squared += delta[d] * delta[d];
+        distance_squared += m_Softening_squared;
+
+        const T factor = G<T> * mass / (distance_squared * sqrt(distance_squared));
+        for(int d = 0; d < D; d++)
+            acceleration[d] += factor * delta[d];
+        if(potential != nullptr)
+            *potential -= factor * distance_squared;
+    }
+
+    Node* NewNode(const T (&center)[D], T half, int depth = 0)
+    {
+        m_Node_count++;
+        Node* node = m_Arena.Create<Node>();
+        for(int d = 0; d < D; d++)
+        {
+            node->center[d] = center[d];
+            node->com[d] = 0;
+        }
+        node->half = half;
+        node->mass = 0;
+        std::fill(node->children, node->children + NbChildren, nullptr);
+        node->first = Empty;
+        node->depth = depth;
+        return node;
+    }
+
+    /// @brief bit d of the child is set when the body is on the upper side of the centre along d
+    int ChildIndex(const Node* node, int i) const
+    {
+        int index = 0;
+        for(int d = 0; d < D; d++)
+            index |= (m_Pos[d][i] >= node->center[d] ? 1 : 0) << d;
+        return index;
+    }
+
+    Node* Child(Node* node, int index)
+    {
+        if(node->children[index] == nullptr)
+        {
+            const T half = node->half * T(0.5);
+            T center[D];
+            for(int d = 0; d < D; d++)
+                center[d] = node->center[d] + ((index >> d) & 1 ? half : -half);
+            node->children[index] = NewNode(center, half, node->depth + 1);
+        }
+        return node->children[index];
+    }
+
+    void Insert(int i)
+    {
+        Node* node = m_Root;
+
+        while(true)
+        {
+            if(node->first == Internal)
+            {
+                node = Child(node, ChildIndex(node, i));
+                continue;
+            }
+
+            if(node->first == Empty)
+            {
+                node->first = i;
+                return;
+            }
+
+            // too deep : the bodies are (almost) at the same place, they share the leaf
+            if(node->depth >= MaxDepth)
+            {
+                m_Next[i] = node->first;
+                node->first = i;
+                return;
+            }
+
+            // split the leaf : its body goes down one level, then i continues its way down
+            const int j = node->first;
+            node->first = Internal;
+            Child(node, ChildIndex(node, j))->first = j;
+        }
+    }
+
+    void ComputeMass(Node* node, const Bodies<T, D>& bodies)
+    {
+        const T* m = bodies.mass.data();
+
+        T mass = 0;
+        T moment[D] = {};
+
+        if(node->first == Internal)
+        {
+            for(Node* child : node->children)
+            {
+                if(child == nullptr)
+                    continue;
+
+                ComputeMass(child, bodies);
+                mass += child->mass;
+                for(int d = 0; d < D; d++)
+                    moment[d] += child->mass * child->com[d];
+            }
+        }
+        else
+        {
+            for(int j = node->first; j >= 0; j = m_Next[j])
+            {
+                mass += m[j];
+                for(int d = 0; d < D; d++)
+                    moment[d] += m[j] * bodies.pos[d][j];
+            }
+        }
+
+        node->mass = mass;
+        for(int d = 0; d < D; d++)
+            node->com[d] = mass > 0 ? moment[d] / mass : node->center[d];
+    }
+};
+
+template<typename T>
+using QuadTree = BarnesHutTree<T, 2>;
+
+template<typename T>
+using Octree = BarnesHutTree<T, 3>;
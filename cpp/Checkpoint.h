@@ -0,0 +1,419 @@
+#pragma once
+
+#include "Scalar.h"
+#include "System.h"
+#include "Integrators.h"
+#include "Trajectory.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+////// Checkpoints
+//
+//  A checkpoint holds everything a simulation integrated step by step needs to go on exactly
+//  as if it had not been stopped : the bodies (with their accelerations), the time, the state
+//  of the integrator, and how much of the trajectory had been written. There is no random
+//  generator in the engine, so nothing else to keep. Restarted with the same command line,
+//  a simulation writes the same trajectory, bit for bit, as a run that was never stopped.
+//
+//  The file is a CheckpointHeader followed by the raw scalars, in the byte order of the machine :
+//
+//      time
+//      fixed timestep  : accelerations_valid (uint64)
+//      dopri5          : dt, last_dt, accepted, rejected, evaluations, first_stage_valid (uint64),
+//                        first stage (2 * dimension * nb_bodies)
+//      mass[n], pos[d][n] for each d, vel[d][n], acc[d][n]
+//
+
+/// @brief CheckpointHeader::integrator of the adaptive integrator, the others being their IntegratorType
+constexpr uint32_t CheckpointDopri5 = 255;
+
+/// @brief first 72 bytes of a checkpoint
+///
+/// The timestep is kept so a restart with another one is refused : the simulation would go on,
+/// but not as the run that was stopped.
+struct CheckpointHeader
+{
+    char magic[8];              // "TIPECKPT"
+    uint32_t version;
+    uint32_t header_size;
+    char dtype[8];              // numpy descriptor of the scalars, as in TrajectoryHeader
+    uint32_t scalar_size;
+    uint32_t nb_bodies;
+    uint32_t dimension;
+    uint32_t integrator;        // IntegratorType, or CheckpointDopri5
+    uint64_t step;              // steps done
+    uint64_t nb_frames;         // frames given to the trajectory writer
+    uint64_t output_size;       // bytes of the trajectory file holding these frames
+    double timestep;            // dt of the steps, or the output interval of dopri5
+};
+
+static_assert(sizeof(CheckpointHeader) == 72, "the header of the checkpoints must stay 72 bytes long");
+
+inline uint32_t checkpointIntegrator(IntegratorType type) { return static_cast<uint32_t>(type); }
+
+/// @brief read only the header, to prepare the trajectory file before the simulation starts
+inline bool readCheckpointHeader(const std::string& path, CheckpointHeader& header)
+{
+    std::ifstream stream(path, std::ios::binary);
+    return stream.read(reinterpret_cast<char*>(&header), sizeof(header))
+        && std::memcmp(header.magic, "TIPECKPT", 8) == 0 && header.header_size == sizeof(CheckpointHeader);
+}
+
+
+/// @brief the state saved in a checkpoint
+template<typename T, int D>
+struct CheckpointState
+{
+    CheckpointHeader header = {};
+    T time = 0;
+    typename Integrator<T, D>::State fixed;
+    typename AdaptiveIntegrator<T, D>::State adaptive;
+    Bodies<T, D> bodies;
+};
+
+
+/// @brief periodic checkpoints of a simulation, written by a background thread, and restart from one of them
+///
+/// The simulation loop only asks Due() after each step; when it is time, Save copies the state
+/// in memory (a few arrays of n scalars) and the background thread serialises it and writes it.
+/// If the previous checkpoint is still being written, the checkpoint is skipped rather than
+/// waited for, so the loop never stalls on the disk. The file is written next to its final
+/// place then renamed, so the latest complete checkpoint is always there.
+///
+/// Save flushes the trajectory writers, so the size of the trajectory recorded in the checkpoint
+/// holds every frame given to them : a restart cuts the file back to that size and appends
+/// the frames that follow.
+template<typename T, int D>
+class Checkpointer {
+public :
+    static constexpr size_t ClockPeriod = 64;
+
+    /// @brief path : "" for no checkpoint, interval : wall-clock seconds between two checkpoints,
+    /// output : stream of the trajectory, to record its size
+    Checkpointer(const std::string& path, double interval, std::ostream* output)
+        : m_Path(path), m_Temporary(path + ".tmp"), m_Interval(interval), m_Output(output), m_Last_save(std::chrono::steady_clock::now())
+    {
+        if(!m_Path.empty())
+            m_Thread = std::thread([this]() { WriterLoop(); });
+    }
+
+    ~Checkpointer()
+    {
+        Finish();
+    }
+
+    Checkpointer(const Checkpointer&) = delete;
+    Checkpointer& operator=(const Checkpointer&) = delete;
+
+
+    ////// Restart
+
+    /// @brief read the checkpoint to restart from, for a system of nbBodies bodies advanced by `integrator`
+    /// with the same timestep (the output interval for dopri5) as the run saved
+    bool Load(const std::string& path, size_t nbBodies, uint32_t integrator, T timestep, std::string& error)
+    {
+        std::ifstream stream(path, std::ios::binary);
+        const std::vector<char> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+        CheckpointHeader& header = m_Restart.header;
+        if(file.size() < sizeof(CheckpointHeader))
+        {
+            error = "can't read " + path;
+            return false;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+
+        if(std::memcmp(header.magic, "TIPECKPT", 8) != 0 || header.version != 2 || header.header_size != sizeof(CheckpointHeader))
+            error = path + " is not a checkpoint";
+        else if(header.scalar_size != sizeof(T) || numpyDtype<T>() != std::string(header.dtype, strnlen(header.dtype, sizeof(header.dtype))))
+            error = "the checkpoint is in " + std::string(header.dtype) + ", not " + numpyDtype<T>();
+        else if(header.dimension != D || header.nb_bodies != nbBodies)
+            error = "the checkpoint has " + std::to_string(header.nb_bodies) + " bodies in " + std::to_string(header.dimension) + "D";
+        else if(header.integrator != integrator)
+            error = "the checkpoint was made with another integrator";
+        else if(header.timestep != static_cast<double>(timestep))
+            error = "the checkpoint was made with a timestep of " + std::to_string(header.timestep) + " s";
+        else if(file.size() != sizeof(CheckpointHeader) + PayloadSize(header))
+            error = "the checkpoint is truncated";
+        else
+        {
+            Deserialize(file.data() + sizeof(CheckpointHeader));
+            m_Restarting = true;
+            return true;
+        }
+        return false;
+    }
+
+    bool IsRestart() const { return m_Restarting; }
+
+    /// @brief put the bodies and the integrator back in the state of the checkpoint loaded, and
+    /// resume the trajectory after its frames, timestep being the one given to TrajectoryWriter::Begin
+    template<typename Integ>
+    const CheckpointState<T, D>& Restore(Bodies<T, D>& bodies, Integ& integrator, TrajectoryWriter<T>& writer, T timestep)
+    {
+        bodies = m_Restart.bodies;
+        SetIntegratorState(integrator, bodies);
+
+        const T* position[D];
+        for(int d = 0; d < D; d++)
+            position[d] = bodies.pos[d].data();
+        writer.Resume(bodies.Size(), D, timestep, m_Restart.header.nb_frames, m_Restart.time, position);
+
+        m_Restarting = false;
+        return m_Restart;
+    }
+
+
+    ////// Checkpoints
+
+    /// @brief true when a checkpoint should be saved, to call after each step
+    ///
+    /// The clock is only read every ClockPeriod steps : a two-body step costs less than reading it.
+    bool Due()
+    {
+        if(m_Path.empty() || ++m_Calls % ClockPeriod != 0)
+            return false;
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Last_save).count();
+        return elapsed >= m_Interval;
+    }
+
+    /// @brief save the state after `step` steps, nbFrames frames having been given to the writer,
+    /// timestep being the one given to Load on a restart; false if the previous checkpoint is still being written
+    template<typename Integ>
+    bool Save(size_t step, size_t nbFrames, T time, const Bodies<T, D>& bodies, const Integ& integrator, TrajectoryWriter<T>& writer,
+              T timestep)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if(m_Pending)
+            {
+                m_Skipped++;
+                return false;
+            }
+        }
+
+        writer.Flush();
+
+        CheckpointHeader& header = m_Snapshot.header;
+        std::memcpy(header.magic, "TIPECKPT", 8);
+        header.version = 2;
+        header.header_size = sizeof(CheckpointHeader);
+        std::strncpy(header.dtype, numpyDtype<T>().c_str(), sizeof(header.dtype) - 1);
+        header.scalar_size = sizeof(T);
+        header.nb_bodies = static_cast<uint32_t>(bodies.Size());
+        header.dimension = D;
+        header.integrator = IntegratorCode(integrator);
+        header.step = step;
+        header.nb_frames = nbFrames;
+        header.output_size = m_Output != nullptr ? static_cast<uint64_t>(m_Output->tellp()) : 0;
+        header.timestep = static_cast<double>(timestep);
+
+        // the vectors keep their capacity from one checkpoint to the next
+        m_Snapshot.time = time;
+        m_Snapshot.bodies = bodies;
+        GetIntegratorState(integrator);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Pending = true;
+        }
+        m_Wake.notify_one();
+
+        m_Last_save = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    /// @brief wait for the checkpoint being written, if any
+    void Finish()
+    {
+        if(!m_Thread.joinable())
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Done = true;
+        }
+        m_Wake.notify_one();
+        m_Thread.join();
+    }
+
+    size_t GetWrittenCount() const { return m_Written; }
+    size_t GetSkippedCount() const { return m_Skipped; }
+
+    /// @brief time spent by the background thread on the last checkpoint, in seconds
+    double GetLastWriteTime() const { return m_Last_write_time; }
+
+private :
+    std::string m_Path;
+    std::string m_Temporary;        // the previous checkpoint stays in place until this one is complete
+    double m_Interval;
+    std::ostream* m_Output;
+    std::chrono::steady_clock::time_point m_Last_save;
+    size_t m_Calls = 0;
+
+    CheckpointState<T, D> m_Restart;
+    bool m_Restarting = false;
+
+    // the snapshot is only touched by the background thread while m_Pending is true
+    CheckpointState<T, D> m_Snapshot;
+    std::vector<char> m_Buffer;
+
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Wake;
+    bool m_Pending = false;
+    bool m_Done = false;
+    size_t m_Written = 0;
+    size_t m_Skipped = 0;
+    double m_Last_write_time = 0;
+
+
+    static uint32_t IntegratorCode(const Integrator<T, D>& integrator) { return checkpointIntegrator(integrator.GetType()); }
+    static uint32_t IntegratorCode(const AdaptiveIntegrator<T, D>&) { return CheckpointDopri5; }
+
+    void GetIntegratorState(const Integrator<T, D>& integrator) { integrator.GetState(m_Snapshot.fixed); }
+    void GetIntegratorState(const AdaptiveIntegrator<T, D>& integrator) { integrator.GetState(m_Snapshot.adaptive); }
+
+    void SetIntegratorState(Integrator<T, D>& integrator, const Bodies<T, D>&) { integrator.SetState(m_Restart.fixed); }
+    void SetIntegratorState(AdaptiveIntegrator<T, D>& integrator, const Bodies<T, D>& bodies) { integrator.SetState(m_Restart.adaptive, bodies); }
+
+
+    static size_t PayloadSize(const CheckpointHeader& header)
+    {
+        const size_t n = header.nb_bodies;
+        const size_t integrator = header.integrator == CheckpointDopri5 ? 2 * sizeof(T) + 4 * sizeof(uint64_t) + 2 * D * n * sizeof(T)
+                                                                        : sizeof(uint64_t);
+        return sizeof(T) + integrator + (1 + 3 * D) * n * sizeof(T);
+    }
+
+    void Serialize()
+    {
+        const CheckpointState<T, D>& state = m_Snapshot;
+        const size_t n = state.bodies.Size();
+
+        m_Buffer.resize(sizeof(CheckpointHeader) + PayloadSize(state.header));
+        char* out = m_Buffer.data();
+
+        const auto put_scalars = [&out](const T* values, size_t count) {
+            for(size_t i = 0; i < count; i++, out += sizeof(T))
+                storeScalar(out, values[i]);
+        };
+        const auto put_integer = [&out](uint64_t value) {
+            std::memcpy(out, &value, sizeof(value));
+            out += sizeof(value);
+        };
+
+        std::memcpy(out, &state.header, sizeof(CheckpointHeader));
+        out += sizeof(CheckpointHeader);
+
+        put_scalars(&state.time, 1);
+        if(state.header.integrator == CheckpointDopri5)
+        {
+            put_scalars(&state.adaptive.dt, 1);
+            put_scalars(&state.adaptive.last_dt, 1);
+            put_integer(state.adaptive.accepted_steps);
+            put_integer(state.adaptive.rejected_steps);
+            put_integer(state.adaptive.force_evaluations);
+            put_integer(state.adaptive.first_stage_valid && state.adaptive.first_stage.size() == 2 * D * n);
+
+            // an integrator that has not stepped yet has no first stage
+            const size_t stored = state.adaptive.first_stage.size() == 2 * D * n ? 2 * D * n : 0;
+            put_scalars(state.adaptive.first_stage.data(), stored);
+            std::memset(out, 0, (2 * D * n - stored) * sizeof(T));
+            out += (2 * D * n - stored) * sizeof(T);
+        }
+        else
+            put_integer(state.fixed.accelerations_valid);
+
+        put_scalars(state.bodies.mass.data(), n);
+        for(const std::vector<T>* arrays : { state.bodies.pos, state.bodies.vel, state.bodies.acc })
+            for(int d = 0; d < D; d++)
+                put_scalars(arrays[d].data(), n);
+    }
+
+    void Deserialize(const char* in)
+    {
+        CheckpointState<T, D>& state = m_Restart;
+        const size_t n = state.header.nb_bodies;
+
+        const auto get_scalars = [&in](T* values, size_t count) {
+            std::memcpy(values, in, count * sizeof(T));
+            in += count * sizeof(T);
+        };
+        const auto get_integer = [&in]() {
+            uint64_t value;
+            std::memcpy(&value, in, sizeof(value));
+            in += sizeof(value);
+            return value;
+        };
+
+        get_scalars(&state.time, 1);
+        if(state.header.integrator == CheckpointDopri5)
+        {
+            get_scalars(&state.adaptive.dt, 1);
+            get_scalars(&state.adaptive.last_dt, 1);
+            state.adaptive.accepted_steps = get_integer();
+            state.adaptive.rejected_steps = get_integer();
+            state.adaptive.force_evaluations = get_integer();
+            state.adaptive.first_stage_valid = get_integer() != 0;
+            state.adaptive.first_stage.resize(2 * D * n);
+            get_scalars(state.adaptive.first_stage.data(), 2 * D * n);
+        }
+        else
+            state.fixed.accelerations_valid = get_integer() != 0;
+
+        state.bodies.mass.resize(n);
+        get_scalars(state.bodies.mass.data(), n);
+        for(std::vector<T>* arrays : { state.bodies.pos, state.bodies.vel, state.bodies.acc })
+        {
+            for(int d = 0; d < D; d++)
+            {
+                arrays[d].resize(n);
+                get_scalars(arrays[d].data(), n);
+            }
+        }
+    }
+
+    void WriterLoop()
+    {
+        while(true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Wake.wait(lock, [this]() { return m_Pending || m_Done; });
+                if(!m_Pending)
+                    return;
+            }
+
+            const auto start = std::chrono::steady_clock::now();
+            Serialize();
+
+            bool written;
+            {
+                std::ofstream stream(m_Temporary, std::ios::binary | std::ios::trunc);
+                written = static_cast<bool>(stream.write(m_Buffer.data(), m_Buffer.size()).flush());
+            }
+            std::error_code error;
+            if(written)
+                std::filesystem::rename(m_Temporary, m_Path, error);
+
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Pending = false;
+                if(written && !error)
+                    m_Written++;
+                m_Last_write_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+        }
+    }
+};
@@ -0,0 +1,546 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Trajectory.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+////// Compressed trajectories
+//
+//  The positions change little from one frame to the next, and in a regular way : each scalar is
+//  predicted by extrapolating the previous frames with a polynomial, and only the difference
+//  with the prediction is stored.
+//
+//  Lossless (tolerance = 0), the bits of the value are XORed with the bits of the prediction :
+//  the most significant bytes, equal, give zeros which are only counted (a 4 bits count per
+//  value), the others are stored. The predictions are made from the exact values.
+//
+//  Lossy (tolerance > 0, in m), the difference is rounded to a multiple of 2 * tolerance and
+//  stored as a variable length integer. The predictions are made from the decoded values, so
+//  the error never accumulates : every decoded position is within the tolerance. The time
+//  column stays lossless.
+//
+//  The frames are cut in blocks of block_frames frames (fewer with many bodies, a block holding
+//  at most 8 MiB of frames), each one predicted from its own frames only, so the blocks can be
+//  decoded separately (in parallel, or only the ones holding the frames wanted). The file is :
+//
+//      CompressedTrajectoryHeader
+//      blocks      each block : the counts of the lossless values, two per byte, then the bytes
+//                  of the values, column after column (t, x0, y0, x1 ...) and frame after frame
+//      index       nb_blocks + 1 uint64, the offset of each block in the file then the offset of the index
+//
+
+
+/// @brief first 72 bytes of a compressed trajectory
+///
+/// The timestep is stored : the frames of a decimated or adaptive simulation are not one
+/// timestep apart, so it can't be taken from the time column.
+struct CompressedTrajectoryHeader
+{
+    char magic[8];              // "TIPECTRJ"
+    uint32_t version;
+    uint32_t header_size;
+    char dtype[8];              // numpy descriptor of the scalars, as in TrajectoryHeader
+    uint16_t scalar_size;
+    uint16_t order;             // degree of the polynomial extrapolation
+    uint32_t nb_bodies;
+    uint32_t dimension;
+    uint32_t block_frames;
+    uint64_t nb_frames;         // 0 if the simulation did not end
+    uint64_t index_offset;
+    double tolerance;           // 0 when lossless
+    double timestep;            // as given to Begin
+};
+
+static_assert(sizeof(CompressedTrajectoryHeader) == 72, "the header of the compressed trajectories must stay 72 bytes long");
+
+
+/// @brief prediction of the next value from the previous ones, history[0] being the last one
+template<typename T>
+inline T predictScalar(const T* history, int degree)
+{
+    switch(degree)
+    {
+        case -1: return 0;
+        case 0: return history[0];
+        case 1: return 2 * history[0] - history[1];
+        case 2: return 3 * history[0] - 3 * history[1] + history[2];
+        default: return 4 * history[0] - 6 * history[1] + 4 * history[2] - history[3];
+    }
+}
+
+inline bool isLittleEndian()
+{
+    const uint16_t one = 1;
+    uint8_t first_byte;
+    std::memcpy(&first_byte, &one, 1);
+    return first_byte == 1;
+}
+
+
+/// @brief encoding and decoding of the blocks, see above
+template<typename T>
+class TrajectoryCodec {
+public :
+    static constexpr int MaxOrder = 3;
+    static constexpr size_t Size = sizeof(T);
+    static_assert(Size <= 16, "the counts of zero bytes are 4 bits long");
+
+    TrajectoryCodec(size_t frame_size, int order, T tolerance)
+        : m_Frame_size(frame_size), m_Order(std::min(std::max(order, 0), MaxOrder)), m_Tolerance(tolerance),
+          m_Step(2 * tolerance), m_Little_endian(isLittleEndian())
+    {
+    }
+
+    /// @brief append to `out` the nbFrames frames of `frames` (frame after frame)
+    void Encode(const T* frames, size_t nbFrames, std::vector<uint8_t>& out) const
+    {
+        const size_t nbLossless = nbFrames * (m_Tolerance > 0 ? 1 : m_Frame_size);
+        const size_t counts = out.size();
+        out.resize(counts + (nbLossless + 1) / 2, 0);
+
+        size_t value = 0;
+        for(size_t c = 0; c < m_Frame_size; c++)
+        {
+            T history[MaxOrder + 1] = {};
+            for(size_t k = 0; k < nbFrames; k++)
+            {
+                const T prediction = predictScalar(history, std::min<int>(m_Order, static_cast<int>(k) - 1));
+                const T x = frames[k * m_Frame_size + c];
+
+                T decoded = x;
+                if(c != 0 && m_Tolerance > 0)
+                    decoded = EncodeRounded(x, prediction, out);
+                else
+                {
+                    const uint8_t zeros = EncodeXor(x, prediction, out);
+                    out[counts + value / 2] |= (value % 2 == 0) ? zeros : uint8_t(zeros << 4);
+                    value++;
+                }
+
+                std::copy_backward(history, history + MaxOrder, history + MaxOrder + 1);
+                history[0] = decoded;
+            }
+        }
+    }
+
+    /// @brief decode a block of nbFrames frames into `frames`, false if the bytes are not a block
+    bool Decode(const uint8_t* in, size_t size, size_t nbFrames, T* frames) const
+    {
+        const size_t nbLossless = nbFrames * (m_Tolerance > 0 ? 1 : m_Frame_size);
+        const uint8_t* counts = in;
+        const uint8_t* end = in + size;
+        in += (nbLossless + 1) / 2;
+        if(in > end)
+            return false;
+
+        size_t value = 0;
+        for(size_t c = 0; c < m_Frame_size; c++)
+        {
+            T history[MaxOrder + 1] = {};
+            for(size_t k = 0; k < nbFrames; k++)
+            {
+                const T prediction = predictScalar(history, std::min<int>(m_Order, static_cast<int>(k) - 1));
+
+                T x;
+                if(c != 0 && m_Tolerance > 0)
+                {
+                    if(!DecodeRounded(prediction, in, end, x))
+                        return false;
+                }
+                else
+                {
+                    const uint8_t zeros = (counts[value / 2] >> (value % 2 == 0 ? 0 : 4)) & 0x0F;
+                    value++;
+                    if(!DecodeXor(prediction, zeros, in, end, x))
+                        return false;
+                }
+
+                frames[k * m_Frame_size + c] = x;
+                std::copy_backward(history, history + MaxOrder, history + MaxOrder + 1);
+                history[0] = x;
+            }
+        }
+        return in == end;
+    }
+
+private :
+    size_t m_Frame_size;
+    int m_Order;
+    T m_Tolerance;
+    T m_Step;
+    bool m_Little_endian;
+
+
+    /// @brief index of the byte of significance s, 0 being the most significant
+    size_t Significant(size_t s) const { return m_Little_endian ? Size - 1 - s : s; }
+
+    /// @brief the bytes of x XOR prediction, without the most significant zeros which are counted
+    uint8_t EncodeXor(T x, T prediction, std::vector<uint8_t>& out) const
+    {
+        char value[Size], predicted[Size];
+        storeScalar(value, x);
+        storeScalar(predicted, prediction);
+
+        uint8_t bytes[Size];
+        for(size_t b = 0; b < Size; b++)
+            bytes[b] = static_cast<uint8_t>(value[b] ^ predicted[b]);
+
+        uint8_t zeros = 0;
+        while(zeros < 15 && zeros < Size && bytes[Significant(zeros)] == 0)
+            zeros++;
+
+        const uint8_t* first = m_Little_endian ? bytes : bytes + zeros;
+        out.insert(out.end(), first, first + (Size - zeros));
+        return zeros;
+    }
+
+    bool DecodeXor(T prediction, uint8_t zeros, const uint8_t*& in, const uint8_t* end, T& x) const
+    {
+        if(zeros > Size || in + (Size - zeros) > end)
+            return false;
+
+        char bytes[Size];
+        storeScalar(bytes, prediction);
+        char* first = m_Little_endian ? bytes : bytes + zeros;
+        for(size_t b = 0; b < Size - zeros; b++)
+            first[b] ^= static_cast<char>(in[b]);
+        in += Size - zeros;
+
+        std::memcpy(&x, bytes, Size);
+        return true;
+    }
+
+    /// @brief (x - prediction) / (2 tolerance) rounded, as a zigzag varint shifted by one, 0 being
+    /// followed by the raw value when the rounding can't give x within the tolerance
+    T EncodeRounded(T x, T prediction, std::vector<uint8_t>& out) const
+    {
+        const T quotient = floor((x - prediction) / m_Step + T(0.5));
+        const T limit = static_cast<T>(int64_t(1) << 61);
+        if(quotient > -limit && quotient < limit)
+        {
+            const int64_t q = static_cast<int64_t>(quotient);
+            const T decoded = prediction + static_cast<T>(q) * m_Step;
+            if(abs(decoded - x) <= m_Tolerance)
+            {
+                WriteVarint(((static_cast<uint64_t>(q) << 1) ^ static_cast<uint64_t>(q >> 63)) + 1, out);
+                return decoded;
+            }
+        }
+
+        out.push_back(0);
+        char raw[Size];
+        storeScalar(raw, x);
+        out.insert(out.end(), raw, raw + Size);
+        return x;
+    }
+
+    bool DecodeRounded(T prediction, const uint8_t*& in, const uint8_t* end, T& x) const
+    {
+        uint64_t code;
+        if(!ReadVarint(in, end, code))
+            return false;
+
+        if(code == 0)
+        {
+            if(in + Size > end)
+                return false;
+            std::memcpy(&x, in, Size);
+            in += Size;
+            return true;
+        }
+
+        const uint64_t zigzag = code - 1;
+        const int64_t q = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+        x = prediction + static_cast<T>(q) * m_Step;
+        return true;
+    }
+
+    static void WriteVarint(uint64_t value, std::vector<uint8_t>& out)
+    {
+        while(value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    static bool ReadVarint(const uint8_t*& in, const uint8_t* end, uint64_t& value)
+    {
+        value = 0;
+        for(int shift = 0; shift < 64; shift += 7)
+        {
+            if(in == end)
+                return false;
+
+            const uint8_t byte = *in++;
+            value |= uint64_t(byte & 0x7F) << shift;
+            if((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+
+/// @brief compressed trajectory written to a stream which can be rewound (a file), see above
+///
+/// The frames of a block are kept until it is full, then encoded and written. End writes the
+/// last block, the index, and the number of frames in the header.
+template<typename T>
+class CompressedTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    static constexpr size_t DefaultBlockFrames = 4096;
+    static constexpr int DefaultOrder = 3;
+    // frames of a block at most, in bytes before encoding : with many bodies, a block holds fewer frames
+    static constexpr size_t BlockBytes = size_t(8) << 20;
+
+    /// @brief tolerance in m, 0 for a lossless compression, and blocks of at most block_frames frames
+    explicit CompressedTrajectoryWriter(std::ostream& stream, T tolerance = 0, size_t block_frames = DefaultBlockFrames, int order = DefaultOrder)
+        : m_Stream(stream), m_Tolerance(tolerance), m_Max_block_frames(std::max<size_t>(1, block_frames)), m_Order(order)
+    {
+    }
+
+    void Begin(size_t nbBodies, int dimension, T timestep) override
+    {
+        m_Dimension = dimension;
+        m_Frame_size = 1 + nbBodies * dimension;
+        m_Block_frames = std::max<size_t>(1, std::min(m_Max_block_frames, BlockBytes / (m_Frame_size * sizeof(T))));
+
+        m_Header = {};
+        std::memcpy(m_Header.magic, "TIPECTRJ", 8);
+        m_Header.version = 2;
+        m_Header.header_size = sizeof(CompressedTrajectoryHeader);
+        std::strncpy(m_Header.dtype, numpyDtype<T>().c_str(), sizeof(m_Header.dtype) - 1);
+        m_Header.scalar_size = sizeof(T);
+        m_Header.order = static_cast<uint16_t>(std::min(std::max(m_Order, 0), TrajectoryCodec<T>::MaxOrder));
+        m_Header.nb_bodies = static_cast<uint32_t>(nbBodies);
+        m_Header.dimension = static_cast<uint32_t>(dimension);
+        m_Header.block_frames = static_cast<uint32_t>(m_Block_frames);
+        m_Header.tolerance = static_cast<double>(m_Tolerance);
+        m_Header.timestep = static_cast<double>(timestep);
+
+        m_Header_position = m_Stream.tellp();
+        m_Stream.write(reinterpret_cast<const char*>(&m_Header), sizeof(m_Header));
+
+        m_Frames.clear();
+        m_Frames.reserve(m_Block_frames * m_Frame_size);
+        m_Offsets.clear();
+        m_Offsets.reserve(OffsetsReserved);
+        m_Nb_frames = 0;
+        m_Size = sizeof(CompressedTrajectoryHeader);
+    }
+
+    void WriteFrame(T time, const T* const* position, size_t nbBodies) override
+    {
+        m_Frames.push_back(time);
+        for(size_t i = 0; i < nbBodies; i++)
+        {
+            for(int d = 0; d < m_Dimension; d++)
+                m_Frames.push_back(position[d][i]);
+        }
+
+        m_Nb_frames++;
+        if(m_Frames.size() == m_Block_frames * m_Frame_size)
+            WriteBlock();
+    }
+
+    void End() override
+    {
+        if(!m_Frames.empty())
+            WriteBlock();
+
+        // index, then the header giving where it is
+        m_Offsets.push_back(m_Size);
+        m_Stream.write(reinterpret_cast<const char*>(m_Offsets.data()), m_Offsets.size() * sizeof(uint64_t));
+
+        m_Header.nb_frames = m_Nb_frames;
+        m_Header.index_offset = m_Size;
+        const std::streampos end = m_Stream.tellp();
+        m_Stream.seekp(m_Header_position);
+        m_Stream.write(reinterpret_cast<const char*>(&m_Header), sizeof(m_Header));
+        m_Stream.seekp(end);
+        m_Stream.flush();
+    }
+
+    void Flush() override { m_Stream.flush(); }
+
+    size_t GetFrameCount() const { return m_Nb_frames; }
+
+    /// @brief bytes written so far, without the frames of the block not full yet
+    size_t GetSize() const { return m_Size; }
+
+private :
+    std::ostream& m_Stream;
+    T m_Tolerance;
+    size_t m_Max_block_frames;
+    int m_Order;
+
+    CompressedTrajectoryHeader m_Header = {};
+    std::streampos m_Header_position = -1;
+    int m_Dimension = 2;
+    size_t m_Frame_size = 1;
+    size_t m_Block_frames = 1;
+    size_t m_Nb_frames = 0;
+    uint64_t m_Size = 0;
+
+    std::vector<T> m_Frames;            // frames of the current block
+    std::vector<uint8_t> m_Block;       // encoded block, kept so it only grows over the first blocks
+    std::vector<uint64_t> m_Offsets;
+
+    // blocks indexed before m_Offsets grows (8 GiB of frames)
+    static constexpr size_t OffsetsReserved = 1024;
+
+
+    void WriteBlock()
+    {
+        const TrajectoryCodec<T> codec(m_Frame_size, m_Header.order, m_Tolerance);
+        m_Block.clear();
+        codec.Encode(m_Frames.data(), m_Frames.size() / m_Frame_size, m_Block);
+
+        m_Offsets.push_back(m_Size);
+        m_Stream.write(reinterpret_cast<const char*>(m_Block.data()), m_Block.size());
+        m_Size += m_Block.size();
+        profileCount(Counter::BytesWritten, m_Block.size());
+        m_Frames.clear();
+    }
+};
+
+
+/// @brief random access to the frames of a compressed trajectory
+///
+/// Only the blocks holding the frames asked for are read, and they are decoded on the threads of a pool.
+template<typename T>
+class CompressedTrajectoryReader {
+public :
+    /// @brief read the header and the index of the file at `path`, false if it is not a finished
+    /// compressed trajectory of T scalars
+    bool Open(const std::string& path, std::string& error)
+    {
+        m_Stream.close();
+        m_Stream.open(path, std::ios::binary);
+        if(!m_Stream.is_open())
+        {
+            error = "can't open " + path;
+            return false;
+        }
+
+        if(!m_Stream.read(reinterpret_cast<char*>(&m_Header), sizeof(m_Header)) || std::memcmp(m_Header.magic, "TIPECTRJ", 8) != 0)
+        {
+            error = path + " is not a compressed trajectory";
+            return false;
+        }
+        if(m_Header.version != 2 || m_Header.header_size != sizeof(CompressedTrajectoryHeader))
+        {
+            error = path + " is a compressed trajectory of an unknown version";
+            return false;
+        }
+        const std::string dtype(m_Header.dtype, sizeof(m_Header.dtype));
+        if(m_Header.scalar_size != sizeof(T) || numpyDtype<T>() != dtype.c_str())
+        {
+            error = path + " is not a trajectory of " + scalarName<T>();
+            return false;
+        }
+        if(m_Header.index_offset == 0 || m_Header.block_frames == 0)
+        {
+            error = path + " was not ended";
+            return false;
+        }
+
+        const size_t nbBlocks = (m_Header.nb_frames + m_Header.block_frames - 1) / m_Header.block_frames;
+        m_Offsets.resize(nbBlocks + 1);
+        m_Stream.seekg(m_Header.index_offset);
+        if(!m_Stream.read(reinterpret_cast<char*>(m_Offsets.data()), m_Offsets.size() * sizeof(uint64_t)))
+        {
+            error = path + " has no index";
+            return false;
+        }
+
+        return true;
+    }
+
+    const CompressedTrajectoryHeader& GetHeader() const { return m_Header; }
+    size_t GetBodyCount() const { return m_Header.nb_bodies; }
+    int GetDimension() const { return static_cast<int>(m_Header.dimension); }
+    size_t GetFrameCount() const { return m_Header.nb_frames; }
+    T GetTimestep() const { return static_cast<T>(m_Header.timestep); }
+    size_t GetBlockCount() const { return m_Offsets.empty() ? 0 : m_Offsets.size() - 1; }
+
+    /// @brief scalars in a frame, [t, x0, y0, x1, ...]
+    size_t GetFrameSize() const { return 1 + m_Header.nb_bodies * m_Header.dimension; }
+
+    /// @brief decode frames [first, first + count) into `frames` (count * GetFrameSize() scalars),
+    /// the blocks being shared between the threads of `pool` if not null
+    bool ReadFrames(size_t first, size_t count, T* frames, ThreadPool* pool = nullptr)
+    {
+        if(count == 0)
+            return true;
+        if(first + count > GetFrameCount())
+            return false;
+
+        const size_t block_frames = m_Header.block_frames;
+        const size_t first_block = first / block_frames;
+        const size_t last_block = (first + count - 1) / block_frames;
+
+        // one read for all the blocks
+        const uint64_t begin = m_Offsets[first_block];
+        m_Bytes.resize(m_Offsets[last_block + 1] - begin);
+        m_Stream.clear();
+        m_Stream.seekg(begin);
+        if(!m_Stream.read(reinterpret_cast<char*>(m_Bytes.data()), m_Bytes.size()))
+            return false;
+
+        const size_t frame_size = GetFrameSize();
+        const size_t nbThreads = pool != nullptr ? pool->Size() : 1;
+        m_Scratch.resize(nbThreads);
+        std::vector<char> valid(last_block - first_block + 1, 0);
+
+        const auto decode = [&](size_t b_begin, size_t b_end, size_t thread) {
+            const TrajectoryCodec<T> codec(frame_size, m_Header.order, static_cast<T>(m_Header.tolerance));
+            std::vector<T>& scratch = m_Scratch[thread];
+
+            for(size_t b = first_block + b_begin; b < first_block + b_end; b++)
+            {
+                const size_t block_first = b * block_frames;
+                const size_t nbFrames = std::min<size_t>(block_frames, GetFrameCount() - block_first);
+                scratch.resize(nbFrames * frame_size);
+
+                const uint8_t* in = m_Bytes.data() + (m_Offsets[b] - begin);
+                if(!codec.Decode(in, m_Offsets[b + 1] - m_Offsets[b], nbFrames, scratch.data()))
+                    continue;
+
+                // the frames of the block asked for
+                const size_t from = std::max(first, block_first);
+                const size_t to = std::min(first + count, block_first + nbFrames);
+                std::copy(scratch.data() + (from - block_first) * frame_size, scratch.data() + (to - block_first) * frame_size,
+                          frames + (from - first) * frame_size);
+                valid[b - first_block] = 1;
+            }
+        };
+
+        if(pool != nullptr)
+            pool->ParallelFor(valid.size(), decode);
+        else
+            decode(0, valid.size(), 0);
+
+        return std::find(valid.begin(), valid.end(), 0) == valid.end();
+    }
+
+private :
+    std::ifstream m_Stream;
+    CompressedTrajectoryHeader m_Header = {};
+    std::vector<uint64_t> m_Offsets;
+    std::vector<uint8_t> m_Bytes;
+    std::vector<std::vector<T>> m_Scratch;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Scalar.h"
+
+
+//////////  Constants
+
+/// @brief the constant of gravitation
+template<typename T>
+constexpr T G = static_cast<T>(6.67e-11L);
+
+template<typename T>
+constexpr T PI = static_cast<T>(3.141592653589793238462643383279502884L);
+
+#ifdef USE_QUAD
+template<>
+constexpr quad PI<quad> = M_PIq;
+#endif
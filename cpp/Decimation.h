@@ -0,0 +1,256 @@
+#pragma once
+
+#include "Trajectory.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+
+/// @brief which frames of the simulation are written
+enum class DecimationType
+{
+    All,            // every frame
+    Every,          // one frame every N steps
+    Interval,       // the first frame after each multiple of a simulated duration
+    Curvature       // a frame when a body has turned enough for a straight line to be visibly wrong
+};
+
+struct DecimationPolicy
+{
+    DecimationType type = DecimationType::All;
+    size_t every = 1;
+    ldouble interval = 0;       // s
+    ldouble tolerance = 0;      // sagitta / chord between two written frames
+};
+
+/// @brief "all", "every:N", "interval:seconds" or "curvature:tolerance"
+inline bool parseDecimationPolicy(const std::string& text, DecimationPolicy& policy)
+{
+    const size_t colon = text.find(':');
+    const std::string name = text.substr(0, colon);
+    const char* value = colon == std::string::npos ? "" : text.c_str() + colon + 1;
+
+    if(name == "all")
+        policy.type = DecimationType::All;
+    else if(name == "every" && strtoul(value, nullptr, 10) > 0)
+    {
+        policy.type = DecimationType::Every;
+        policy.every = strtoul(value, nullptr, 10);
+    }
+    else if(name == "interval" && strtold(value, nullptr) > 0)
+    {
+        policy.type = DecimationType::Interval;
+        policy.interval = strtold(value, nullptr);
+    }
+    else if(name == "curvature" && strtold(value, nullptr) > 0)
+    {
+        policy.type = DecimationType::Curvature;
+        policy.tolerance = strtold(value, nullptr);
+    }
+    else
+        return false;
+
+    return true;
+}
+
+
+/// @brief TrajectoryWriter dropping the frames the policy does not need, before they are formatted
+///
+/// The first and the last frames are always written. The curvature policy follows the direction
+/// of each body from one frame to the next : a circular arc turning by an angle a is drawn
+/// as a chord whose sagitta is about a/8 of its length, so a frame is written as soon as one body
+/// has turned by 8 * tolerance since the last written frame. Straight motions give almost no frames.
+template<typename T>
+class DecimatingTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    DecimatingTrajectoryWriter(TrajectoryWriter<T>& output, const DecimationPolicy& policy)
+        : m_Output(output), m_Policy(policy)
+    {
+        const ldouble angle = 8 * policy.tolerance;
+        m_Cos_angle = static_cast<T>(angle < 3.14159265358979L ? std::cos(angle) : -1.0L);
+    }
+
+    void Begin(size_t nbBodies, int dimension, T timestep) override
+    {
+        m_Output.Begin(nbBodies, dimension, timestep);
+        Start(nbBodies, dimension);
+    }
+
+    /// @brief go on after a checkpoint; the curvature policy has lost the directions of the bodies
+    /// and starts following them again, as at the first frames
+    void Resume(size_t nbBodies, int dimension, T timestep, size_t nbFrames, T time, const T* const* position) override
+    {
+        m_Output.Resume(nbBodies, dimension, timestep, nbFrames, time, position);
+        Start(nbBodies, dimension);
+
+        // nbFrames frames were received, the last one, at `time`, being the previous position of the bodies
+        m_Nb_frames = nbFrames;
+        m_Last[0] = time;
+        for(int d = 0; d < dimension; d++)
+            std::copy(position[d], position[d] + nbBodies, m_Last.begin() + 1 + d * nbBodies);
+        if(m_Policy.type == DecimationType::Interval)
+        {
+            const T interval = static_cast<T>(m_Policy.interval);
+            m_Next_time = (floor(time / interval) + 1) * interval;
+        }
+    }
+
+    void WriteFrame(T time, const T* const* position, size_t nbBodies) override
+    {
+        const bool keep = Keep(time, position, nbBodies);
+        const bool write = keep || m_Nb_frames == 0;
+
+        if(write)
+        {
+            m_Output.WriteFrame(time, position, nbBodies);
+            m_Nb_written++;
+        }
+
+        if(m_Policy.type == DecimationType::Curvature && m_Nb_frames != 0)
+            UpdateDirections(position, nbBodies, write);
+
+        // the last frame is kept to be written by End, and as the previous position of the bodies
+        m_Last[0] = time;
+        for(int d = 0; d < m_Dimension; d++)
+            std::copy(position[d], position[d] + nbBodies, m_Last.begin() + 1 + d * m_Nb_bodies);
+        m_Pending = !write;
+        m_Nb_frames++;
+    }
+
+    void End() override
+    {
+        if(m_Pending)
+        {
+            const T* position[3];
+            for(int d = 0; d < m_Dimension; d++)
+                position[d] = LastPosition(d);
+            m_Output.WriteFrame(m_Last[0], position, m_Nb_bodies);
+            m_Nb_written++;
+            m_Pending = false;
+        }
+        m_Output.End();
+    }
+
+    /// @brief the frame waiting to be written is not given to the output : the checkpoint
+    /// records it as the last frame received, and a restart starts after it
+    void Flush() override { m_Output.Flush(); }
+
+    size_t GetFrameCount() const { return m_Nb_frames; }
+    size_t GetWrittenCount() const { return m_Nb_written; }
+
+private :
+    TrajectoryWriter<T>& m_Output;
+    DecimationPolicy m_Policy;
+    T m_Cos_angle;
+
+    size_t m_Nb_bodies = 0;
+    int m_Dimension = 2;
+    size_t m_Nb_frames = 0;
+    size_t m_Nb_written = 0;
+    T m_Next_time = 0;
+    bool m_Pending = false;
+    std::vector<T> m_Last;
+
+    // curvature : unit direction of each body when its last frame was written
+    std::vector<T> m_Written_direction;
+    std::vector<bool> m_Has_direction;
+
+
+    void Start(size_t nbBodies, int dimension)
+    {
+        m_Nb_bodies = nbBodies;
+        m_Dimension = dimension;
+        m_Nb_frames = 0;
+        m_Nb_written = 0;
+        m_Next_time = 0;
+        m_Pending = false;
+
+        // last frame received : [t, x0 ... xn-1, y0 ... yn-1 (, z0 ... zn-1)]
+        m_Last.assign(1 + dimension * nbBodies, T(0));
+        if(m_Policy.type == DecimationType::Curvature)
+        {
+            m_Written_direction.assign(dimension * nbBodies, T(0));
+            m_Has_direction.assign(nbBodies, false);
+        }
+    }
+
+    const T* LastPosition(int d) const { return m_Last.data() + 1 + d * m_Nb_bodies; }
+
+    bool Keep(T time, const T* const* position, size_t nbBodies)
+    {
+        switch(m_Policy.type)
+        {
+        case DecimationType::All :
+            return true;
+        case DecimationType::Every :
+            return m_Nb_frames % m_Policy.every == 0;
+        case DecimationType::Interval :
+        {
+            if(time < m_Next_time)
+                return false;
+
+            // next multiple of the interval, without accumulating rounding errors
+            const T interval = static_cast<T>(m_Policy.interval);
+            m_Next_time = (floor(time / interval) + 1) * interval;
+            return true;
+        }
+        case DecimationType::Curvature :
+            return HasTurned(position, nbBodies);
+        }
+        return true;
+    }
+
+    /// @brief true when the step from the last frame received to this one has turned too much
+    bool HasTurned(const T* const* position, size_t nbBodies) const
+    {
+        for(size_t i = 0; i < nbBodies; i++)
+        {
+            if(!m_Has_direction[i])
+                continue;
+
+            T dot = 0;
+            T norm_squared = 0;
+            for(int d = 0; d < m_Dimension; d++)
+            {
+                const T step = position[d][i] - LastPosition(d)[i];
+                dot += step * m_Written_direction[m_Dimension * i + d];
+                norm_squared += step * step;
+            }
+
+            // cos(turned angle) < cos(8 tolerance), without any square root
+            if(dot < 0 ? m_Cos_angle >= 0 || dot * dot > m_Cos_angle * m_Cos_angle * norm_squared
+                       : m_Cos_angle >= 0 && dot * dot < m_Cos_angle * m_Cos_angle * norm_squared)
+                return true;
+        }
+        return false;
+    }
+
+    /// @brief remember the direction of the bodies at the frames written
+    void UpdateDirections(const T* const* position, size_t nbBodies, bool written)
+    {
+        for(size_t i = 0; i < nbBodies; i++)
+        {
+            if(written || !m_Has_direction[i])
+            {
+                T step[3];
+                T norm_squared = 0;
+                for(int d = 0; d < m_Dimension; d++)
+                {
+                    step[d] = position[d][i] - LastPosition(d)[i];
+                    norm_squared += step[d] * step[d];
+                }
+                if(norm_squared == 0)
+                    continue;
+
+                const T norm = sqrt(norm_squared);
+                for(int d = 0; d < m_Dimension; d++)
+                    m_Written_direction[m_Dimension * i + d] = step[d] / norm;
+                m_Has_direction[i] = true;
+            }
+        }
+    }
+};
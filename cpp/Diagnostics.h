@@ -0,0 +1,223 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Constants.h"
+#include "Vector.h"
+#include "System.h"
+#include "Integrators.h"
+#include <algorithm>
+#include <ostream>
+#include <vector>
+
+
+////// Conserved quantities
+//
+//  The energy, the angular momentum and, for two bodies, the Laplace-Runge-Lenz vector are
+//  constant along the exact solution : how much they drift measures the error of the integration.
+//
+//  The kinetic energy and the angular momentum cost O(N). The potential energy is the O(N²) part :
+//  instead of a second pass over the pairs, the force evaluation writes the potential of each body
+//  from the inverse distances it computes anyway (gravityRows, AccumulatePairs, BarnesHutTree).
+//  With Verlet and dopri5 the last evaluation of a step is at the final positions, so the record
+//  costs nothing more. With Euler and RK4 the evaluation is only moved from the start of the next
+//  step, and Yoshida pays one evaluation per record. The records are taken every few steps only.
+//
+
+template<typename T>
+struct ConservedQuantities
+{
+    T time = 0;
+    T kinetic = 0;
+    T potential = 0;
+    Vec3<T> angular_momentum = Vec3<T>::Zero();   // sum of m r x v, along z in 2D
+    Vec3<T> eccentricity = Vec3<T>::Zero();       // Laplace-Runge-Lenz vector / (mu m), two bodies only
+
+    T Energy() const { return kinetic + potential; }
+};
+
+
+/// @brief records of the conserved quantities of a simulation, every `every` steps
+///
+/// The bodies attract each other, and are attracted by central_mass fixed at the origin if it is
+/// not 0 (the two-body simulations, where a single body moves). The eccentricity vector is the
+/// one of this single body, or of the relative motion of two bodies.
+///
+/// Each record is a line "time;kinetic;potential;energy;energy_error;Lx;Ly;Lz;angular_momentum_error;ex;ey;ez"
+/// of the output, the errors being relative to the first record.
+template<typename T, int D>
+class Diagnostics {
+public :
+    Diagnostics(size_t every, T central_mass = 0, std::ostream* output = nullptr)
+        : m_Every(every == 0 ? 1 : every), m_Central_mass(central_mass), m_Output(output)
+    {
+    }
+
+    /// @brief forget the records, to measure another run
+    void Reset(size_t every, std::ostream* output)
+    {
+        m_Every = every == 0 ? 1 : every;
+        m_Output = output;
+        m_Capturing = m_Captured = false;
+        m_Nb_records = 0;
+        m_Max_energy_error = m_Max_angular_momentum_error = m_Max_precession = 0;
+    }
+
+    /// @brief true when the state after `step` steps is to be recorded : call Capture before that step
+    bool Due(size_t step) const { return step % m_Every == 0; }
+
+    /// @brief the force evaluations of the next step write the potential of the bodies
+    void Capture() { m_Capturing = m_Captured = true; }
+
+    /// @brief where the force evaluation writes the potential of the n bodies, null when it is not needed
+    T* Potential(size_t n)
+    {
+        if(!m_Capturing)
+            return nullptr;
+
+        m_Potential.resize(n);
+        return m_Potential.data();
+    }
+
+    /// @brief record the state of the bodies at `time`, the step just done having been captured or not
+    template<typename Integ, typename Force>
+    const ConservedQuantities<T>& Record(T time, Bodies<T, D>& bodies, Integ& integrator, Force&& force)
+    {
+        // the potential of the last evaluation is only valid if it was at the current positions
+        if(bodies.Size() > 1 && !(m_Captured && integrator.HasAccelerations()))
+        {
+            m_Capturing = true;
+            force(bodies);
+            AccelerationsComputed(integrator);
+        }
+        m_Capturing = m_Captured = false;
+
+        Measure(time, bodies, m_Current);
+        if(m_Nb_records == 0)
+        {
+            m_Initial = m_Current;
+            if(m_Output != nullptr)
+                *m_Output << "time;kinetic;potential;energy;energy_error;Lx;Ly;Lz;angular_momentum_error;ex;ey;ez\n";
+        }
+
+        const T energy_error = EnergyError();
+        const T angular_momentum_error = AngularMomentumError();
+        m_Max_energy_error = std::max(m_Max_energy_error, abs(energy_error));
+        m_Max_angular_momentum_error = std::max(m_Max_angular_momentum_error, angular_momentum_error);
+        m_Max_precession = std::max(m_Max_precession, abs(Precession()));
+
+        if(m_Output != nullptr)
+        {
+            const T values[] = { m_Current.time, m_Current.kinetic, m_Current.potential, m_Current.Energy(), energy_error,
+                                 m_Current.angular_momentum.x, m_Current.angular_momentum.y, m_Current.angular_momentum.z, angular_momentum_error,
+                                 m_Current.eccentricity.x, m_Current.eccentricity.y, m_Current.eccentricity.z };
+            for(size_t k = 0; k < sizeof(values) / sizeof(values[0]); k++)
+            {
+                if(k != 0)
+                    *m_Output << ';';
+                writeScalar(*m_Output, values[k]);
+            }
+            *m_Output << '\n';
+        }
+
+        m_Nb_records++;
+        return m_Current;
+    }
+
+    const ConservedQuantities<T>& GetInitial() const { return m_Initial; }
+    const ConservedQuantities<T>& GetCurrent() const { return m_Current; }
+    size_t GetRecordCount() const { return m_Nb_records; }
+
+    /// @brief (E - E0) / |E0| of the last record
+    T EnergyError() const
+    {
+        const T initial = m_Initial.Energy();
+        return initial != 0 ? (m_Current.Energy() - initial) / abs(initial) : m_Current.Energy();
+    }
+
+    /// @brief |L - L0| / |L0| of the last record
+    T AngularMomentumError() const
+    {
+        const T drift = (m_Current.angular_momentum - m_Initial.angular_momentum).Magnitude();
+        const T initial = m_Initial.angular_momentum.Magnitude();
+        return initial != 0 ? drift / initial : drift;
+    }
+
+    /// @brief angle in radians from the first eccentricity vector to the last one, 0 for circular orbits
+    T Precession() const
+    {
+        const Vec3<T>& e0 = m_Initial.eccentricity;
+        const Vec3<T>& e = m_Current.eccentricity;
+        return atan2(cross(e0, e).Magnitude(), dot(e0, e));
+    }
+
+    T GetMaxEnergyError() const { return m_Max_energy_error; }
+    T GetMaxAngularMomentumError() const { return m_Max_angular_momentum_error; }
+    T GetMaxPrecession() const { return m_Max_precession; }
+
+private :
+    size_t m_Every;
+    T m_Central_mass;
+    std::ostream* m_Output;
+
+    bool m_Capturing = false;       // the force evaluations write m_Potential
+    bool m_Captured = false;        // every evaluation since Capture did
+    std::vector<T> m_Potential;
+
+    ConservedQuantities<T> m_Initial;
+    ConservedQuantities<T> m_Current;
+    size_t m_Nb_records = 0;
+    T m_Max_energy_error = 0;
+    T m_Max_angular_momentum_error = 0;
+    T m_Max_precession = 0;
+
+
+    static void AccelerationsComputed(Integrator<T, D>& integrator) { integrator.AccelerationsComputed(); }
+    static void AccelerationsComputed(AdaptiveIntegrator<T, D>&) {}
+
+    static Vec3<T> Extend(const VecN<T, D>& v)
+    {
+        if constexpr(D == 3)
+            return v;
+        else
+            return Vec3<T>(v.x, v.y, 0);
+    }
+
+    void Measure(T time, const Bodies<T, D>& bodies, ConservedQuantities<T>& quantities) const
+    {
+        const size_t n = bodies.Size();
+        const T* m = bodies.mass.data();
+
+        quantities.time = time;
+        quantities.kinetic = 0;
+        quantities.potential = 0;
+        quantities.angular_momentum = Vec3<T>::Zero();
+
+        for(size_t i = 0; i < n; i++)
+        {
+            const Vec3<T> r = Extend(bodies.GetPosition(i));
+            const Vec3<T> v = Extend(bodies.GetVelocity(i));
+
+            quantities.kinetic += m[i] * v.Magnitude_squared() / 2;
+            quantities.angular_momentum += m[i] * cross(r, v);
+
+            // each pair is in the potential of both bodies
+            if(n > 1)
+                quantities.potential += m[i] * m_Potential[i] / 2;
+            if(m_Central_mass != 0)
+                quantities.potential -= G<T> * m_Central_mass * m[i] / r.Magnitude();
+        }
+
+        quantities.eccentricity = Vec3<T>::Zero();
+        if(m_Central_mass != 0 && n == 1)
+            quantities.eccentricity = Eccentricity(Extend(bodies.GetPosition(0)), Extend(bodies.GetVelocity(0)), G<T> * m_Central_mass);
+        else if(m_Central_mass == 0 && n == 2)
+            quantities.eccentricity = Eccentricity(Extend(bodies.GetPosition(1) - bodies.GetPosition(0)),
+                                                   Extend(bodies.GetVelocity(1) - bodies.GetVelocity(0)), G<T> * (m[0] + m[1]));
+    }
+
+    /// @brief e = v x (r x v) / mu - r / |r|, pointing to the periapsis with the eccentricity as length
+    static Vec3<T> Eccentricity(const Vec3<T>& r, const Vec3<T>& v, T mu)
+    {
+        return cross(v, cross(r, v)) / mu - r.Normalised();
+    }
+};
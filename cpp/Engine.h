@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Vector.h"
+#include "System.h"
+#include "Integrators.h"
+#include "Gravity.h"
+#include "BarnesHut.h"
+#include "ThreadPool.h"
+#include "Trajectory.h"
+#include "Simulation.h"
+#include <cstddef>
+#include <type_traits>
+
+
+////// Library API
+//
+//  The N-body simulation of the command line, driven from another program : create the system,
+//  step it N times, query its state, as many times as needed. The headers are the whole library,
+//  they only need the threads (-pthread). The Python module of bindings.cpp is built on it.
+
+
+/// @brief how an Engine computes the accelerations and integrates them, as the options of the command line
+struct EngineSettings
+{
+    IntegratorType integrator = IntegratorType::Verlet;
+    bool barnes_hut = false;        // quadtree (octree in 3D) instead of the direct summation
+    double theta = 0.5;             // opening angle of the tree
+    double softening = 0;           // Plummer softening length in m
+    size_t threads = 1;             // 0 for every core
+    bool simd_kernel = true;        // direct summation in SIMD registers, float and double only
+};
+
+
+/// @brief bodies of a system advanced together with a fixed timestep, from one call to Step to the next
+///
+/// The state is kept between the calls, so stepping 10 times by 100 steps gives the same
+/// trajectory as stepping once by 1000. The frames can be given to a TrajectoryWriter as
+/// they are computed (a MemoryTrajectoryWriter to keep them in memory).
+template<typename T, int D = 2>
+class Engine {
+public :
+    static constexpr int Dim = D;
+    using Vector = VecD<T, D>;
+
+    explicit Engine(const EngineSettings& settings = EngineSettings())
+        : m_Settings(settings),
+          m_Pool(settings.threads),
+          m_Integrator(settings.integrator),
+          m_Tree(static_cast<T>(settings.theta), static_cast<T>(settings.softening)),
+          m_Direct(m_Pool, UsesSimdKernel(settings) ? DirectKernel::Simd : DirectKernel::Pairs, static_cast<T>(settings.softening))
+    {
+    }
+
+    ~Engine() { Finish(); }
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    const EngineSettings& GetSettings() const { return m_Settings; }
+
+    /// @brief SIMD kernel of the direct summation, only worth it with SIMD registers
+    static bool UsesSimdKernel(const EngineSettings& settings)
+    {
+        return settings.simd_kernel && !settings.barnes_hut && (std::is_same<T, float>::value || std::is_same<T, double>::value);
+    }
+
+
+    ////// System
+
+    void AddBody(T mass, const Vector& position, const Vector& velocity)
+    {
+        m_Bodies.AddBody(mass, position, velocity);
+        Invalidate();
+    }
+
+    /// @brief add the bodies of a file, in the format of the command line (see loadSystem)
+    bool LoadSystem(const char* filepath)
+    {
+        Invalidate();
+        return loadSystem(filepath, m_Bodies);
+    }
+
+    /// @brief to call when the bodies have been changed through GetBodies
+    void Invalidate() { m_Integrator.Invalidate(); }
+
+    size_t Size() const { return m_Bodies.Size(); }
+
+    /// @brief the arrays of the bodies, x in pos[0], y in pos[1] ...
+    const Bodies<T, D>& GetBodies() const { return m_Bodies; }
+    Bodies<T, D>& GetBodies() { return m_Bodies; }
+
+    T GetTime() const { return m_Time; }
+    void SetTime(T time) { m_Time = time; }
+
+    /// @brief steps done since the engine was created
+    size_t GetStepCount() const { return m_Nb_steps; }
+
+
+    ////// Stepping
+
+    /// @brief give the next frames to `writer` (nullptr for none), the first one being the current state
+    ///
+    /// The writer is begun by the next Step, once the timestep is known, and ended by Finish.
+    void Record(TrajectoryWriter<T>* writer)
+    {
+        Finish();
+        m_Writer = writer;
+    }
+
+    bool HasWriter() const { return m_Writer != nullptr; }
+
+    /// @brief true once the writer has been begun, the next steps adding a frame each
+    bool IsRecording() const { return m_Recording; }
+
+    /// @brief end the recording, if any
+    void Finish()
+    {
+        if(m_Writer != nullptr && m_Recording)
+            m_Writer->End();
+        m_Recording = false;
+    }
+
+    /// @brief advance the bodies by nbSteps steps of dt
+    void Step(size_t nbSteps, T dt)
+    {
+        if(m_Writer != nullptr && !m_Recording)
+        {
+            m_Writer->Begin(m_Bodies.Size(), D, dt);
+            m_Writer->WriteFrame(m_Time, m_Bodies);
+            m_Recording = true;
+        }
+
+        const auto force = [this](Bodies<T, D>& state) { ComputeAccelerations(state); };
+        for(size_t i = 0; i < nbSteps; i++)
+        {
+            m_Integrator.Step(m_Bodies, dt, force);
+            m_Time += dt;
+            m_Nb_steps++;
+
+            if(m_Writer != nullptr)
+                m_Writer->WriteFrame(m_Time, m_Bodies);
+        }
+    }
+
+    /// @brief fill state.acc with the force backend of the settings
+    void ComputeAccelerations(Bodies<T, D>& state)
+    {
+        if(m_Settings.barnes_hut)
+            m_Tree.ComputeAccelerations(state, &m_Pool);
+        else
+            m_Direct(state);
+    }
+
+private :
+    EngineSettings m_Settings;
+    ThreadPool m_Pool;
+    Integrator<T, D> m_Integrator;
+    BarnesHutTree<T, D> m_Tree;
+    ParallelDirectForce<T, D> m_Direct;
+    Bodies<T, D> m_Bodies;
+
+    T m_Time = 0;
+    size_t m_Nb_steps = 0;
+
+    TrajectoryWriter<T>* m_Writer = nullptr;
+    bool m_Recording = false;
+};
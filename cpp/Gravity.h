@@ -0,0 +1,248 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Constants.h"
+#include "Vector.h"
+#include "Object.h"
+#include "System.h"
+#include "ThreadPool.h"
+#include "GravityKernel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+
+////// Gravitation
+//
+//  The accelerations of the bodies : AttractionForce between two of them, and the direct
+//  summation over every pair of a system, on one thread or shared between the threads of a pool.
+//  The Barnes-Hut approximation is in BarnesHut.h.
+
+/// @brief force applied by the source on the target, Vec2 or Vec3
+template<typename T, int N>
+inline VecN<T, N> AttractionForce(T source_mass, VecN<T, N> source_position, T target_mass, VecN<T, N> target_position)
+{
+    const VecN<T, N> deplacement_vector = source_position - target_position;
+    // the masses are applied separately so the product of the two masses cannot overflow a float
+    const VecN<T, N> force = (G<T> * source_mass / deplacement_vector.Magnitude_squared() * target_mass) * deplacement_vector.Normalised();
+    
+    return force;
+}
+
+template<typename T>
+Vec2<T> AttractionForce(const Object<T>& source, const Object<T>& target)
+{
+    return AttractionForce(source.mass, source.GetCurrentPosition(), target.mass, target.GetCurrentPosition());
+}
+
+/// @brief add to acc the interactions of the pairs (i, j > i) for i in [begin, end)
+///
+/// Same physics as AttractionForce, but working on the arrays of the bodies : the force
+/// applied by j on i is computed once and i applies the opposite one on j.
+/// With Potential, the potential of the pair (-G m / r, r from r² / r³) is also added to both bodies.
+template<bool Potential = false, typename T, int D>
+void AccumulatePairs(const Bodies<T, D>& bodies, const size_t begin, const size_t end, T* const (&acc)[D], const T softening_squared = 0,
+                     T* const potential = nullptr)
+{
+    const size_t n = bodies.Size();
+    const T g = G<T>;
+
+    const T* __restrict m = bodies.mass.data();
+
+    for(size_t i = begin; i < end; i++)
+    {
+        T position[D];
+        T acceleration[D];
+        for(int d = 0; d < D; d++)
+        {
+            position[d] = bodies.pos[d][i];
+            acceleration[d] = 0;
+        }
+        const T gmi = g * m[i];
+        T row_potential = 0;
+
+        for(size_t j = i + 1; j < n; j++)
+        {
+            T delta[D];
+            T distance_squared = 0;
+            for(int d = 0; d < D; d++)
+            {
+                delta[d] = bodies.pos[d][j] - position[d];
+                distance_squared += delta[d] * delta[d];
+            }
+            distance_squared += softening_squared;
+
+            // G / r³ is subnormal in float at astronomical distances, G * m is not
+            const T inv_distance_cube = T(1) / (distance_squared * sqrt(distance_squared));
+            const T gmj = g * m[j];
+
+            for(int d = 0; d < D; d++)
+            {
+                acceleration[d] += gmj * inv_distance_cube * delta[d];
+                acc[d][j] -= gmi * inv_distance_cube * delta[d];
+            }
+
+            if constexpr(Potential)
+            {
+                const T inv_distance = distance_squared * inv_distance_cube;
+                row_potential -= gmj * inv_distance;
+                potential[j] -= gmi * inv_distance;
+            }
+        }
+
+        for(int d = 0; d < D; d++)
+            acc[d][i] += acceleration[d];
+        if constexpr(Potential)
+            potential[i] += row_potential;
+    }
+}
+
+/// @brief compute the acceleration of every body, each pair being evaluated only once,
+/// and the potential of each body if `potential` (n scalars) is not null
+template<typename T, int D>
+void ComputeAccelerations(Bodies<T, D>& bodies, const T softening_squared = 0, T* const potential = nullptr)
+{
+    const size_t n = bodies.Size();
+
+    T* acc[D];
+    for(int d = 0; d < D; d++)
+    {
+        std::fill(bodies.acc[d].begin(), bodies.acc[d].end(), T(0));
+        acc[d] = bodies.acc[d].data();
+    }
+
+    if(potential != nullptr)
+    {
+        std::fill(potential, potential + n, T(0));
+        AccumulatePairs<true>(bodies, 0, n, acc, softening_squared, potential);
+    }
+    else
+        AccumulatePairs(bodies, 0, n, acc, softening_squared);
+}
+
+
+/// @brief how the direct summation is computed
+enum class DirectKernel
+{
+    Pairs,      // each pair once (Newton's third law), any scalar type
+    Simd        // every pair twice but in SIMD registers (float and double), see GravityKernel.h
+};
+
+
+/// @brief direct summation shared between the threads of a pool
+///
+/// With the pairs kernel, each thread gets a block of rows holding the same number of pairs
+/// and accumulates into its own buffer. The buffers are then added in the order of the threads,
+/// so the result only depends on the number of threads, not on their scheduling. With the SIMD
+/// kernel, each thread computes whole rows and writes them directly.
+template<typename T, int D = 2>
+class ParallelDirectForce {
+public :
+    static constexpr int Dim = D;
+
+    explicit ParallelDirectForce(ThreadPool& pool, DirectKernel kernel = DirectKernel::Pairs, T softening = 0)
+        : m_Pool(pool), m_Kernel(kernel), m_Softening_squared(softening * softening), m_Simd_level(detectSimdLevel())
+    {
+    }
+
+    /// @brief accelerations of the bodies, and the potential of each body if `potential` (n scalars) is not null
+    void operator()(Bodies<T, D>& bodies, T* const potential = nullptr)
+    {
+        const size_t n = bodies.Size();
+        const size_t nbThreads = m_Pool.Size();
+        profileCount(Counter::Interactions, n != 0 ? n * (n - 1) : 0);
+
+        if(m_Kernel == DirectKernel::Simd)
+        {
+            const T* pos[D];
+            T* acc[D];
+            for(int d = 0; d < D; d++)
+            {
+                pos[d] = bodies.pos[d].data();
+                acc[d] = bodies.acc[d].data();
+            }
+
+            m_Pool.ParallelFor(n, [this, &bodies, &pos, &acc, potential, n](size_t begin, size_t end, size_t) {
+                const ScopedPhase phase(Phase::ForceChunk);
+                gravityRows(m_Simd_level, pos, bodies.mass.data(), n, G<T>, m_Softening_squared, begin, end, acc, potential);
+            });
+            return;
+        }
+
+        if(nbThreads == 1)
+        {
+            ComputeAccelerations(bodies, m_Softening_squared, potential);
+            return;
+        }
+
+        if(m_Rows.size() != nbThreads + 1 || m_Rows[nbThreads] != n)
+            SplitRows(n, nbThreads);
+
+        // the potential of each thread follows its accelerations, in one more buffer
+        const int nbBuffers = potential != nullptr ? Dim + 1 : Dim;
+        for(int b = 0; b < nbBuffers; b++)
+            m_Buffers[b].resize(nbThreads * n);
+
+        m_Pool.Run([this, &bodies, potential, n](size_t thread) {
+            const ScopedPhase phase(Phase::ForceChunk);
+            T* acc[D];
+            for(int d = 0; d < D; d++)
+            {
+                acc[d] = m_Buffers[d].data() + thread * n;
+                std::fill(acc[d], acc[d] + n, T(0));
+            }
+
+            if(potential != nullptr)
+            {
+                T* const thread_potential = m_Buffers[Dim].data() + thread * n;
+                std::fill(thread_potential, thread_potential + n, T(0));
+                AccumulatePairs<true>(bodies, m_Rows[thread], m_Rows[thread + 1], acc, m_Softening_squared, thread_potential);
+            }
+            else
+                AccumulatePairs(bodies, m_Rows[thread], m_Rows[thread + 1], acc, m_Softening_squared);
+        });
+
+        m_Pool.ParallelFor(n, [this, &bodies, potential, n, nbThreads, nbBuffers](size_t begin, size_t end, size_t) {
+            for(int b = 0; b < nbBuffers; b++)
+            {
+                T* __restrict total = b < Dim ? bodies.acc[b].data() : potential;
+                const T* __restrict buffers = m_Buffers[b].data();
+
+                for(size_t i = begin; i < end; i++)
+                    total[i] = buffers[i];
+                for(size_t thread = 1; thread < nbThreads; thread++)
+                {
+                    for(size_t i = begin; i < end; i++)
+                        total[i] += buffers[thread * n + i];
+                }
+            }
+        });
+    }
+
+private :
+    ThreadPool& m_Pool;
+    DirectKernel m_Kernel;
+    T m_Softening_squared;
+    SimdLevel m_Simd_level;
+    std::vector<T> m_Buffers[Dim + 1];      // accelerations then potential of each thread
+    std::vector<size_t> m_Rows;
+
+
+    /// @brief row i has n - 1 - i pairs : cut the rows so every thread gets the same number of pairs
+    void SplitRows(size_t n, size_t nbThreads)
+    {
+        m_Rows.assign(nbThreads + 1, n);
+        m_Rows[0] = 0;
+
+        const double total = double(n) * (n - 1) / 2;
+        size_t thread = 1;
+        double pairs = 0;
+        for(size_t i = 0; i < n && thread < nbThreads; i++)
+        {
+            pairs += double(n - 1 - i);
+            while(thread < nbThreads && pairs >= total * thread / nbThreads)
+                m_Rows[thread++] = i + 1;
+        }
+    }
+};
@@ -0,0 +1,457 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Simd.h"
+#include <cstddef>
+#include <type_traits>
+
+
+////// Batched gravity kernel
+//
+//  Accelerations of the rows [begin, end) against every body, without Newton's third law so
+//  that the inner loop runs over contiguous bodies and fills whole SIMD registers :
+//
+//      a_i = g * sum_j m_j * (x_j - x_i) / (|x_j - x_i|² + eps²)^(3/2)
+//
+//  eps is the Plummer softening length. The body itself is skipped by its index, not by its
+//  distance : with eps > 0 its distance is eps, and its -g m_i / eps would go in the potential.
+//  Given a potential array, the kernels also write the potential of each row, from the inverse
+//  distances they already have (phi_i = -g * sum_j m_j / |x_j - x_i|, softened the same way).
+//  The positions and the accelerations are given as D arrays, one per component (D = 2 or 3),
+//  the loops over the components being unrolled.
+//  The AVX2 / AVX-512 versions are compiled for their instruction set only and chosen at
+//  runtime from what the processor supports, the portable one is left to the autovectoriser.
+//
+
+
+/// @brief one interaction with another body, shared by every version for the bodies that don't fill a register
+template<int D, bool Potential, typename T>
+inline void gravityInteraction(const T (&delta)[D], T mj, T eps2, T (&sum)[D], T& potential_sum)
+{
+    // from the last component, the contractions in FMA giving the same results as the former 2D kernels
+    T distance_squared = 0;
+#pragma GCC unroll 3
+    for(int d = D - 1; d >= 0; d--)
+        distance_squared += delta[d] * delta[d];
+    distance_squared += eps2;
+
+    const T inv_distance = 1 / sqrt(distance_squared);
+    const T factor = mj * inv_distance * inv_distance * inv_distance;
+#pragma GCC unroll 3
+    for(int d = 0; d < D; d++)
+        sum[d] += factor * delta[d];
+    if constexpr(Potential)
+        potential_sum += mj * inv_distance;
+}
+
+/// @brief the bodies [from, n) with the scalar interaction, then the accelerations (and the potential) of row i
+template<int D, bool Potential, typename T>
+inline void gravityRowEnd(const T* const (&pos)[D], const T* m, size_t from, size_t n, T g, T eps2,
+                          size_t i, T (&sum)[D], T potential_sum, T* const (&acc)[D], T* potential)
+{
+    for(size_t j = from; j < n; j++)
+    {
+        if(j == i)
+            continue;
+
+        T delta[D];
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+            delta[d] = pos[d][j] - pos[d][i];
+        gravityInteraction<D, Potential>(delta, m[j], eps2, sum, potential_sum);
+    }
+
+#pragma GCC unroll 3
+    for(int d = 0; d < D; d++)
+        acc[d][i] = g * sum[d];
+    if constexpr(Potential)
+        potential[i] = -g * potential_sum;
+}
+
+template<int D, bool Potential = false, typename T>
+void gravityRowsPortable(const T* const (&pos)[D], const T* __restrict m, size_t n, T g, T eps2,
+                         size_t begin, size_t end, T* const (&acc)[D], T* potential = nullptr)
+{
+    for(size_t i = begin; i < end; i++)
+    {
+        T position[D];
+        T sum[D];
+        T potential_sum = 0;
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+        {
+            position[d] = pos[d][i];
+            sum[d] = 0;
+        }
+
+        for(size_t j = 0; j < n; j++)
+        {
+            T delta[D];
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                delta[d] = pos[d][j] - position[d];
+
+            T distance_squared = 0;
+#pragma GCC unroll 3
+            for(int d = D - 1; d >= 0; d--)
+                distance_squared += delta[d] * delta[d];
+            distance_squared += eps2;
+
+            const T inv_distance = j != i ? 1 / sqrt(distance_squared) : T(0);
+            const T factor = m[j] * inv_distance * inv_distance * inv_distance;
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                sum[d] += factor * delta[d];
+            if constexpr(Potential)
+                potential_sum += m[j] * inv_distance;
+        }
+
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+            acc[d][i] = g * sum[d];
+        if constexpr(Potential)
+            potential[i] = -g * potential_sum;
+    }
+}
+
+
+
+#ifdef SIMD_X86
+
+////// AVX2 + FMA
+
+__attribute__((target("avx2,fma")))
+inline double horizontalSum(__m256d v)
+{
+    const __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+__attribute__((target("avx2,fma")))
+inline float horizontalSum(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    return _mm_cvtss_f32(_mm_add_ss(sum, _mm_movehdup_ps(sum)));
+}
+
+/// @brief double : 1 / sqrt(r²) from one square root and one division (no double rsqrt in AVX2)
+template<int D, bool Potential = false>
+__attribute__((target("avx2,fma")))
+inline void gravityRowsAVX2(const double* const (&pos)[D], const double* m, size_t n, double g, double eps2,
+                            size_t begin, size_t end, double* const (&acc)[D], double* potential = nullptr)
+{
+    const size_t n_simd = n & ~size_t(3);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d eps2_v = _mm256_set1_pd(eps2);
+    const __m256i first_lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+    const __m256i lane_step = _mm256_set1_epi64x(4);
+
+    for(size_t i = begin; i < end; i++)
+    {
+        __m256d position[D];
+        __m256d sum[D];
+        __m256d potential_sum = zero;
+        const __m256i self_index = _mm256_set1_epi64x(static_cast<long long>(i));
+        __m256i lanes = first_lanes;
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+        {
+            position[d] = _mm256_set1_pd(pos[d][i]);
+            sum[d] = zero;
+        }
+
+        for(size_t j = 0; j < n_simd; j += 4)
+        {
+            __m256d delta[D];
+            __m256d distance_squared = eps2_v;
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                delta[d] = _mm256_sub_pd(_mm256_loadu_pd(pos[d] + j), position[d]);
+#pragma GCC unroll 3
+            for(int d = D - 1; d >= 0; d--)
+                distance_squared = _mm256_fmadd_pd(delta[d], delta[d], distance_squared);
+
+            const __m256d inv_distance = _mm256_div_pd(one, _mm256_sqrt_pd(distance_squared));
+            const __m256d inv_distance_cube = _mm256_mul_pd(inv_distance, _mm256_mul_pd(inv_distance, inv_distance));
+            const __m256d self = _mm256_castsi256_pd(_mm256_cmpeq_epi64(lanes, self_index));
+            lanes = _mm256_add_epi64(lanes, lane_step);
+            const __m256d mass = _mm256_loadu_pd(m + j);
+            const __m256d factor = _mm256_andnot_pd(self, _mm256_mul_pd(mass, inv_distance_cube));
+            if constexpr(Potential)
+                potential_sum = _mm256_add_pd(potential_sum, _mm256_andnot_pd(self, _mm256_mul_pd(mass, inv_distance)));
+
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                sum[d] = _mm256_fmadd_pd(factor, delta[d], sum[d]);
+        }
+
+        double total[D];
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+            total[d] = horizontalSum(sum[d]);
+        const double potential_total = Potential ? horizontalSum(potential_sum) : 0;
+        gravityRowEnd<D, Potential>(pos, m, n_simd, n, g, eps2, i, total, potential_total, acc, potential);
+    }
+}
+
+/// @brief float : approximate rsqrt refined by one Newton-Raphson iteration
+template<int D, bool Potential = false>
+__attribute__((target("avx2,fma")))
+inline void gravityRowsAVX2(const float* const (&pos)[D], const float* m, size_t n, float g, float eps2,
+                            size_t begin, size_t end, float* const (&acc)[D], float* potential = nullptr)
+{
+    const size_t n_simd = n & ~size_t(7);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 three = _mm256_set1_ps(3.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 eps2_v = _mm256_set1_ps(eps2);
+    const __m256i first_lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i lane_step = _mm256_set1_epi32(8);
+
+    for(size_t i = begin; i < end; i++)
+    {
+        __m256 position[D];
+        __m256 sum[D];
+        __m256 potential_sum = zero;
+        // 32 bits indices : the float systems are far from 2^32 bodies
+        const __m256i self_index = _mm256_set1_epi32(static_cast<int>(i));
+        __m256i lanes = first_lanes;
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+        {
+            position[d] = _mm256_set1_ps(pos[d][i]);
+            sum[d] = zero;
+        }
+
+        for(size_t j = 0; j < n_simd; j += 8)
+        {
+            __m256 delta[D];
+            __m256 distance_squared = eps2_v;
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                delta[d] = _mm256_sub_ps(_mm256_loadu_ps(pos[d] + j), position[d]);
+#pragma GCC unroll 3
+            for(int d = D - 1; d >= 0; d--)
+                distance_squared = _mm256_fmadd_ps(delta[d], delta[d], distance_squared);
+
+            // y = y * (3 - r² y²) / 2
+            __m256 inv_distance = _mm256_rsqrt_ps(distance_squared);
+            inv_distance = _mm256_mul_ps(_mm256_mul_ps(half, inv_distance),
+                                         _mm256_fnmadd_ps(_mm256_mul_ps(distance_squared, inv_distance), inv_distance, three));
+
+            const __m256 inv_distance_cube = _mm256_mul_ps(inv_distance, _mm256_mul_ps(inv_distance, inv_distance));
+            const __m256 self = _mm256_castsi256_ps(_mm256_cmpeq_epi32(lanes, self_index));
+            lanes = _mm256_add_epi32(lanes, lane_step);
+            const __m256 mass = _mm256_loadu_ps(m + j);
+            const __m256 factor = _mm256_andnot_ps(self, _mm256_mul_ps(mass, inv_distance_cube));
+            if constexpr(Potential)
+                potential_sum = _mm256_add_ps(potential_sum, _mm256_andnot_ps(self, _mm256_mul_ps(mass, inv_distance)));
+
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                sum[d] = _mm256_fmadd_ps(factor, delta[d], sum[d]);
+        }
+
+        float total[D];
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+            total[d] = horizontalSum(sum[d]);
+        const float potential_total = Potential ? horizontalSum(potential_sum) : 0;
+        gravityRowEnd<D, Potential>(pos, m, n_simd, n, g, eps2, i, total, potential_total, acc, potential);
+    }
+}
+
+
+
+////// AVX-512
+
+// the masked forms with a full mask avoid the _mm512_undefined_* of the plain ones, that gcc 12 reports as uninitialized
+
+__attribute__((target("avx512f")))
+inline double horizontalSum(__m512d v)
+{
+    const __m256d low = _mm256_castsi256_pd(_mm512_maskz_extracti64x4_epi64(0xF, _mm512_castpd_si512(v), 0));
+    const __m256d high = _mm256_castsi256_pd(_mm512_maskz_extracti64x4_epi64(0xF, _mm512_castpd_si512(v), 1));
+    const __m256d sum = _mm256_add_pd(low, high);
+    const __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+}
+
+__attribute__((target("avx512f")))
+inline float horizontalSum(__m512 v)
+{
+    const __m256 low = _mm256_castsi256_ps(_mm512_maskz_extracti64x4_epi64(0xF, _mm512_castps_si512(v), 0));
+    const __m256 high = _mm256_castsi256_ps(_mm512_maskz_extracti64x4_epi64(0xF, _mm512_castps_si512(v), 1));
+    const __m256 sum = _mm256_add_ps(low, high);
+    __m128 quarter = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    quarter = _mm_add_ps(quarter, _mm_movehl_ps(quarter, quarter));
+    return _mm_cvtss_f32(_mm_add_ss(quarter, _mm_movehdup_ps(quarter)));
+}
+
+/// @brief double : 14 bits rsqrt refined by two Newton-Raphson iterations
+template<int D, bool Potential = false>
+__attribute__((target("avx512f")))
+inline void gravityRowsAVX512(const double* const (&pos)[D], const double* m, size_t n, double g, double eps2,
+                              size_t begin, size_t end, double* const (&acc)[D], double* potential = nullptr)
+{
+    const size_t n_simd = n & ~size_t(7);
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d three = _mm512_set1_pd(3.0);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d eps2_v = _mm512_set1_pd(eps2);
+    const __m512i first_lanes = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m512i lane_step = _mm512_set1_epi64(8);
+
+    for(size_t i = begin; i < end; i++)
+    {
+        __m512d position[D];
+        __m512d sum[D];
+        __m512d potential_sum = zero;
+        const __m512i self_index = _mm512_set1_epi64(static_cast<long long>(i));
+        __m512i lanes = first_lanes;
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+        {
+            position[d] = _mm512_set1_pd(pos[d][i]);
+            sum[d] = zero;
+        }
+
+        for(size_t j = 0; j < n_simd; j += 8)
+        {
+            __m512d delta[D];
+            __m512d distance_squared = eps2_v;
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                delta[d] = _mm512_sub_pd(_mm512_loadu_pd(pos[d] + j), position[d]);
+#pragma GCC unroll 3
+            for(int d = D - 1; d >= 0; d--)
+                distance_squared = _mm512_fmadd_pd(delta[d], delta[d], distance_squared);
+
+            __m512d inv_distance = _mm512_maskz_rsqrt14_pd(0xFF, distance_squared);
+            for(int iteration = 0; iteration < 2; iteration++)
+                inv_distance = _mm512_mul_pd(_mm512_mul_pd(half, inv_distance),
+                                             _mm512_fnmadd_pd(_mm512_mul_pd(distance_squared, inv_distance), inv_distance, three));
+
+            const __m512d inv_distance_cube = _mm512_mul_pd(inv_distance, _mm512_mul_pd(inv_distance, inv_distance));
+            const __mmask8 not_self = _mm512_cmpneq_epi64_mask(lanes, self_index);
+            lanes = _mm512_add_epi64(lanes, lane_step);
+            const __m512d mass = _mm512_loadu_pd(m + j);
+            const __m512d factor = _mm512_maskz_mul_pd(not_self, mass, inv_distance_cube);
+            if constexpr(Potential)
+                potential_sum = _mm512_add_pd(potential_sum, _mm512_maskz_mul_pd(not_self, mass, inv_distance));
+
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                sum[d] = _mm512_fmadd_pd(factor, delta[d], sum[d]);
+        }
+
+        double total[D];
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+            total[d] = horizontalSum(sum[d]);
+        const double potential_total = Potential ? horizontalSum(potential_sum) : 0;
+        gravityRowEnd<D, Potential>(pos, m, n_simd, n, g, eps2, i, total, potential_total, acc, potential);
+    }
+}
+
+/// @brief float : 14 bits rsqrt refined by one Newton-Raphson iteration
+template<int D, bool Potential = false>
+__attribute__((target("avx512f")))
+inline void gravityRowsAVX512(const float* const (&pos)[D], const float* m, size_t n, float g, float eps2,
+                              size_t begin, size_t end, float* const (&acc)[D], float* potential = nullptr)
+{
+    const size_t n_simd = n & ~size_t(15);
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 three = _mm512_set1_ps(3.0f);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 eps2_v = _mm512_set1_ps(eps2);
+    const __m512i first_lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i lane_step = _mm512_set1_epi32(16);
+
+    for(size_t i = begin; i < end; i++)
+    {
+        __m512 position[D];
+        __m512 sum[D];
+        __m512 potential_sum = zero;
+        const __m512i self_index = _mm512_set1_epi32(static_cast<int>(i));
+        __m512i lanes = first_lanes;
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+        {
+            position[d] = _mm512_set1_ps(pos[d][i]);
+            sum[d] = zero;
+        }
+
+        for(size_t j = 0; j < n_simd; j += 16)
+        {
+            __m512 delta[D];
+            __m512 distance_squared = eps2_v;
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                delta[d] = _mm512_sub_ps(_mm512_loadu_ps(pos[d] + j), position[d]);
+#pragma GCC unroll 3
+            for(int d = D - 1; d >= 0; d--)
+                distance_squared = _mm512_fmadd_ps(delta[d], delta[d], distance_squared);
+
+            __m512 inv_distance = _mm512_maskz_rsqrt14_ps(0xFFFF, distance_squared);
+            inv_distance = _mm512_mul_ps(_mm512_mul_ps(half, inv_distance),
+                                         _mm512_fnmadd_ps(_mm512_mul_ps(distance_squared, inv_distance), inv_distance, three));
+
+            const __m512 inv_distance_cube = _mm512_mul_ps(inv_distance, _mm512_mul_ps(inv_distance, inv_distance));
+            const __mmask16 not_self = _mm512_cmpneq_epi32_mask(lanes, self_index);
+            lanes = _mm512_add_epi32(lanes, lane_step);
+            const __m512 mass = _mm512_loadu_ps(m + j);
+            const __m512 factor = _mm512_maskz_mul_ps(not_self, mass, inv_distance_cube);
+            if constexpr(Potential)
+                potential_sum = _mm512_add_ps(potential_sum, _mm512_maskz_mul_ps(not_self, mass, inv_distance));
+
+#pragma GCC unroll 3
+            for(int d = 0; d < D; d++)
+                sum[d] = _mm512_fmadd_ps(factor, delta[d], sum[d]);
+        }
+
+        float total[D];
+#pragma GCC unroll 3
+        for(int d = 0; d < D; d++)
+            total[d] = horizontalSum(sum[d]);
+        const float potential_total = Potential ? horizontalSum(potential_sum) : 0;
+        gravityRowEnd<D, Potential>(pos, m, n_simd, n, g, eps2, i, total, potential_total, acc, potential);
+    }
+}
+
+#endif
+
+
+
+/// @brief accelerations of the rows [begin, end), with the given instruction set
+template<int D, bool Potential, typename T>
+void gravityRowsWith(SimdLevel level, const T* const (&pos)[D], const T* m, size_t n, T g, T eps2,
+                     size_t begin, size_t end, T* const (&acc)[D], T* potential)
+{
+#ifdef SIMD_X86
+    if constexpr(std::is_same<T, double>::value || std::is_same<T, float>::value)
+    {
+        if(level == SimdLevel::AVX512)
+            return gravityRowsAVX512<D, Potential>(pos, m, n, g, eps2, begin, end, acc, potential);
+        if(level == SimdLevel::AVX2)
+            return gravityRowsAVX2<D, Potential>(pos, m, n, g, eps2, begin, end, acc, potential);
+    }
+#endif
+    (void)level;
+    gravityRowsPortable<D, Potential>(pos, m, n, g, eps2, begin, end, acc, potential);
+}
+
+/// @brief accelerations of the rows [begin, end), and their potential if `potential` is not null
+///
+/// Only float and double have SIMD versions, the other scalar types always use the portable one.
+template<int D, typename T>
+void gravityRows(SimdLevel level, const T* const (&pos)[D], const T* m, size_t n, T g, T eps2,
+                 size_t begin, size_t end, T* const (&acc)[D], T* potential = nullptr)
+{
+    if(potential != nullptr)
+        gravityRowsWith<D, true>(level, pos, m, n, g, eps2, begin, end, acc, potential);
+    else
+        gravityRowsWith<D, false>(level, pos, m, n, g, eps2, begin, end, acc, potential);
+}
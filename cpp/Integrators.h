@@ -0,0 +1,571 @@
+#pragma once
+
+#include "System.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+#include <initializer_list>
+
+
+/// @brief the integration schemes available for the simulations
+enum class IntegratorType
+{
+    Euler,      // explicit Euler, 1st order
+    Verlet,     // velocity Verlet / kick-drift-kick leapfrog, 2nd order symplectic
+    RK4,        // classic Runge-Kutta, 4th order
+    Yoshida4    // Yoshida triple jump, 4th order symplectic
+};
+
+inline bool parseIntegrator(const std::string& name, IntegratorType& type)
+{
+    if(name == "euler")         type = IntegratorType::Euler;
+    else if(name == "verlet")   type = IntegratorType::Verlet;
+    else if(name == "rk4")      type = IntegratorType::RK4;
+    else if(name == "yoshida4") type = IntegratorType::Yoshida4;
+    else return false;
+
+    return true;
+}
+
+inline const char* integratorName(IntegratorType type)
+{
+    switch(type)
+    {
+        case IntegratorType::Euler:     return "euler";
+        case IntegratorType::Verlet:    return "verlet";
+        case IntegratorType::RK4:       return "rk4";
+        case IntegratorType::Yoshida4:  return "yoshida4";
+    }
+    return "unknown";
+}
+
+
+
+/// @brief advance bodies in time with one of the IntegratorType schemes
+///
+/// Every scheme gets the accelerations through the same callback, `force(bodies)`, which has
+/// to fill bodies.acc from bodies.pos (and bodies.mass). The accelerations left in the bodies
+/// after a Verlet step are reused by the next one, so it only costs one evaluation per step.
+template<typename T, int D = 2>
+class Integrator {
+public :
+    static constexpr int Dim = D;
+
+    explicit Integrator(IntegratorType type)
+        : m_Type(type)
+    {
+    }
+
+    IntegratorType GetType() const { return m_Type; }
+
+    /// @brief number of calls to the force callback made by one step
+    int ForceEvaluationsPerStep() const
+    {
+        switch(m_Type)
+        {
+            case IntegratorType::Euler:     return 1;
+            case IntegratorType::Verlet:    return 1;
+            case IntegratorType::RK4:       return 4;
+            case IntegratorType::Yoshida4:  return 3;
+        }
+        return 0;
+    }
+
+    /// @brief to call when the positions have been changed outside of the integrator
+    void Invalidate() { m_Accelerations_valid = false; }
+
+    /// @brief true when bodies.acc are the accelerations at the current positions, the last
+    /// force evaluation having been at these positions (after a Verlet step)
+    bool HasAccelerations() const { return m_Accelerations_valid; }
+
+    /// @brief to call when bodies.acc have been computed at the current positions outside of the
+    /// integrator, the next step then uses them instead of evaluating them again
+    void AccelerationsComputed() { m_Accelerations_valid = true; }
+
+    /// @brief what a restarted integrator needs to go on exactly as this one (see Checkpoint.h),
+    /// the scratch stages of RK4 being computed again
+    struct State
+    {
+        bool accelerations_valid = false;
+    };
+
+    void GetState(State& state) const { state.accelerations_valid = m_Accelerations_valid; }
+    void SetState(const State& state) { m_Accelerations_valid = state.accelerations_valid; }
+
+    template<typename Force>
+    void Step(Bodies<T, D>& bodies, const T dt, Force&& force)
+    {
+        switch(m_Type)
+        {
+            case IntegratorType::Euler:     StepEuler(bodies, dt, force); break;
+            case IntegratorType::Verlet:    StepVerlet(bodies, dt, force); break;
+            case IntegratorType::RK4:       StepRK4(bodies, dt, force); break;
+            case IntegratorType::Yoshida4:  StepYoshida4(bodies, dt, force); break;
+        }
+    }
+
+private :
+    IntegratorType m_Type;
+    bool m_Accelerations_valid = false;
+
+    // scratch state of the RK4 stages
+    Bodies<T, D> m_Stage;
+    std::vector<T> m_Position_increment[Dim];
+    std::vector<T> m_Velocity_increment[Dim];
+
+
+    /// @brief x += c * v * dt
+    static void Drift(Bodies<T, D>& bodies, const T c_dt)
+    {
+        const size_t n = bodies.Size();
+        for(int d = 0; d < Dim; d++)
+        {
+            T* __restrict p = bodies.pos[d].data();
+            const T* __restrict v = bodies.vel[d].data();
+
+            for(size_t i = 0; i < n; i++)
+                p[i] += v[i] * c_dt;
+        }
+    }
+
+    /// @brief v += c * a * dt
+    static void Kick(Bodies<T, D>& bodies, const T c_dt)
+    {
+        const size_t n = bodies.Size();
+        for(int d = 0; d < Dim; d++)
+        {
+            T* __restrict v = bodies.vel[d].data();
+            const T* __restrict a = bodies.acc[d].data();
+
+            for(size_t i = 0; i < n; i++)
+                v[i] += a[i] * c_dt;
+        }
+    }
+
+
+    template<typename Force>
+    void StepEuler(Bodies<T, D>& bodies, const T dt, Force& force)
+    {
+        if(!m_Accelerations_valid)
+            force(bodies);
+
+        Drift(bodies, dt);
+        Kick(bodies, dt);
+
+        m_Accelerations_valid = false;
+    }
+
+    template<typename Force>
+    void StepVerlet(Bodies<T, D>& bodies, const T dt, Force& force)
+    {
+        const T half_dt = dt * static_cast<T>(0.5f);
+
+        if(!m_Accelerations_valid)
+            force(bodies);
+
+        Kick(bodies, half_dt);
+        Drift(bodies, dt);
+        force(bodies);
+        Kick(bodies, half_dt);
+
+        m_Accelerations_valid = true;
+    }
+
+    template<typename Force>
+    void StepYoshida4(Bodies<T, D>& bodies, const T dt, Force& force)
+    {
+        // H. Yoshida, Construction of higher order symplectic integrators (1990)
+        const T cbrt2 = cbrt(static_cast<T>(2));
+        const T w1 = 1 / (2 - cbrt2);
+        const T w0 = -cbrt2 / (2 - cbrt2);
+
+        const T c[4] = { w1 / 2, (w0 + w1) / 2, (w0 + w1) / 2, w1 / 2 };
+        const T k[3] = { w1, w0, w1 };
+
+        for(int s = 0; s < 3; s++)
+        {
+            Drift(bodies, c[s] * dt);
+            force(bodies);
+            Kick(bodies, k[s] * dt);
+        }
+        Drift(bodies, c[3] * dt);
+
+        m_Accelerations_valid = false;
+    }
+
+    template<typename Force>
+    void StepRK4(Bodies<T, D>& bodies, const T dt, Force& force)
+    {
+        const size_t n = bodies.Size();
+        const T half_dt = dt * static_cast<T>(0.5f);
+
+        if(m_Stage.Size() != n)
+        {
+            m_Stage = bodies;
+            for(int d = 0; d < Dim; d++)
+            {
+                m_Position_increment[d].assign(n, 0);
+                m_Velocity_increment[d].assign(n, 0);
+            }
+        }
+
+        // k1 : derivatives at the beginning of the step
+        if(!m_Accelerations_valid)
+            force(bodies);
+
+        for(int d = 0; d < Dim; d++)
+        {
+            const T* __restrict p = bodies.pos[d].data();
+            const T* __restrict v = bodies.vel[d].data();
+            const T* __restrict a = bodies.acc[d].data();
+            T* __restrict stage_p = m_Stage.pos[d].data();
+            T* __restrict stage_v = m_Stage.vel[d].data();
+            T* __restrict dp = m_Position_increment[d].data();
+            T* __restrict dv = m_Velocity_increment[d].data();
+
+            for(size_t i = 0; i < n; i++)
+            {
+                dp[i] = v[i];
+                dv[i] = a[i];
+                stage_p[i] = p[i] + v[i] * half_dt;
+                stage_v[i] = v[i] + a[i] * half_dt;
+            }
+        }
+
+        // k2 and k3 : derivatives at the middle of the step, k4 : at the end
+        const T weights[3] = { 2, 2, 1 };
+        const T next_step[3] = { half_dt, dt, 0 };
+
+        for(int k = 0; k < 3; k++)
+        {
+            force(m_Stage);
+
+            for(int d = 0; d < Dim; d++)
+            {
+                const T* __restrict p = bodies.pos[d].data();
+                const T* __restrict v = bodies.vel[d].data();
+                const T* __restrict stage_a = m_Stage.acc[d].data();
+                T* __restrict stage_p = m_Stage.pos[d].data();
+                T* __restrict stage_v = m_Stage.vel[d].data();
+                T* __restrict dp = m_Position_increment[d].data();
+                T* __restrict dv = m_Velocity_increment[d].data();
+
+                const T w = weights[k];
+                const T h = next_step[k];
+                for(size_t i = 0; i < n; i++)
+                {
+                    const T stage_velocity = stage_v[i];
+                    dp[i] += w * stage_velocity;
+                    dv[i] += w * stage_a[i];
+                    stage_p[i] = p[i] + stage_velocity * h;
+                    stage_v[i] = v[i] + stage_a[i] * h;
+                }
+            }
+        }
+
+        const T sixth_dt = dt / 6;
+        for(int d = 0; d < Dim; d++)
+        {
+            T* __restrict p = bodies.pos[d].data();
+            T* __restrict v = bodies.vel[d].data();
+            const T* __restrict dp = m_Position_increment[d].data();
+            const T* __restrict dv = m_Velocity_increment[d].data();
+
+            for(size_t i = 0; i < n; i++)
+            {
+                p[i] += dp[i] * sixth_dt;
+                v[i] += dv[i] * sixth_dt;
+            }
+        }
+
+        m_Accelerations_valid = false;
+    }
+};
+
+
+
+/// @brief Dormand-Prince 5(4) integrator with adaptive timestep and dense output
+///
+/// Each step is retried with a smaller timestep until the embedded 4th order error estimate
+/// is below atol + rtol * |y| for every position and velocity component. The state between
+/// the beginning and the end of the last accepted step is given by Interpolate.
+///
+/// A step that can't be made throws std::runtime_error rather than being retried forever : when
+/// the error estimate is not finite (bodies colliding), or when the rejections bring the timestep
+/// under MinTimestepRatio times the time of the step, where t + dt can't be told apart from t.
+template<typename T, int D = 2>
+class AdaptiveIntegrator {
+public :
+    static constexpr int Dim = D;
+    static constexpr int MinTimestepRatio = 16;     // in epsilons of T
+
+    AdaptiveIntegrator(T rtol, T atol, T initial_dt)
+        : m_Rtol(rtol), m_Atol(atol), m_Dt(initial_dt)
+    {
+    }
+
+    size_t GetAcceptedSteps() const { return m_Accepted_steps; }
+    size_t GetRejectedSteps() const { return m_Rejected_steps; }
+    size_t GetForceEvaluations() const { return m_Force_evaluations; }
+
+    /// @brief timestep that will be tried by the next step
+    T GetTimestep() const { return m_Dt; }
+
+    /// @brief to call when the bodies have been changed outside of the integrator
+    void Invalidate() { m_First_stage_valid = false; }
+
+    /// @brief true when the last force evaluation was at the current state (always after a step, FSAL)
+    bool HasAccelerations() const { return m_First_stage_valid; }
+
+    /// @brief what a restarted integrator needs to go on exactly as this one (see Checkpoint.h)
+    ///
+    /// The first stage of the next step (FSAL) is kept, so a restart does not cost one more
+    /// force evaluation and gives the same steps. The dense output is only used within a step.
+    struct State
+    {
+        T dt = 0;
+        T last_dt = 0;
+        size_t accepted_steps = 0;
+        size_t rejected_steps = 0;
+        size_t force_evaluations = 0;
+        bool first_stage_valid = false;
+        std::vector<T> first_stage;     // m_K[0], 2 * D * n scalars
+    };
+
+    void GetState(State& state) const
+    {
+        state.dt = m_Dt;
+        state.last_dt = m_Last_dt;
+        state.accepted_steps = m_Accepted_steps;
+        state.rejected_steps = m_Rejected_steps;
+        state.force_evaluations = m_Force_evaluations;
+        state.first_stage_valid = m_First_stage_valid;
+        state.first_stage.assign(m_K[0].begin(), m_K[0].end());
+    }
+
+    /// @brief bodies : the system the integrator will advance
+    void SetState(const State& state, const Bodies<T, D>& bodies)
+    {
+        Resize(bodies);
+
+        m_Dt = state.dt;
+        m_Last_dt = state.last_dt;
+        m_Accepted_steps = state.accepted_steps;
+        m_Rejected_steps = state.rejected_steps;
+        m_Force_evaluations = state.force_evaluations;
+        m_First_stage_valid = state.first_stage_valid && state.first_stage.size() == m_K[0].size();
+        if(m_First_stage_valid)
+            std::copy(state.first_stage.begin(), state.first_stage.end(), m_K[0].begin());
+    }
+
+    /// @brief advance the bodies by one accepted step of at most max_dt, from the time t, return the timestep taken
+    template<typename Force>
+    T Step(Bodies<T, D>& bodies, const T max_dt, Force&& force, const T t = 0)
+    {
+        // Dormand & Prince (1980), coefficients as given by Hairer, Norsett & Wanner
+        static const T a21 = T(1)/5;
+        static const T a31 = T(3)/40,       a32 = T(9)/40;
+        static const T a41 = T(44)/45,      a42 = T(-56)/15,        a43 = T(32)/9;
+        static const T a51 = T(19372)/6561, a52 = T(-25360)/2187,   a53 = T(64448)/6561,    a54 = T(-212)/729;
+        static const T a61 = T(9017)/3168,  a62 = T(-355)/33,       a63 = T(46732)/5247,    a64 = T(49)/176,    a65 = T(-5103)/18656;
+        static const T a71 = T(35)/384,     a73 = T(500)/1113,      a74 = T(125)/192,       a75 = T(-2187)/6784, a76 = T(11)/84;
+
+        static const T e1 = T(71)/57600,    e3 = T(-71)/16695,      e4 = T(71)/1920,        e5 = T(-17253)/339200, e6 = T(22)/525, e7 = T(-1)/40;
+
+        const size_t n = bodies.Size();
+        const size_t size = 2 * Dim * n;
+
+        if(m_Y0.size() != size)
+            Resize(bodies);
+
+        Pack(bodies, m_Y0);
+
+        // first stage, reused from the last stage of the previous step (FSAL)
+        if(!m_First_stage_valid)
+        {
+            Derivative(m_Y0, m_K[0], force);
+            m_First_stage_valid = true;
+        }
+
+        while(true)
+        {
+            const T h = std::min(m_Dt, max_dt);
+
+            Stage(h, { a21 }, m_K[1], force);
+            Stage(h, { a31, a32 }, m_K[2], force);
+            Stage(h, { a41, a42, a43 }, m_K[3], force);
+            Stage(h, { a51, a52, a53, a54 }, m_K[4], force);
+            Stage(h, { a61, a62, a63, a64, a65 }, m_K[5], force);
+            Stage(h, { a71, 0, a73, a74, a75, a76 }, m_K[6], force);      // m_Y1 is the 5th order solution
+
+            // scaled RMS norm of the difference between the 5th and 4th order solutions
+            T error = 0;
+            for(size_t c = 0; c < size; c++)
+            {
+                const T local_error = h * (e1*m_K[0][c] + e3*m_K[2][c] + e4*m_K[3][c] + e5*m_K[4][c] + e6*m_K[5][c] + e7*m_K[6][c]);
+                const T scale = m_Atol + m_Rtol * std::max(abs(m_Y0[c]), abs(m_Y1[c]));
+                const T ratio = local_error / scale;
+                error += ratio * ratio;
+            }
+            error = sqrt(error / static_cast<T>(size));
+            if(!isFinite(error))
+                throw std::runtime_error("dopri5 : the error estimate is not finite at t = " + std::to_string(static_cast<double>(t)) + " s");
+
+            // new timestep, with a safety factor and bounded growth
+            const T factor = error == 0 ? T(5) : std::min(T(5), std::max(T(0.2), T(0.9) * pow(error, T(-0.2))));
+
+            if(error <= 1)
+            {
+                PrepareDenseOutput(h);
+                Unpack(m_Y1, bodies);
+                m_K[0].swap(m_K[6]);
+
+                // the timestep is only shortened to reach max_dt, it must not shrink the next steps
+                if(h == m_Dt || factor < 1)
+                    m_Dt = h * factor;
+
+                m_Last_dt = h;
+                m_Accepted_steps++;
+                return h;
+            }
+
+            m_Dt = h * std::max(factor, T(0.1));
+            m_Rejected_steps++;
+
+            if(m_Dt <= MinTimestepRatio * scalarEpsilon<T>() * abs(t))
+                throw std::runtime_error("dopri5 : the timestep fell to " + std::to_string(static_cast<double>(m_Dt)) + " s at t = "
+                                         + std::to_string(static_cast<double>(t)) + " s");
+        }
+    }
+
+    /// @brief state at t + theta * dt, t and dt being the beginning and the length of the last accepted step
+    void Interpolate(const T theta, Bodies<T, D>& out) const
+    {
+        const T theta1 = 1 - theta;
+        const size_t size = m_Y0.size();
+
+        for(size_t c = 0; c < size; c++)
+            m_Interpolated[c] = m_Dense[0][c] + theta * (m_Dense[1][c] + theta1 * (m_Dense[2][c] + theta * (m_Dense[3][c] + theta1 * m_Dense[4][c])));
+
+        Unpack(m_Interpolated, out);
+    }
+
+private :
+    T m_Rtol;
+    T m_Atol;
+    T m_Dt;
+    T m_Last_dt = 0;
+
+    size_t m_Accepted_steps = 0;
+    size_t m_Rejected_steps = 0;
+    size_t m_Force_evaluations = 0;
+
+    bool m_First_stage_valid = false;
+
+    // packed states : every position component, then every velocity component
+    std::vector<T> m_Y0;
+    std::vector<T> m_Y1;
+    std::vector<T> m_K[7];
+    std::vector<T> m_Dense[5];
+    mutable std::vector<T> m_Interpolated;
+    Bodies<T, D> m_Stage;
+
+
+    void Resize(const Bodies<T, D>& bodies)
+    {
+        const size_t size = 2 * Dim * bodies.Size();
+
+        m_Stage = bodies;
+        m_Y0.assign(size, 0);
+        m_Y1.assign(size, 0);
+        m_Interpolated.assign(size, 0);
+        for(std::vector<T>& k : m_K)
+            k.assign(size, 0);
+        for(std::vector<T>& dense : m_Dense)
+            dense.assign(size, 0);
+
+        m_First_stage_valid = false;
+    }
+
+    static void Pack(const Bodies<T, D>& bodies, std::vector<T>& y)
+    {
+        const size_t n = bodies.Size();
+        for(int d = 0; d < Dim; d++)
+        {
+            std::copy(bodies.pos[d].begin(), bodies.pos[d].end(), y.begin() + d * n);
+            std::copy(bodies.vel[d].begin(), bodies.vel[d].end(), y.begin() + (Dim + d) * n);
+        }
+    }
+
+    static void Unpack(const std::vector<T>& y, Bodies<T, D>& bodies)
+    {
+        const size_t n = bodies.Size();
+        for(int d = 0; d < Dim; d++)
+        {
+            std::copy(y.begin() + d * n, y.begin() + (d + 1) * n, bodies.pos[d].begin());
+            std::copy(y.begin() + (Dim + d) * n, y.begin() + (Dim + d + 1) * n, bodies.vel[d].begin());
+        }
+    }
+
+    /// @brief k = dy/dt = (velocities, accelerations)
+    template<typename Force>
+    void Derivative(const std::vector<T>& y, std::vector<T>& k, Force& force)
+    {
+        const size_t n = m_Stage.Size();
+
+        Unpack(y, m_Stage);
+        force(m_Stage);
+        m_Force_evaluations++;
+
+        std::copy(y.begin() + Dim * n, y.end(), k.begin());
+        for(int d = 0; d < Dim; d++)
+            std::copy(m_Stage.acc[d].begin(), m_Stage.acc[d].end(), k.begin() + (Dim + d) * n);
+    }
+
+    /// @brief m_Y1 = y0 + h * sum(a[i] * k[i]), then k = f(m_Y1)
+    template<typename Force>
+    void Stage(const T h, std::initializer_list<T> a, std::vector<T>& k, Force& force)
+    {
+        const size_t size = m_Y0.size();
+        std::copy(m_Y0.begin(), m_Y0.end(), m_Y1.begin());
+
+        int i = 0;
+        for(const T coefficient : a)
+        {
+            if(coefficient != 0)
+            {
+                const T h_a = h * coefficient;
+                const T* __restrict ki = m_K[i].data();
+                T* __restrict y = m_Y1.data();
+                for(size_t c = 0; c < size; c++)
+                    y[c] += h_a * ki[c];
+            }
+            i++;
+        }
+
+        Derivative(m_Y1, k, force);
+    }
+
+    /// @brief coefficients of the 4th order continuous extension of the accepted step
+    void PrepareDenseOutput(const T h)
+    {
+        static const T d1 = T(-12715105075.0L)/T(11282082432.0L),   d3 = T(87487479700.0L)/T(32700410799.0L);
+        static const T d4 = T(-10690763975.0L)/T(1880347072.0L),    d5 = T(701980252875.0L)/T(199316789632.0L);
+        static const T d6 = T(-1453857185.0L)/T(822651844.0L),      d7 = T(69997945.0L)/T(29380423.0L);
+
+        const size_t size = m_Y0.size();
+        for(size_t c = 0; c < size; c++)
+        {
+            const T delta = m_Y1[c] - m_Y0[c];
+            const T bspl = h * m_K[0][c] - delta;
+
+            m_Dense[0][c] = m_Y0[c];
+            m_Dense[1][c] = delta;
+            m_Dense[2][c] = bspl;
+            m_Dense[3][c] = delta - h * m_K[6][c] - bspl;
+            m_Dense[4][c] = h * (d1*m_K[0][c] + d3*m_K[2][c] + d4*m_K[3][c] + d5*m_K[4][c] + d6*m_K[5][c] + d7*m_K[6][c]);
+        }
+    }
+};
@@ -0,0 +1,294 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Constants.h"
+#include "Simd.h"
+#include <cstddef>
+
+
+////// Kepler equation
+//
+//  Position on an ellipse of semi-major axis a and eccentricity e, the focus at the origin and
+//  the periapsis on the +x axis, at the mean anomaly M = 2 pi t / T :
+//
+//      M = E - e sin E                 (eccentric anomaly E)
+//      x = a (cos E - e)
+//      y = a sqrt(1 - e²) sin E
+//
+//  The orbits are sampled at t = i * dt, i.e. M = 2 pi frac(i * dq) with dq = dt / T. Consecutive
+//  samples have close eccentric anomalies, so each solve starts from the previous one moved by
+//  dM / (1 - e cos E) and ends after one or two Halley steps (cubic convergence). Once a step
+//  is small enough, sin E and cos E are moved along with E instead of being computed again.
+//
+
+
+/// @brief Halley correction of E for f(E) = E - e sin E - M, given sin E and cos E
+template<typename T>
+inline T keplerHalleyStep(T E, T sin_E, T cos_E, T e, T M)
+{
+    const T f = E - e * sin_E - M;
+    const T df = 1 - e * cos_E;
+    const T d2f = e * sin_E;
+    return -2 * f * df / (2 * df * df - f * d2f);
+}
+
+/// @brief below this correction, a Halley step leaves an error under the precision of T (C step³ < epsilon)
+template<typename T>
+inline T keplerConvergedStep()
+{
+    return cbrt(6 * scalarEpsilon<T>());
+}
+
+/// @brief starting point of Danby, good for every eccentricity without knowing the previous solution
+template<typename T>
+inline T keplerStart(T M, T e)
+{
+    return M + T(0.85) * e * (sin(M) < 0 ? T(-1) : T(1));
+}
+
+/// @brief eccentric anomaly for the mean anomaly M, starting from E
+template<typename T>
+T solveKepler(T M, T e, T E)
+{
+    const T converged = keplerConvergedStep<T>();
+    for(int i = 0; i < 64; i++)
+    {
+        const T step = keplerHalleyStep(E, sin(E), cos(E), e, M);
+        E += step;
+        if(abs(step) < converged)
+            break;
+    }
+    return E;
+}
+
+/// @brief mean anomaly of sample i, in [0, 2 pi)
+template<typename T>
+inline T keplerMeanAnomaly(size_t i, T dq)
+{
+    const T q = static_cast<T>(i) * dq;
+    return 2 * PI<T> * (q - floor(q));
+}
+
+
+/// @brief positions of the samples first ... first + n - 1, one sample after another
+template<typename T>
+void keplerOrbitPortable(T a, T e, T dq, size_t first, size_t n, T* x, T* y)
+{
+    if(n == 0)
+        return;
+
+    const T b = a * sqrt(1 - e * e);
+    const T two_pi = 2 * PI<T>;
+    const T converged = keplerConvergedStep<T>();
+
+    T M = keplerMeanAnomaly(first, dq);
+    T E = solveKepler(M, e, keplerStart(M, e));
+    T sin_E = sin(E);
+    T cos_E = cos(E);
+    x[0] = a * (cos_E - e);
+    y[0] = b * sin_E;
+
+    for(size_t k = 1; k < n; k++)
+    {
+        // warm start, E going back by 2 pi with M at each new orbit
+        const T previous_M = M;
+        M = keplerMeanAnomaly(first + k, dq);
+        const bool wrapped = M < previous_M;
+        E += (M - previous_M + (wrapped ? two_pi : T(0))) / (1 - e * cos_E);
+        if(wrapped)
+            E -= two_pi;
+
+        for(int i = 0; i < 64; i++)
+        {
+            sin_E = sin(E);
+            cos_E = cos(E);
+            const T step = keplerHalleyStep(E, sin_E, cos_E, e, M);
+            E += step;
+
+            // sin and cos of E + step to the second order, exact at this precision
+            const T half_step_squared = step * step / 2;
+            const T new_sin_E = sin_E + step * cos_E - half_step_squared * sin_E;
+            cos_E = cos_E - step * sin_E - half_step_squared * cos_E;
+            sin_E = new_sin_E;
+
+            if(abs(step) < converged)
+                break;
+        }
+
+        x[k] = a * (cos_E - e);
+        y[k] = b * sin_E;
+    }
+}
+
+
+
+#ifdef SIMD_X86
+
+////// Lanes of doubles
+//
+//  The same code is compiled for AVX2 (4 doubles) and AVX-512 (8 doubles) with the vector
+//  extensions of gcc. Each lane follows its own block of consecutive samples, so the warm
+//  start still comes from the previous sample of the same lane.
+//
+
+typedef double KeplerV4 __attribute__((vector_size(32)));
+typedef double KeplerV8 __attribute__((vector_size(64)));
+
+// The helpers take and give the vectors by reference : they are always inlined in functions
+// compiled for their instruction set, but a vector passed by value would change the ABI.
+
+/// @brief nearest integer of each lane, |x| < 2^51
+template<typename V>
+__attribute__((always_inline)) inline void roundLanes(const V& x, V& rounded)
+{
+    const double magic = 6755399441055744.0;    // 1.5 * 2^52
+    rounded = (x + magic) - magic;
+}
+
+template<typename V>
+__attribute__((always_inline)) inline void floorLanes(const V& x, V& floored)
+{
+    V rounded;
+    roundLanes(x, rounded);
+    floored = rounded > x ? rounded - 1 : rounded;
+}
+
+/// @brief sin and cos of each lane, for |x| of a few pi
+///
+/// Reduction to [-pi/4, pi/4] with pi/2 split in two parts, then the polynomials of fdlibm.
+template<typename V>
+__attribute__((always_inline)) inline void sincosLanes(const V& x, V& sin_x, V& cos_x)
+{
+    const double pio2_hi = 1.57079632679489655800e+00;
+    const double pio2_lo = 6.12323399573676603587e-17;
+
+    V k;
+    roundLanes<V>(x * 0.63661977236758134308, k);     // 2 / pi
+    const V r = (x - k * pio2_hi) - k * pio2_lo;
+    const V r2 = r * r;
+
+    const V sin_r = r + r * r2 * (-1.66666666666666324348e-01 + r2 * (8.33333333332248946124e-03
+                  + r2 * (-1.98412698298579493134e-04 + r2 * (2.75573137070700676789e-06
+                  + r2 * (-2.50507602534068634195e-08 + r2 * 1.58969099521155010221e-10)))));
+    const V cos_r = 1 - r2 * 0.5 + r2 * r2 * (4.16666666666666019037e-02 + r2 * (-1.38888888888741095749e-03
+                  + r2 * (2.48015872894767294178e-05 + r2 * (-2.75573143513906633035e-07
+                  + r2 * (2.08757232129817482790e-09 + r2 * -1.13596475577881948265e-11)))));
+
+    // quadrant : (sin, cos) = (s, c), (c, -s), (-s, -c), (-c, s)
+    V quarter;
+    floorLanes<V>(k * 0.25, quarter);
+    const V quadrant = k - 4 * quarter;
+    const V swapped_sin = (quadrant == 1 || quadrant == 3) ? cos_r : sin_r;
+    const V swapped_cos = (quadrant == 1 || quadrant == 3) ? sin_r : cos_r;
+    sin_x = quadrant >= 2 ? -swapped_sin : swapped_sin;
+    cos_x = (quadrant == 1 || quadrant == 2) ? -swapped_cos : swapped_cos;
+}
+
+/// @brief W lanes, lane l computing the samples first + l * block ... first + (l + 1) * block - 1
+template<typename V, int W>
+__attribute__((always_inline)) inline void keplerOrbitLanes(double a, double e, double dq, size_t first, size_t block, double* x, double* y)
+{
+    const double b = a * sqrt(1 - e * e);
+    const double two_pi = 2 * PI<double>;
+    const double converged = keplerConvergedStep<double>();
+
+    // first sample of each lane : no previous solution
+    V E, sin_E, cos_E, M, index;
+    for(int l = 0; l < W; l++)
+    {
+        const size_t i = first + l * block;
+        M[l] = keplerMeanAnomaly(i, dq);
+        E[l] = solveKepler(M[l], e, keplerStart(M[l], e));
+        sin_E[l] = sin(E[l]);
+        cos_E[l] = cos(E[l]);
+        index[l] = static_cast<double>(i);
+
+        x[l * block] = a * (cos_E[l] - e);
+        y[l * block] = b * sin_E[l];
+    }
+
+    for(size_t k = 1; k < block; k++)
+    {
+        index += 1;
+        const V q = index * dq;
+        const V previous_M = M;
+        V floor_q;
+        floorLanes(q, floor_q);
+        M = two_pi * (q - floor_q);
+
+        const V dM = M - previous_M;
+        const V wrapped = dM < 0 ? V{} + two_pi : V{};
+        E = E + (dM + wrapped) / (1 - e * cos_E) - wrapped;
+
+        for(int i = 0; i < 16; i++)
+        {
+            sincosLanes(E, sin_E, cos_E);
+            const V f = E - e * sin_E - M;
+            const V df = 1 - e * cos_E;
+            const V step = -2 * f * df / (2 * df * df - f * (e * sin_E));
+            E += step;
+
+            const V half_step_squared = step * step * 0.5;
+            const V new_sin_E = sin_E + step * cos_E - half_step_squared * sin_E;
+            cos_E = cos_E - step * sin_E - half_step_squared * cos_E;
+            sin_E = new_sin_E;
+
+            bool done = true;
+            for(int l = 0; l < W; l++)
+                done = done && abs(step[l]) < converged;
+            if(done)
+                break;
+        }
+
+        const V xs = a * (cos_E - e);
+        const V ys = b * sin_E;
+        for(int l = 0; l < W; l++)
+        {
+            x[l * block + k] = xs[l];
+            y[l * block + k] = ys[l];
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+inline void keplerOrbitAVX2(double a, double e, double dq, size_t first, size_t block, double* x, double* y)
+{
+    keplerOrbitLanes<KeplerV4, 4>(a, e, dq, first, block, x, y);
+}
+
+__attribute__((target("avx512f")))
+inline void keplerOrbitAVX512(double a, double e, double dq, size_t first, size_t block, double* x, double* y)
+{
+    keplerOrbitLanes<KeplerV8, 8>(a, e, dq, first, block, x, y);
+}
+
+#endif
+
+
+/// @brief positions of the samples first ... first + n - 1 of the orbit (a, e), sample i at M = 2 pi frac(i * dq)
+template<typename T>
+void keplerOrbit(SimdLevel, T a, T e, T dq, size_t first, size_t n, T* x, T* y)
+{
+    keplerOrbitPortable(a, e, dq, first, n, x, y);
+}
+
+inline void keplerOrbit(SimdLevel level, double a, double e, double dq, size_t first, size_t n, double* x, double* y)
+{
+#ifdef SIMD_X86
+    // the samples left by the lanes are done one by one
+    const int width = level == SimdLevel::AVX512 ? 8 : level == SimdLevel::AVX2 ? 4 : 1;
+    const size_t block = n / width;
+    if(width > 1 && block > 1)
+    {
+        if(level == SimdLevel::AVX512)
+            keplerOrbitAVX512(a, e, dq, first, block, x, y);
+        else
+            keplerOrbitAVX2(a, e, dq, first, block, x, y);
+
+        const size_t done = block * width;
+        keplerOrbitPortable(a, e, dq, first + done, n - done, x + done, y + done);
+        return;
+    }
+#endif
+    keplerOrbitPortable(a, e, dq, first, n, x, y);
+}
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "Trajectory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <system_error>
+
+// POSIX memory mapping (Linux, macOS)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+////// Memory-mapped trajectories
+//
+//  The binary format of Trajectory.h, written through a shared mapping of the file : the frames
+//  are stored straight into the page cache, the kernel writing them to the disk on its own, so
+//  the length of a run is only limited by the disk.
+//
+//  The file grows by chunks (64 MiB by default) ahead of the frames, and is cut back to the
+//  frames written by End. TrajectoryHeader::nb_frames is stored after each frame, once the frame
+//  is complete, and the header has the TrajectoryPublished flag : a MappedTrajectoryReader can
+//  follow the run from another process, every frame it counts being whole. The rest of the
+//  file is zeros, not frames, even before the first one is published.
+
+
+/// @brief offset of nb_frames in the mapping, read and written atomically
+inline uint64_t* mappedFrameCount(char* mapping)
+{
+    return reinterpret_cast<uint64_t*>(mapping + offsetof(TrajectoryHeader, nb_frames));
+}
+
+
+/// @brief binary trajectory written into a memory-mapped file, see above
+template<typename T>
+class MappedTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    static constexpr size_t DefaultChunkSize = size_t(64) << 20;
+
+    /// @brief create (or empty) the file at `path`, IsOpen telling if it could be
+    explicit MappedTrajectoryWriter(const std::string& path, size_t chunk_size = DefaultChunkSize)
+        : m_Path(path), m_Chunk_size(chunk_size)
+    {
+        m_File = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+
+    ~MappedTrajectoryWriter() override
+    {
+        // not ended : the header still counts the frames if the file can't be cut
+        if(m_Mapping != nullptr)
+        {
+            Unmap();
+            Cut();
+        }
+        if(m_File >= 0)
+            ::close(m_File);
+    }
+
+    MappedTrajectoryWriter(const MappedTrajectoryWriter&) = delete;
+    MappedTrajectoryWriter& operator=(const MappedTrajectoryWriter&) = delete;
+
+    bool IsOpen() const { return m_File >= 0; }
+
+    void Begin(size_t nbBodies, int dimension, T timestep) override
+    {
+        m_Dimension = dimension;
+        m_Frame_size = (1 + dimension * nbBodies) * sizeof(T);
+        m_Nb_frames = 0;
+        m_Size = sizeof(TrajectoryHeader);
+
+        Map(m_Size);
+        TrajectoryHeader header = makeTrajectoryHeader<T>(nbBodies, dimension, timestep);
+        header.flags |= TrajectoryPublished;
+        std::memcpy(m_Mapping, &header, sizeof(header));
+    }
+
+    void WriteFrame(T time, const T* const* position, size_t nbBodies) override
+    {
+        if(m_Size + m_Frame_size > m_Capacity)
+            Map(m_Size + m_Frame_size);
+
+        char* out = m_Mapping + m_Size;
+        storeScalar(out, time);
+        out += sizeof(T);
+        for(size_t i = 0; i < nbBodies; i++)
+        {
+            for(int d = 0; d < m_Dimension; d++)
+            {
+                storeScalar(out, position[d][i]);
+                out += sizeof(T);
+            }
+        }
+
+        m_Size += m_Frame_size;
+        m_Nb_frames++;
+        profileCount(Counter::BytesWritten, m_Frame_size);
+
+        // published once the frame is complete
+        __atomic_store_n(mappedFrameCount(m_Mapping), uint64_t(m_Nb_frames), __ATOMIC_RELEASE);
+    }
+
+    /// @brief unmap the file, cut to the header and the frames
+    void End() override
+    {
+        if(m_Mapping == nullptr)
+            return;
+
+        Unmap();
+        if(!Cut())
+            throw std::system_error(errno, std::generic_category(), "can't cut " + m_Path);
+    }
+
+    size_t GetFrameCount() const { return m_Nb_frames; }
+
+    /// @brief bytes of the header and the frames written
+    size_t GetSize() const { return m_Size; }
+
+private :
+    std::string m_Path;
+    size_t m_Chunk_size;
+    int m_File = -1;
+
+    char* m_Mapping = nullptr;
+    size_t m_Capacity = 0;      // bytes of the file mapped
+    size_t m_Size = 0;          // bytes used
+    size_t m_Frame_size = 0;
+    int m_Dimension = 2;
+    size_t m_Nb_frames = 0;
+
+
+    /// @brief grow the file by whole chunks to hold `size` bytes, and map all of it
+    void Map(size_t size)
+    {
+        if(m_File < 0)
+            throw std::system_error(EBADF, std::generic_category(), "can't open " + m_Path);
+
+        const size_t capacity = (size + m_Chunk_size - 1) / m_Chunk_size * m_Chunk_size;
+        Unmap();
+
+        if(::ftruncate(m_File, static_cast<off_t>(capacity)) != 0)
+            throw std::system_error(errno, std::generic_category(), "can't grow " + m_Path);
+
+        void* mapping = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, 0);
+        if(mapping == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), "can't map " + m_Path);
+
+        m_Mapping = static_cast<char*>(mapping);
+        m_Capacity = capacity;
+    }
+
+    void Unmap()
+    {
+        if(m_Mapping != nullptr)
+            ::munmap(m_Mapping, m_Capacity);
+        m_Mapping = nullptr;
+        m_Capacity = 0;
+    }
+
+    /// @brief drop the part of the last chunk after the frames
+    bool Cut() { return ::ftruncate(m_File, static_cast<off_t>(m_Size)) == 0; }
+};
+
+
+/// @brief random access to the frames of a binary trajectory, mapped read-only
+///
+/// The file can still be written (by a MappedTrajectoryWriter) : Refresh maps the frames
+/// published since the last call. Frame k is found from its offset, without reading the others.
+template<typename T>
+class MappedTrajectoryReader {
+public :
+    MappedTrajectoryReader() = default;
+
+    ~MappedTrajectoryReader() { Close(); }
+
+    MappedTrajectoryReader(const MappedTrajectoryReader&) = delete;
+    MappedTrajectoryReader& operator=(const MappedTrajectoryReader&) = delete;
+
+    /// @brief map the file at `path`, false if it is not a trajectory of T scalars
+    bool Open(const std::string& path, std::string& error)
+    {
+        Close();
+
+        m_File = ::open(path.c_str(), O_RDONLY);
+        if(m_File < 0)
+        {
+            error = "can't open " + path;
+            return false;
+        }
+
+        if(!Refresh() || m_Size < sizeof(TrajectoryHeader))
+        {
+            error = path + " is too short";
+            Close();
+            return false;
+        }
+
+        std::memcpy(&m_Header, m_Mapping, sizeof(m_Header));
+        if(std::memcmp(m_Header.magic, "TIPETRAJ", 8) != 0 || m_Header.scalar_size != sizeof(T)
+           || (m_Header.columns & TrajectoryTime) == 0)
+        {
+            error = path + " is not a binary trajectory of " + scalarName<T>();
+            Close();
+            return false;
+        }
+
+        m_Frame_size = 1 + m_Header.nb_bodies * m_Header.dimension;
+        return true;
+    }
+
+    void Close()
+    {
+        if(m_Mapping != nullptr)
+            ::munmap(m_Mapping, m_Size);
+        if(m_File >= 0)
+            ::close(m_File);
+        m_Mapping = nullptr;
+        m_Size = 0;
+        m_File = -1;
+    }
+
+    /// @brief map the file again if it has grown, false if it can't be
+    bool Refresh()
+    {
+        struct stat status;
+        if(::fstat(m_File, &status) != 0)
+            return false;
+
+        const size_t size = static_cast<size_t>(status.st_size);
+        if(size == m_Size)
+            return true;
+
+        if(m_Mapping != nullptr)
+            ::munmap(m_Mapping, m_Size);
+        m_Mapping = nullptr;
+        m_Size = 0;
+
+        if(size == 0)
+            return true;
+
+        void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, m_File, 0);
+        if(mapping == MAP_FAILED)
+            return false;
+
+        m_Mapping = static_cast<char*>(mapping);
+        m_Size = size;
+        return true;
+    }
+
+    const TrajectoryHeader& GetHeader() const { return m_Header; }
+    size_t GetBodyCount() const { return m_Header.nb_bodies; }
+    int GetDimension() const { return static_cast<int>(m_Header.dimension); }
+
+    /// @brief frames complete in the file : the number published by a MappedTrajectoryWriter,
+    /// or else the one written by End, or the size of the file for a stream not ended
+    size_t GetFrameCount() const
+    {
+        if(m_Mapping == nullptr)
+            return 0;
+
+        const size_t in_file = (m_Size - sizeof(TrajectoryHeader)) / (m_Frame_size * sizeof(T));
+        const size_t published = __atomic_load_n(mappedFrameCount(m_Mapping), __ATOMIC_ACQUIRE);
+        if(published == 0 && (m_Header.flags & TrajectoryPublished) == 0)
+            return in_file;
+        return std::min(published, in_file);
+    }
+
+    /// @brief [t, x0, y0, x1, ...] of frame k < GetFrameCount()
+    const T* GetFrame(size_t k) const
+    {
+        return reinterpret_cast<const T*>(m_Mapping + sizeof(TrajectoryHeader)) + k * m_Frame_size;
+    }
+
+    T GetTime(size_t k) const { return GetFrame(k)[0]; }
+
+    /// @brief component d of the position of a body in frame k
+    T GetPosition(size_t k, size_t body, int d) const { return GetFrame(k)[1 + body * m_Header.dimension + d]; }
+
+private :
+    int m_File = -1;
+    char* m_Mapping = nullptr;
+    size_t m_Size = 0;
+    TrajectoryHeader m_Header = {};
+    size_t m_Frame_size = 1;
+};
@@ -3,42 +3,55 @@
 #include "Vector.h"
 #include <vector>
 #include <string>
+#include <stdexcept>
 
 using uint = unsigned int;
 
+/// @brief a body of the two-body simulations
+///
+/// With nbIter = 0 only the current state is kept, so the memory does not depend on the length
+/// of the simulation (the frames go to a TrajectoryWriter as they are computed). Otherwise the
+/// whole history of the nbIter updates is recorded.
+template<typename T>
 struct Object {
 public :
-    ldouble mass;
+    T mass;
 
-    Object(ldouble _mass, Vec2<ldouble> initial_position, Vec2<ldouble> initial_velocity, size_t nbIter)
-        : mass(_mass), nb_Iterations(nbIter)
+    Object(T _mass, Vec2<T> initial_position, Vec2<T> initial_velocity, size_t nbIter = 0)
+        : mass(_mass), nb_Iterations(nbIter), m_Position(initial_position), m_Velocity(initial_velocity)
     {
-        positions.reserve(nbIter);
-        velocities.reserve(nbIter);
+        if(nbIter == 0)
+            return;
+
+        // the initial state and the nbIter updates
+        positions.reserve(nbIter + 1);
+        velocities.reserve(nbIter + 1);
 
         positions.emplace_back(initial_position);
         velocities.emplace_back(initial_velocity);
     }
 
 
-    Vec2<ldouble> GetCurrentPosition() const { return positions[m_Last_index]; }
-    Vec2<ldouble> GetCurrentVelocity() const { return velocities[m_Last_index]; }
+    Vec2<T> GetCurrentPosition() const { return m_Position; }
+    Vec2<T> GetCurrentVelocity() const { return m_Velocity; }
+
+    bool IsRecording() const { return nb_Iterations != 0; }
 
-    std::vector<Vec2<ldouble>> GetPositionsArray() const { return positions; }
-    std::vector<Vec2<ldouble>> GetVelocitiesArray() const { return velocities; }
+    const std::vector<Vec2<T>>& GetPositionsArray() const { return positions; }
+    const std::vector<Vec2<T>>& GetVelocitiesArray() const { return velocities; }
 
-    void Update_state(Vec2<ldouble> position, Vec2<ldouble> velocity)
+    void Update_state(Vec2<T> position, Vec2<T> velocity)
     {
-        // check if the object is full
-        if(m_Last_index > nb_Iterations - 1)
-        {
-            std::string error_message = std::string("Try accessing the ") +
-                                        std::to_string(m_Last_index + 1) +
-                                        std::string("th element while this object size is ") +
-                                        std::to_string(m_Last_index) + std::to_string('\n');
-            throw error_message.c_str();
+        m_Position = position;
+        m_Velocity = velocity;
+
+        if(!IsRecording())
             return;
-        }
+
+        // check if the object is full, the message only being built when it is
+        if(m_Last_index > nb_Iterations - 1)
+            throw std::out_of_range("Try accessing the " + std::to_string(m_Last_index + 1) +
+                                    "th element while this object size is " + std::to_string(m_Last_index));
 
         // update the index
         m_Last_index++;
@@ -53,7 +66,11 @@ public :
 private :
     size_t m_Last_index = 0;
     const size_t nb_Iterations;
-    
-    std::vector<Vec2<ldouble>> positions;
-    std::vector<Vec2<ldouble>> velocities;
+
+    Vec2<T> m_Position;
+    Vec2<T> m_Velocity;
+
+    // history, only when recording
+    std::vector<Vec2<T>> positions;
+    std::vector<Vec2<T>> velocities;
 };
\ No newline at end of file
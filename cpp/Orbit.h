@@ -0,0 +1,90 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Constants.h"
+#include "Vector.h"
+#include "Kepler.h"
+#include "ThreadPool.h"
+#include "Trajectory.h"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+
+////// Orbite analytique
+//
+//  Les positions d'une planète autour d'un astre fixe, données par l'équation de Kepler
+//  au lieu d'être intégrées pas à pas.
+
+template<typename Ty>
+Ty periode(Ty a,Ty masse_central){
+    return sqrt(4*PI<Ty>*PI<Ty>*a*a*a/(G<Ty>*masse_central));
+}
+
+template<typename Ty>
+Ty suite_psi(Ty T,Ty t,Ty e,Ty psi){
+    return -(psi-e*sin(psi)-2*PI<Ty>*t/T)/(1-e*cos(psi))+psi;
+}
+
+template<typename Ty>
+Ty newton(Ty T,Ty t,Ty e,Ty psi){
+    Ty psi_precedent=psi;
+    Ty psi_nouveau=psi+1;  //valeur arbitraire pour entrer dans la boucle
+    int i=0;
+    while(i<1000 && abs(psi_precedent-psi_nouveau)>static_cast<Ty>(0.00001)){
+        psi_precedent=psi_nouveau;
+        psi_nouveau=suite_psi(T,t,e,psi_precedent);
+        i=i+1;
+    }
+    return psi_nouveau;
+}
+
+template<typename Ty>
+Ty conv_psi_en_phi(Ty e,Ty psi){
+    return 2*atan(abs(tan(psi/2))*sqrt((1+e)/(1-e)));
+}
+
+template<typename Ty>
+Ty calcul_rayon(Ty e,Ty phi,Ty p){
+    return p/(1+e*cos(phi));
+}
+
+/// @brief orbite analytique : les positions sont calculées par paquets (Kepler.h) au lieu d'un newton() par point
+///
+/// Chaque point ne dépend que de son temps i*pas : les paquets de SimuChunk points sont partagés
+/// entre les threads du pool, chacun écrivant sa tranche de x et y, puis écrits dans l'ordre.
+/// La mémoire ne dépend donc pas du nombre d'itérations. polaire (phi, rayon) n'est rempli que s'il est demandé.
+constexpr size_t SimuChunk = 1 << 20;
+
+template<typename Ty>
+void simu(Ty r1,Ty r2,Ty masse_central,size_t nombre_iteration,Ty pas, TrajectoryWriter<Ty>& writer,
+          ThreadPool& pool, std::vector<Vec2<Ty>>* polaire = nullptr){
+    Ty a=(r1+r2)/2;
+    Ty e= abs((r1-r2)/(r1+r2));
+    Ty T=periode(a,masse_central);
+    const SimdLevel level = detectSimdLevel();
+    std::vector<Ty> x(std::min(nombre_iteration, SimuChunk));
+    std::vector<Ty> y(x.size());
+
+    if(polaire)
+        polaire->assign(nombre_iteration, Vec2<Ty>(0,0));
+
+    writer.Begin(1, 2, pas);
+    for(size_t first=0;first<nombre_iteration;first+=SimuChunk){
+        const size_t n = std::min(SimuChunk, nombre_iteration-first);
+
+        pool.ParallelFor(n, [&](size_t begin, size_t end, size_t){
+            keplerOrbit(level, a, e, pas/T, first+begin, end-begin, x.data()+begin, y.data()+begin);
+
+            if(polaire)
+                for(size_t i=begin;i<end;i++)
+                    (*polaire)[first+i] = Vec2<Ty>(atan2(y[i],x[i]),sqrt(x[i]*x[i]+y[i]*y[i]));
+        });
+
+        for(size_t i=0;i<n;i++){
+            const Ty* position[2] = { &x[i], &y[i] };
+            writer.WriteFrame((first+i)*pas, position, 1);
+        }
+    }
+    writer.End();
+}
@@ -0,0 +1,351 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <vector>
+
+
+////// Profiling
+//
+//  With PROFILE (a CMake option), the phases of the steps are timed by ScopedPhase objects and
+//  the work done is counted by profileCount. Without it, ScopedPhase and profileCount are empty
+//  and the compiler removes them.
+//
+//  Every thread has its own slot of totals, taken at its first timer : the threads of the pool
+//  add to their slot without locks, and the slots are only read by Report, once the threads
+//  are waiting. A phase started inside another one (the force inside the integrator) is counted
+//  in the total of both, but only in the self time of the inner one, so that the self times
+//  of a thread add up to its time in the outer phase.
+//
+//  With tracing on, every timer is also kept as an event (up to TraceCapacity per thread) for
+//  WriteTrace, in the Chrome trace format (chrome://tracing, ui.perfetto.dev, speedscope).
+
+
+enum class Phase : int
+{
+    Simulation,         // the loop over the steps
+    Integrator,         // Integrator::Step, the force evaluations being apart
+    Force,              // the accelerations of the bodies
+    ForceChunk,         // the part of a force evaluation done by one thread
+    UpdateState,        // Object::Update_state of the two-body simulations
+    Output,             // the frames given to the TrajectoryWriter
+    Diagnostics,        // the conserved quantities
+    Checkpoint,         // the copy of the state for the checkpoint thread
+    Count
+};
+
+inline const char* phaseName(Phase phase)
+{
+    switch(phase)
+    {
+        case Phase::Simulation:     return "simulation";
+        case Phase::Integrator:     return "integrator";
+        case Phase::Force:          return "force";
+        case Phase::ForceChunk:     return "force chunk";
+        case Phase::UpdateState:    return "update_state";
+        case Phase::Output:         return "output";
+        case Phase::Diagnostics:    return "diagnostics";
+        case Phase::Checkpoint:     return "checkpoint";
+        case Phase::Count:          break;
+    }
+    return "";
+}
+
+enum class Counter : int
+{
+    Steps,
+    Interactions,       // accelerations of a body by another body or a cell of the tree
+    BytesWritten,       // by the trajectory writers
+    Count
+};
+
+inline const char* counterName(Counter counter)
+{
+    switch(counter)
+    {
+        case Counter::Steps:            return "steps";
+        case Counter::Interactions:     return "interactions";
+        case Counter::BytesWritten:     return "bytes_written";
+        case Counter::Count:            break;
+    }
+    return "";
+}
+
+constexpr bool profiling()
+{
+#ifdef PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+/// @brief timer of one phase, as written to the Chrome trace
+struct TraceEvent
+{
+    Phase phase;
+    int64_t start;          // ns since the start of the program
+    int64_t duration;
+};
+
+/// @brief totals of one thread, only written by this thread
+struct alignas(64) ProfileSlot
+{
+    static constexpr int NbPhases = static_cast<int>(Phase::Count);
+    static constexpr int NbCounters = static_cast<int>(Counter::Count);
+
+    int64_t total[NbPhases] = {};       // ns
+    int64_t self[NbPhases] = {};
+    uint64_t calls[NbPhases] = {};
+    uint64_t counters[NbCounters] = {};
+
+    std::vector<TraceEvent> events;
+    uint64_t dropped_events = 0;
+};
+
+
+class Profiler {
+public :
+    static constexpr size_t MaxThreads = 256;
+    static constexpr size_t TraceCapacity = size_t(1) << 18;
+
+    Profiler() : m_Start(std::chrono::steady_clock::now()) {}
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    /// @brief keep the timers as events, to call before the first one
+    void EnableTrace() { m_Tracing = true; }
+    bool IsTracing() const { return m_Tracing; }
+
+    /// @brief ns since the start of the program
+    int64_t Now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_Start).count();
+    }
+
+    /// @brief slot of a new thread, null once MaxThreads have one
+    ProfileSlot* Register()
+    {
+        const size_t index = m_Nb_slots.fetch_add(1, std::memory_order_relaxed);
+        if(index >= MaxThreads)
+            return nullptr;
+
+        ProfileSlot* slot = &m_Slots[index];
+        if(m_Tracing)
+            slot->events.reserve(TraceCapacity);
+        return slot;
+    }
+
+    size_t GetThreadCount() const { return std::min(m_Nb_slots.load(std::memory_order_relaxed), MaxThreads); }
+    const ProfileSlot& GetSlot(size_t thread) const { return m_Slots[thread]; }
+
+    /// @brief sum of the slots of every thread
+    ProfileSlot Total() const
+    {
+        ProfileSlot total;
+        for(size_t t = 0; t < GetThreadCount(); t++)
+        {
+            const ProfileSlot& slot = m_Slots[t];
+            for(int p = 0; p < ProfileSlot::NbPhases; p++)
+            {
+                total.total[p] += slot.total[p];
+                total.self[p] += slot.self[p];
+                total.calls[p] += slot.calls[p];
+            }
+            for(int c = 0; c < ProfileSlot::NbCounters; c++)
+                total.counters[c] += slot.counters[c];
+            total.dropped_events += slot.dropped_events;
+        }
+        return total;
+    }
+
+    /// @brief time of each phase and rates of the counters, over the time of the simulation loops
+    void Report(std::ostream& os) const
+    {
+        const ProfileSlot total = Total();
+        const double loop = Seconds(total.total[index(Phase::Simulation)]);
+        const std::ios::fmtflags flags = os.flags();
+
+        os << "Profile of the simulation (" << std::fixed << std::setprecision(3) << loop << " s, "
+           << GetThreadCount() << " threads) :\n";
+        os << "    " << std::left << std::setw(14) << "phase" << std::right << std::setw(12) << "total (s)"
+           << std::setw(12) << "self (s)" << std::setw(9) << "self %" << std::setw(12) << "calls" << "\n";
+
+        for(int p = 0; p < ProfileSlot::NbPhases; p++)
+        {
+            if(total.calls[p] == 0)
+                continue;
+
+            // the chunks run beside the thread calling the force, they are not part of its time
+            const double self = Seconds(total.self[p]);
+            os << "    " << std::left << std::setw(14) << phaseName(static_cast<Phase>(p)) << std::right
+               << std::setw(12) << Seconds(total.total[p]) << std::setw(12) << self;
+            if(static_cast<Phase>(p) != Phase::ForceChunk && loop > 0)
+                os << std::setw(8) << std::setprecision(1) << 100 * self / loop << '%' << std::setprecision(3);
+            else
+                os << std::setw(9) << "";
+            os << std::setw(12) << total.calls[p] << "\n";
+        }
+
+        // the share of each thread in the force evaluations
+        if(total.calls[index(Phase::ForceChunk)] != 0)
+        {
+            os << "    force chunks per thread (s) :";
+            for(size_t t = 0; t < GetThreadCount(); t++)
+            {
+                if(m_Slots[t].calls[index(Phase::ForceChunk)] != 0)
+                    os << ' ' << Seconds(m_Slots[t].total[index(Phase::ForceChunk)]);
+            }
+            os << "\n";
+        }
+
+        os << std::defaultfloat << std::setprecision(4);
+        for(int c = 0; c < ProfileSlot::NbCounters; c++)
+        {
+            os << "    " << counterName(static_cast<Counter>(c)) << " : " << total.counters[c];
+            if(loop > 0)
+                os << " (" << total.counters[c] / loop << " /s)";
+            os << "\n";
+        }
+        if(total.dropped_events != 0)
+            os << "    trace events dropped : " << total.dropped_events << "\n";
+
+        os.flags(flags);
+    }
+
+    /// @brief the same figures as Report, as a JSON object
+    void WriteJson(std::ostream& os) const
+    {
+        const ProfileSlot total = Total();
+        const double loop = Seconds(total.total[index(Phase::Simulation)]);
+
+        os << std::setprecision(9) << "{\n  \"simulation_time\": " << loop << ",\n  \"threads\": " << GetThreadCount()
+           << ",\n  \"phases\": {";
+        for(int p = 0; p < ProfileSlot::NbPhases; p++)
+        {
+            os << (p == 0 ? "\n" : ",\n") << "    \"" << phaseName(static_cast<Phase>(p)) << "\": { \"total\": " << Seconds(total.total[p])
+               << ", \"self\": " << Seconds(total.self[p]) << ", \"calls\": " << total.calls[p] << ", \"per_thread\": [";
+            for(size_t t = 0; t < GetThreadCount(); t++)
+                os << (t == 0 ? "" : ", ") << Seconds(m_Slots[t].total[p]);
+            os << "] }";
+        }
+        os << "\n  },\n  \"counters\": {";
+        for(int c = 0; c < ProfileSlot::NbCounters; c++)
+        {
+            os << (c == 0 ? "\n" : ",\n") << "    \"" << counterName(static_cast<Counter>(c)) << "\": { \"count\": " << total.counters[c]
+               << ", \"per_second\": " << (loop > 0 ? total.counters[c] / loop : 0) << " }";
+        }
+        os << "\n  }\n}\n";
+    }
+
+    /// @brief the events of every thread in the Chrome trace format, one track per thread
+    void WriteTrace(std::ostream& os) const
+    {
+        os << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        bool first = true;
+        for(size_t t = 0; t < GetThreadCount(); t++)
+        {
+            for(const TraceEvent& event : m_Slots[t].events)
+            {
+                os << (first ? "" : ",\n") << "{\"name\": \"" << phaseName(event.phase) << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << t
+                   << ", \"ts\": " << event.start / 1e3 << ", \"dur\": " << event.duration / 1e3 << "}";
+                first = false;
+            }
+        }
+        os << "\n]}\n";
+    }
+
+private :
+    std::chrono::steady_clock::time_point m_Start;
+    bool m_Tracing = false;
+    std::atomic<size_t> m_Nb_slots{0};
+    std::array<ProfileSlot, MaxThreads> m_Slots;
+
+    static int index(Phase phase) { return static_cast<int>(phase); }
+    static double Seconds(int64_t ns) { return ns * 1e-9; }
+};
+
+
+#ifdef PROFILE
+
+// only with PROFILE : its MaxThreads slots would otherwise take room in every program
+inline Profiler g_Profiler;
+
+/// @brief slot of the calling thread, taken at its first call
+inline ProfileSlot* profileSlot()
+{
+    thread_local ProfileSlot* const slot = g_Profiler.Register();
+    return slot;
+}
+
+inline void profileCount(Counter counter, uint64_t n)
+{
+    if(ProfileSlot* const slot = profileSlot())
+        slot->counters[static_cast<int>(counter)] += n;
+}
+
+/// @brief time from its construction to its destruction added to the phase
+class ScopedPhase {
+public :
+    explicit ScopedPhase(Phase phase)
+        : m_Phase(phase), m_Slot(profileSlot()), m_Parent(s_Current), m_Start(g_Profiler.Now())
+    {
+        s_Current = this;
+    }
+
+    ~ScopedPhase()
+    {
+        const int64_t duration = g_Profiler.Now() - m_Start;
+        s_Current = m_Parent;
+        if(m_Parent != nullptr)
+            m_Parent->m_Children += duration;
+
+        if(m_Slot == nullptr)
+            return;
+
+        const int p = static_cast<int>(m_Phase);
+        m_Slot->total[p] += duration;
+        m_Slot->self[p] += duration - m_Children;
+        m_Slot->calls[p]++;
+
+        if(g_Profiler.IsTracing())
+        {
+            if(m_Slot->events.size() < Profiler::TraceCapacity)
+                m_Slot->events.push_back({ m_Phase, m_Start, duration });
+            else
+                m_Slot->dropped_events++;
+        }
+    }
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+private :
+    Phase m_Phase;
+    ProfileSlot* m_Slot;
+    ScopedPhase* m_Parent;
+    int64_t m_Start;
+    int64_t m_Children = 0;
+
+    // innermost phase of the thread
+    static inline thread_local ScopedPhase* s_Current = nullptr;
+};
+
+#else
+
+inline void profileCount(Counter, uint64_t) {}
+
+class ScopedPhase {
+public :
+    explicit ScopedPhase(Phase) {}
+};
+
+#endif
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <limits>
+#include <string>
+#include <ostream>
+#include <type_traits>
+
+#ifdef USE_QUAD
+    // needs to be linked with -lquadmath
+    #include <quadmath.h>
+#endif
+
+
+using ldouble = long double;
+
+
+
+////// Scalar types the simulator can be instantiated with
+//
+//  float, double, long double, and __float128 when compiled with -DUSE_QUAD
+//
+
+// the overloads for float and long double are found the same way as the double ones
+// (libstdc++ already provides abs for __float128)
+using std::sqrt;
+using std::sin;
+using std::cos;
+using std::tan;
+using std::atan;
+using std::atan2;
+using std::cbrt;
+using std::pow;
+using std::floor;
+using std::abs;
+
+
+#ifdef USE_QUAD
+
+using quad = __float128;
+
+inline quad sqrt(quad x) { return sqrtq(x); }
+inline quad sin(quad x) { return sinq(x); }
+inline quad cos(quad x) { return cosq(x); }
+inline quad tan(quad x) { return tanq(x); }
+inline quad atan(quad x) { return atanq(x); }
+inline quad atan2(quad y, quad x) { return atan2q(y, x); }
+inline quad cbrt(quad x) { return cbrtq(x); }
+inline quad pow(quad x, quad y) { return powq(x, y); }
+inline quad floor(quad x) { return floorq(x); }
+
+inline std::ostream& operator<<(std::ostream& os, quad x)
+{
+    char buffer[64];
+    quadmath_snprintf(buffer, sizeof(buffer), "%.*Qg", static_cast<int>(os.precision()), x);
+    return os << buffer;
+}
+
+#endif
+
+
+
+/// @brief same format as std::to_string ("%f") for every scalar type
+template<typename T>
+std::string toString(T x)
+{
+    return std::to_string(x);
+}
+
+#ifdef USE_QUAD
+template<>
+inline std::string toString<quad>(quad x)
+{
+    char buffer[64];
+    quadmath_snprintf(buffer, sizeof(buffer), "%Qf", x);
+    return std::string(buffer);
+}
+#endif
+
+
+/// @brief write x to the stream in the format of toString, without allocating a string; returns the characters written
+template<typename T>
+size_t writeScalar(std::ostream& os, T x)
+{
+    char buffer[64];
+    int length;
+#ifdef USE_QUAD
+    if constexpr(std::is_same_v<T, quad>)
+        length = quadmath_snprintf(buffer, sizeof(buffer), "%Qf", x);
+    else
+#endif
+    if constexpr(std::is_same_v<T, ldouble>)
+        length = std::snprintf(buffer, sizeof(buffer), "%Lf", x);
+    else
+        length = std::snprintf(buffer, sizeof(buffer), "%f", static_cast<double>(x));
+
+    // more than 56 digits before the point
+    if(length < 0 || static_cast<size_t>(length) >= sizeof(buffer))
+    {
+        const std::string text = toString(x);
+        os << text;
+        return text.size();
+    }
+
+    os.write(buffer, length);
+    return static_cast<size_t>(length);
+}
+
+
+/// @brief read a scalar from the command line
+template<typename T>
+T parseScalar(const char* str)
+{
+    char* _stopstring;
+    return static_cast<T>(strtold(str, &_stopstring));
+}
+
+#ifdef USE_QUAD
+template<>
+inline quad parseScalar<quad>(const char* str)
+{
+    char* _stopstring;
+    return strtoflt128(str, &_stopstring);
+}
+#endif
+
+
+/// @brief name of the scalar type, as given to --precision
+template<typename T> constexpr const char* scalarName();
+template<> constexpr const char* scalarName<float>() { return "float"; }
+template<> constexpr const char* scalarName<double>() { return "double"; }
+template<> constexpr const char* scalarName<ldouble>() { return "long"; }
+#ifdef USE_QUAD
+template<> constexpr const char* scalarName<quad>() { return "quad"; }
+#endif
+
+
+/// @brief difference between 1 and the next representable value
+template<typename T> constexpr T scalarEpsilon() { return std::numeric_limits<T>::epsilon(); }
+#ifdef USE_QUAD
+template<> constexpr quad scalarEpsilon<quad>() { return FLT128_EPSILON; }
+#endif
+
+/// @brief false for the infinities and NaN (std::isfinite has no overload for quad)
+template<typename T> bool isFinite(T x) { return x - x == T(0); }
@@ -0,0 +1,46 @@
+#pragma once
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define SIMD_X86
+    #include <immintrin.h>
+#endif
+
+
+////// Instruction sets
+//
+//  The kernels using SIMD registers are compiled for each instruction set with
+//  __attribute__((target(...))) and the best version is chosen at runtime, so the program
+//  doesn't need to be compiled with -mavx2 and still runs on any x86-64 processor.
+//
+
+
+enum class SimdLevel { Portable, AVX2, AVX512 };
+
+inline const char* simdLevelName(SimdLevel level)
+{
+    switch(level)
+    {
+        case SimdLevel::Portable:   return "portable";
+        case SimdLevel::AVX2:       return "avx2";
+        case SimdLevel::AVX512:     return "avx512";
+    }
+    return "unknown";
+}
+
+/// @brief best instruction set supported by the processor
+inline SimdLevel detectSimdLevel()
+{
+#ifdef SIMD_X86
+    static const SimdLevel level = []() {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f"))
+            return SimdLevel::AVX512;
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return SimdLevel::AVX2;
+        return SimdLevel::Portable;
+    }();
+    return level;
+#else
+    return SimdLevel::Portable;
+#endif
+}
@@ -0,0 +1,326 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Vector.h"
+#include "Object.h"
+#include "System.h"
+#include "Integrators.h"
+#include "Gravity.h"
+#include "Trajectory.h"
+#include "Checkpoint.h"
+#include "Diagnostics.h"
+#include "Allocations.h"
+#include "Profiler.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+
+////// Simulations
+//
+//  The loops advancing the bodies step after step, the frames going to a TrajectoryWriter,
+//  and the reading of the systems from a file.
+//
+//  Every buffer has its size after the first step : with COUNT_ALLOCATIONS (Allocations.h), the
+//  heap allocations of the following steps are counted, reported and returned by simulation()
+//  (0 without it), there should be none.
+//  With PROFILE (Profiler.h), the phases of each step are timed.
+
+
+/// @brief print the allocations of the steps after the first one when they are counted, and return their number
+inline size_t reportAllocations(AllocationProbe& probe)
+{
+    if(!allocationsCounted())
+        return 0;
+
+    probe.Stop();
+    std::cout << "Heap allocations after the first step : " << probe.GetCount() << " (" << probe.GetBytes() << " bytes)\n";
+    return probe.GetCount();
+}
+
+template<typename T>
+size_t simulation(const size_t nbIteration, const Object<T>& source, Object<T>& target, const T dt, Integrator<T>& integrator, TrajectoryWriter<T>& writer,
+                  Checkpointer<T, 2>* checkpointer = nullptr, Diagnostics<T, 2>* diagnostics = nullptr)
+{
+    std::cout << "Starting the simulation (" << integratorName(integrator.GetType()) << ")...\n";
+
+    // the target is integrated alone, the source does not move
+    Bodies<T> bodies;
+    bodies.AddBody(target.mass, target.GetCurrentPosition(), target.GetCurrentVelocity());
+
+    const auto force = [&source](Bodies<T>& state) {
+        const ScopedPhase phase(Phase::Force);
+        profileCount(Counter::Interactions, 1);
+        const Vec2<T> acceleration = AttractionForce(source.mass, source.GetCurrentPosition(), state.mass[0], state.GetPosition(0)) / state.mass[0];
+        state.acc[0][0] = acceleration.x;
+        state.acc[1][0] = acceleration.y;
+    };
+
+    size_t first = 0;
+    if(checkpointer != nullptr && checkpointer->IsRestart())
+    {
+        first = checkpointer->Restore(bodies, integrator, writer, dt).header.step;
+        target.Update_state(bodies.GetPosition(0), bodies.GetVelocity(0));
+        std::cout << "Restarting at step " << first << "\n";
+    }
+    else
+    {
+        writer.Begin(1, 2, dt);
+        writer.WritePoint(0, target.GetCurrentPosition());
+    }
+    if(diagnostics != nullptr)
+        diagnostics->Record(first * dt, bodies, integrator, force);
+
+    AllocationProbe allocations;
+    const ScopedPhase loop(Phase::Simulation);
+    for(size_t i = first; i < nbIteration; i++)
+    {
+        {
+            const ScopedPhase phase(Phase::Integrator);
+            integrator.Step(bodies, dt, force);
+        }
+        {
+            const ScopedPhase phase(Phase::UpdateState);
+            target.Update_state(bodies.GetPosition(0), bodies.GetVelocity(0));
+        }
+        {
+            const ScopedPhase phase(Phase::Output);
+            writer.WritePoint((i + 1) * dt, target.GetCurrentPosition());
+        }
+        profileCount(Counter::Steps, 1);
+
+        if(diagnostics != nullptr && (diagnostics->Due(i + 1) || i + 1 == nbIteration))
+        {
+            const ScopedPhase phase(Phase::Diagnostics);
+            diagnostics->Record((i + 1) * dt, bodies, integrator, force);
+        }
+
+        // frame 0 and one frame per step have been written
+        if(checkpointer != nullptr && i + 1 < nbIteration && checkpointer->Due())
+        {
+            const ScopedPhase phase(Phase::Checkpoint);
+            checkpointer->Save(i + 1, i + 2, (i + 1) * dt, bodies, integrator, writer, dt);
+        }
+
+        if(i == first)
+            allocations.Start();
+    }
+    {
+        const ScopedPhase phase(Phase::Output);
+        writer.End();
+    }
+    std::cout << "Simulation finished.\n";
+    return reportAllocations(allocations);
+}
+
+
+/// @brief advance every body of the system together, the accelerations being given by force(bodies)
+template<typename T, int D, typename Force>
+size_t simulation(const size_t nbIteration, Bodies<T, D>& bodies, const T dt, Integrator<T, D>& integrator, Force&& force, TrajectoryWriter<T>& writer,
+                  Checkpointer<T, D>* checkpointer = nullptr, Diagnostics<T, D>* diagnostics = nullptr)
+{
+    std::cout << "Starting the simulation of " << bodies.Size() << " bodies (" << integratorName(integrator.GetType()) << ")...\n";
+
+    const auto profiled_force = [&force](Bodies<T, D>& state) {
+        const ScopedPhase phase(Phase::Force);
+        force(state);
+    };
+
+    size_t first = 0;
+    if(checkpointer != nullptr && checkpointer->IsRestart())
+    {
+        first = checkpointer->Restore(bodies, integrator, writer, dt).header.step;
+        std::cout << "Restarting at step " << first << "\n";
+    }
+    else
+    {
+        writer.Begin(bodies.Size(), D, dt);
+        writer.WriteFrame(0, bodies);
+    }
+    if(diagnostics != nullptr)
+        diagnostics->Record(first * dt, bodies, integrator, force);
+
+    AllocationProbe allocations;
+    const ScopedPhase loop(Phase::Simulation);
+    for(size_t i = first; i < nbIteration; i++)
+    {
+        // the potential comes with the forces of the step before a record
+        const bool record = diagnostics != nullptr && (diagnostics->Due(i + 1) || i + 1 == nbIteration);
+        if(record)
+            diagnostics->Capture();
+
+        {
+            const ScopedPhase phase(Phase::Integrator);
+            integrator.Step(bodies, dt, profiled_force);
+        }
+        {
+            const ScopedPhase phase(Phase::Output);
+            writer.WriteFrame((i + 1) * dt, bodies);
+        }
+        profileCount(Counter::Steps, 1);
+
+        if(record)
+        {
+            const ScopedPhase phase(Phase::Diagnostics);
+            diagnostics->Record((i + 1) * dt, bodies, integrator, profiled_force);
+        }
+
+        if(checkpointer != nullptr && i + 1 < nbIteration && checkpointer->Due())
+        {
+            const ScopedPhase phase(Phase::Checkpoint);
+            checkpointer->Save(i + 1, i + 2, (i + 1) * dt, bodies, integrator, writer, dt);
+        }
+
+        if(i == first)
+            allocations.Start();
+    }
+    {
+        const ScopedPhase phase(Phase::Output);
+        writer.End();
+    }
+    std::cout << "Simulation finished.\n";
+    return reportAllocations(allocations);
+}
+
+
+/// @brief integrate with an adaptive timestep until `duration`
+///
+/// With `fixed_output`, a frame is written every `output_interval` seconds using the dense
+/// output of the integrator, otherwise a frame is written after each accepted step.
+template<typename T, int D, typename Force>
+size_t simulation(const T duration, const T output_interval, const bool fixed_output, Bodies<T, D>& bodies, AdaptiveIntegrator<T, D>& integrator, Force&& force, TrajectoryWriter<T>& writer,
+                  Checkpointer<T, D>* checkpointer = nullptr, Diagnostics<T, D>* diagnostics = nullptr)
+{
+    std::cout << "Starting the simulation of " << bodies.Size() << " bodies (dopri5)...\n";
+
+    const auto profiled_force = [&force](Bodies<T, D>& state) {
+        const ScopedPhase phase(Phase::Force);
+        force(state);
+    };
+
+    T t = 0;
+    size_t nbOutput = 1;        // frames written, the first being at t = 0
+    size_t nbSteps = 0;
+
+    if(checkpointer != nullptr && checkpointer->IsRestart())
+    {
+        const CheckpointState<T, D>& state = checkpointer->Restore(bodies, integrator, writer, output_interval);
+        t = state.time;
+        nbOutput = state.header.nb_frames;
+        nbSteps = state.header.step;
+        std::cout << "Restarting at t = " << t << " s\n";
+    }
+    else
+    {
+        writer.Begin(bodies.Size(), D, output_interval);
+        writer.WriteFrame(0, bodies);
+    }
+
+    if(diagnostics != nullptr)
+        diagnostics->Record(t, bodies, integrator, force);
+
+    Bodies<T, D> frame = bodies;
+    const size_t first = nbSteps;
+    AllocationProbe allocations;
+    const ScopedPhase loop(Phase::Simulation);
+    while(t < duration)
+    {
+        // the last step is not known in advance, the record after it may cost one more evaluation
+        const bool record = diagnostics != nullptr && diagnostics->Due(nbSteps + 1);
+        if(record)
+            diagnostics->Capture();
+
+        T dt;
+        {
+            const ScopedPhase phase(Phase::Integrator);
+            dt = integrator.Step(bodies, duration - t, profiled_force, t);
+        }
+        const T t_end = (duration - t <= dt) ? duration : t + dt;
+        profileCount(Counter::Steps, 1);
+
+        if(fixed_output)
+        {
+            const ScopedPhase phase(Phase::Output);
+            T output_time = nbOutput * output_interval;
+            while(output_time <= t_end)
+            {
+                integrator.Interpolate((output_time - t) / dt, frame);
+                writer.WriteFrame(output_time, frame);
+
+                nbOutput++;
+                output_time = nbOutput * output_interval;
+            }
+        }
+        else
+        {
+            const ScopedPhase phase(Phase::Output);
+            writer.WriteFrame(t_end, bodies);
+            nbOutput++;
+        }
+
+        t = t_end;
+        nbSteps++;
+
+        if(diagnostics != nullptr && (record || t >= duration))
+        {
+            const ScopedPhase phase(Phase::Diagnostics);
+            diagnostics->Record(t, bodies, integrator, profiled_force);
+        }
+
+        if(checkpointer != nullptr && t < duration && checkpointer->Due())
+        {
+            const ScopedPhase phase(Phase::Checkpoint);
+            checkpointer->Save(nbSteps, nbOutput, t, bodies, integrator, writer, output_interval);
+        }
+
+        if(nbSteps == first + 1)
+            allocations.Start();
+    }
+
+    {
+        const ScopedPhase phase(Phase::Output);
+        writer.End();
+    }
+    std::cout << "Simulation finished : " << integrator.GetAcceptedSteps() << " steps, "
+              << integrator.GetRejectedSteps() << " rejected, "
+              << integrator.GetForceEvaluations() << " force evaluations\n";
+    return reportAllocations(allocations);
+}
+
+
+/// @brief read the bodies of a system, one per line : "mass x y vx vy" or "mass x y z vx vy vz" in 3D,
+/// lines starting with '#' are ignored
+template<typename T, int D>
+bool loadSystem(const char* filepath, Bodies<T, D>& bodies)
+{
+    std::ifstream bodies_stream(filepath);
+    if(!bodies_stream.is_open())
+        return false;
+
+    std::string line;
+    while(std::getline(bodies_stream, line))
+    {
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream line_stream(line);
+        std::string fields[1 + 2 * D];
+        for(std::string& field : fields)
+        {
+            if(!(line_stream >> field))
+                return false;
+        }
+
+        T values[1 + 2 * D];
+        for(int f = 0; f < 1 + 2 * D; f++)
+            values[f] = parseScalar<T>(fields[f].c_str());
+
+        if constexpr(D == 3)
+            bodies.AddBody(values[0], Vec3<T>(values[1], values[2], values[3]), Vec3<T>(values[4], values[5], values[6]));
+        else
+            bodies.AddBody(values[0], Vec2<T>(values[1], values[2]), Vec2<T>(values[3], values[4]));
+    }
+
+    return bodies.Size() != 0;
+}
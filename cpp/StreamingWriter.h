@@ -0,0 +1,216 @@
+#pragma once
+
+#include "Trajectory.h"
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// @brief TrajectoryWriter handing the frames to a background thread through a ring buffer
+///
+/// The ring holds `capacity` frames allocated once by Begin, so the memory used by the output
+/// does not depend on the length of the simulation. The simulation only copies each frame in
+/// the ring and goes on; it waits only when the ring is full, i.e. when the disk is slower than
+/// the integration. The writer thread is only woken up when half of the ring is used, then it
+/// gives every frame available to the wrapped writer at once.
+///
+/// If the wrapped writer throws, the writer thread drops the frames left and stops : the
+/// exception is thrown again by the next WriteFrame, Flush or End of the simulation.
+template<typename T>
+class StreamingTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    explicit StreamingTrajectoryWriter(TrajectoryWriter<T>& output, size_t capacity = 1024)
+        : m_Output(output), m_Capacity(capacity == 0 ? 1 : capacity), m_Batch((m_Capacity + 1) / 2)
+    {
+    }
+
+    ~StreamingTrajectoryWriter() override
+    {
+        // not ended : the error of the wrapped writer, if any, was already thrown by WriteFrame
+        if(m_Thread.joinable())
+        {
+            Stop();
+            if(!m_Error)
+                m_Output.End();
+        }
+    }
+
+    StreamingTrajectoryWriter(const StreamingTrajectoryWriter&) = delete;
+    StreamingTrajectoryWriter& operator=(const StreamingTrajectoryWriter&) = delete;
+
+    void Begin(size_t nbBodies, int dimension, T timestep) override
+    {
+        m_Output.Begin(nbBodies, dimension, timestep);
+        Start(nbBodies, dimension);
+    }
+
+    void Resume(size_t nbBodies, int dimension, T timestep, size_t nbFrames, T time, const T* const* position) override
+    {
+        m_Output.Resume(nbBodies, dimension, timestep, nbFrames, time, position);
+        Start(nbBodies, dimension);
+    }
+
+    void WriteFrame(T time, const T* const* position, size_t nbBodies) override
+    {
+        size_t head;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            if(m_Head - m_Tail == m_Capacity)
+            {
+                m_Stalls++;
+                m_Not_full.wait(lock, [this]() { return m_Head - m_Tail < m_Capacity || m_Error; });
+            }
+            if(m_Error)
+                std::rethrow_exception(m_Error);
+            head = m_Head;
+        }
+
+        // the writer thread does not read this slot before m_Head moves past it
+        T* slot = m_Ring.data() + (head % m_Capacity) * m_Frame_size;
+        slot[0] = time;
+        for(int d = 0; d < m_Dimension; d++)
+            std::memcpy(slot + 1 + d * m_Nb_bodies, position[d], nbBodies * sizeof(T));
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Head++;
+            wake = (m_Head - m_Tail == m_Batch);
+        }
+        if(wake)
+            m_Not_empty.notify_one();
+    }
+
+    /// @brief wait until every frame is written, then end the wrapped writer
+    void End() override
+    {
+        Stop();
+        if(m_Error)
+            std::rethrow_exception(m_Error);
+
+        m_Output.End();
+    }
+
+    /// @brief wait until every frame received is given to the wrapped writer, then flush it
+    void Flush() override
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Flushing = true;
+            m_Not_empty.notify_one();
+            m_Not_full.wait(lock, [this]() { return m_Head == m_Tail || m_Error; });
+            m_Flushing = false;
+            if(m_Error)
+                std::rethrow_exception(m_Error);
+        }
+        m_Output.Flush();
+    }
+
+    size_t GetCapacity() const { return m_Capacity; }
+
+    /// @brief number of frames that had to wait for a free slot
+    size_t GetStalls() const { return m_Stalls; }
+
+private :
+    TrajectoryWriter<T>& m_Output;
+    const size_t m_Capacity;
+    const size_t m_Batch;           // frames waiting before the writer thread is woken up
+    size_t m_Nb_bodies = 0;
+    int m_Dimension = 2;
+    size_t m_Frame_size = 0;
+    std::vector<T> m_Ring;
+
+    std::thread m_Thread;
+    std::mutex m_Mutex;
+    std::condition_variable m_Not_empty;
+    std::condition_variable m_Not_full;
+
+    // frames [m_Tail, m_Head) are waiting in the ring
+    size_t m_Head = 0;
+    size_t m_Tail = 0;
+    bool m_Done = false;
+    bool m_Flushing = false;
+    size_t m_Stalls = 0;
+    std::exception_ptr m_Error;     // thrown by the wrapped writer on the writer thread
+
+
+    void Start(size_t nbBodies, int dimension)
+    {
+        // one slot : [t, x0 ... xn-1, y0 ... yn-1 (, z0 ... zn-1)]
+        m_Nb_bodies = nbBodies;
+        m_Dimension = dimension;
+        m_Frame_size = 1 + dimension * nbBodies;
+        m_Ring.assign(m_Capacity * m_Frame_size, T(0));
+        m_Head = 0;
+        m_Tail = 0;
+        m_Done = false;
+        m_Flushing = false;
+        m_Stalls = 0;
+        m_Error = nullptr;
+
+        m_Thread = std::thread([this]() { WriterLoop(); });
+    }
+
+    /// @brief wait until the writer thread has given every frame to the wrapped writer, or failed
+    void Stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Done = true;
+        }
+        m_Not_empty.notify_one();
+
+        if(m_Thread.joinable())
+            m_Thread.join();
+    }
+
+    void WriterLoop()
+    {
+        while(true)
+        {
+            size_t tail, head;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Not_empty.wait(lock, [this]() { return m_Done || m_Head - m_Tail >= m_Batch || (m_Flushing && m_Head != m_Tail); });
+                if(m_Head == m_Tail)
+                    return;
+
+                tail = m_Tail;
+                head = m_Head;
+            }
+
+            try
+            {
+                for(size_t frame = tail; frame < head; frame++)
+                {
+                    const T* slot = m_Ring.data() + (frame % m_Capacity) * m_Frame_size;
+                    const T* position[3];
+                    for(int d = 0; d < m_Dimension; d++)
+                        position[d] = slot + 1 + d * m_Nb_bodies;
+                    m_Output.WriteFrame(slot[0], position, m_Nb_bodies);
+                }
+            }
+            catch(...)
+            {
+                // the frames waiting are dropped, and nothing waits for the next ones
+                {
+                    std::lock_guard<std::mutex> lock(m_Mutex);
+                    m_Error = std::current_exception();
+                }
+                m_Not_full.notify_all();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Tail = head;
+            }
+            m_Not_full.notify_one();
+        }
+    }
+};
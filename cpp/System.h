@@ -0,0 +1,73 @@
+#pragma once
+
+#include "Vector.h"
+#include <vector>
+
+
+/// @brief Vec2 or Vec3, the vector type of a space of dimension D
+template<typename T, int D>
+using VecD = VecN<T, D>;
+
+template<typename T, int N>
+inline T component(const VecN<T, N>& v, int d) { return v[d]; }
+
+
+/// @brief all the bodies of a simulation, stored as a structure of arrays and advanced together
+///
+/// Every quantity has its own contiguous array (pos[0] is x[], pos[1] is y[], vel[0] is vx[] ...)
+/// so the loops over the bodies stream through memory and can be vectorised. A 3D system only
+/// adds the z arrays : the kernels run over each component the same way, so a body costs
+/// 3/2 of the memory traffic of a 2D one and not the 4/2 of a padded (x, y, z, w) layout.
+template<typename T, int D = 2>
+struct Bodies {
+public :
+    static_assert(D == 2 || D == 3, "the simulations are in 2D or 3D");
+
+    static constexpr int Dim = D;
+    using Vector = VecD<T, D>;
+
+    std::vector<T> mass;
+    std::vector<T> pos[Dim];
+    std::vector<T> vel[Dim];
+    std::vector<T> acc[Dim];
+
+    Bodies() = default;
+
+    void Reserve(size_t nbBodies)
+    {
+        mass.reserve(nbBodies);
+        for(int d = 0; d < Dim; d++)
+        {
+            pos[d].reserve(nbBodies);
+            vel[d].reserve(nbBodies);
+            acc[d].reserve(nbBodies);
+        }
+    }
+
+    void AddBody(T _mass, Vector initial_position, Vector initial_velocity)
+    {
+        mass.push_back(_mass);
+
+        for(int d = 0; d < Dim; d++)
+        {
+            pos[d].push_back(component(initial_position, d));
+            vel[d].push_back(component(initial_velocity, d));
+            acc[d].push_back(0);
+        }
+    }
+
+    size_t Size() const { return mass.size(); }
+
+    Vector GetPosition(size_t i) const { return Get(pos, i); }
+    Vector GetVelocity(size_t i) const { return Get(vel, i); }
+    Vector GetAcceleration(size_t i) const { return Get(acc, i); }
+
+private :
+    static Vector Get(const std::vector<T> (&arrays)[Dim], size_t i)
+    {
+        if constexpr(D == 3)
+            return Vector(arrays[0][i], arrays[1][i], arrays[2][i]);
+        else
+            return Vector(arrays[0][i], arrays[1][i]);
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+/// @brief persistent worker threads, woken up for each parallel section
+///
+/// The calling thread takes part in the work as thread 0, so a pool of size 1 runs everything
+/// inline without any synchronisation. Work is always split the same way for a given size,
+/// which keeps the results reproducible from one run to another.
+class ThreadPool {
+public :
+    /// @brief nbThreads = 0 uses every core of the machine
+    explicit ThreadPool(size_t nbThreads = 1)
+    {
+        if(nbThreads == 0)
+            nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+        m_Size = nbThreads;
+        m_Workers.reserve(nbThreads - 1);
+        for(size_t t = 1; t < nbThreads; t++)
+            m_Workers.emplace_back([this, t]() { WorkerLoop(t); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stop = true;
+        }
+        m_Start_condition.notify_all();
+
+        for(std::thread& worker : m_Workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t Size() const { return m_Size; }
+
+    /// @brief call task(thread_index) once on every thread of the pool and wait for all of them
+    template<typename Task>
+    void Run(Task&& task)
+    {
+        if(m_Size == 1)
+        {
+            task(size_t(0));
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            using Callable = std::remove_reference_t<Task>;
+            m_Task = const_cast<void*>(static_cast<const void*>(&task));
+            m_Invoke = [](void* context, size_t thread) { (*static_cast<Callable*>(context))(thread); };
+            m_Remaining = m_Size - 1;
+            m_Generation++;
+        }
+        m_Start_condition.notify_all();
+
+        task(size_t(0));
+
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        m_Done_condition.wait(lock, [this]() { return m_Remaining == 0; });
+    }
+
+    /// @brief split [0, n) in Size() contiguous chunks and call function(begin, end, thread_index) on each
+    template<typename Function>
+    void ParallelFor(size_t n, Function&& function)
+    {
+        Run([this, n, &function](size_t thread) {
+            const size_t begin = n * thread / m_Size;
+            const size_t end = n * (thread + 1) / m_Size;
+            if(begin < end)
+                function(begin, end, thread);
+        });
+    }
+
+private :
+    size_t m_Size;
+    std::vector<std::thread> m_Workers;
+
+    std::mutex m_Mutex;
+    std::condition_variable m_Start_condition;
+    std::condition_variable m_Done_condition;
+
+    // current parallel section
+    void* m_Task = nullptr;
+    void (*m_Invoke)(void*, size_t) = nullptr;
+    size_t m_Remaining = 0;
+    size_t m_Generation = 0;
+    bool m_Stop = false;
+
+
+    void WorkerLoop(size_t thread)
+    {
+        size_t generation = 0;
+
+        while(true)
+        {
+            void* task;
+            void (*invoke)(void*, size_t);
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Start_condition.wait(lock, [this, generation]() { return m_Stop || m_Generation != generation; });
+                if(m_Stop)
+                    return;
+
+                generation = m_Generation;
+                task = m_Task;
+                invoke = m_Invoke;
+            }
+
+            invoke(task, thread);
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if(--m_Remaining == 0)
+                m_Done_condition.notify_one();
+        }
+    }
+};
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "Scalar.h"
+#include "Vector.h"
+#include "System.h"
+#include "Profiler.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+/// @brief output of the simulations, one frame (the positions of every body at a given time) after another
+///
+/// Begin is called once before the first frame and End once after the last one. A simulation
+/// restarted from a checkpoint calls Resume instead of Begin, on an output already holding its first frames.
+template<typename T>
+class TrajectoryWriter {
+public :
+    virtual ~TrajectoryWriter() = default;
+
+    /// @brief dimension : number of components of the positions, 2 or 3
+    virtual void Begin(size_t nbBodies, int dimension, T timestep) = 0;
+
+    /// @brief positions of the nbBodies bodies at `time`, position[d] being the array of the d-th components
+    virtual void WriteFrame(T time, const T* const* position, size_t nbBodies) = 0;
+
+    virtual void End() = 0;
+
+    /// @brief give every frame received so far to the stream, for a checkpoint to record its size
+    virtual void Flush() {}
+
+    /// @brief go on after nbFrames frames already in the output, the last one being `position` at `time`
+    virtual void Resume(size_t nbBodies, int dimension, T timestep, size_t /*nbFrames*/, T /*time*/, const T* const* /*position*/)
+    {
+        Begin(nbBodies, dimension, timestep);
+    }
+
+    template<int D>
+    void WriteFrame(T time, const Bodies<T, D>& bodies)
+    {
+        const T* position[D];
+        for(int d = 0; d < D; d++)
+            position[d] = bodies.pos[d].data();
+        WriteFrame(time, position, bodies.Size());
+    }
+
+    /// @brief frame of a system with a single body
+    void WritePoint(T time, const Vec2<T>& position)
+    {
+        const T* components[2] = { &position.x, &position.y };
+        WriteFrame(time, components, 1);
+    }
+};
+
+
+/// @brief text output, one line per frame : "x0;y0;x1;y1;...\n" or "x0;y0;z0;x1;...\n" in 3D (the time is not written)
+template<typename T>
+class CsvTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    explicit CsvTrajectoryWriter(std::ostream& stream)
+        : m_Stream(stream)
+    {
+    }
+
+    void Begin(size_t, int dimension, T) override { m_Dimension = dimension; }
+
+    void Resume(size_t, int dimension, T, size_t, T, const T* const*) override { m_Dimension = dimension; }
+
+    void WriteFrame(T, const T* const* position, size_t nbBodies) override
+    {
+        // the separators and the end of line
+        size_t bytes = nbBodies * m_Dimension;
+        for(size_t i = 0; i < nbBodies; i++)
+        {
+            for(int d = 0; d < m_Dimension; d++)
+            {
+                if(i != 0 || d != 0)
+                    m_Stream << ';';
+
+                bytes += writeScalar(m_Stream, position[d][i]);
+            }
+        }
+        m_Stream << '\n';
+        profileCount(Counter::BytesWritten, bytes);
+    }
+
+    void End() override { m_Stream.flush(); }
+
+    void Flush() override { m_Stream.flush(); }
+
+private :
+    std::ostream& m_Stream;
+    int m_Dimension = 2;
+};
+
+
+////// Binary format
+
+/// @brief flags of TrajectoryHeader::columns
+enum TrajectoryColumns : uint32_t
+{
+    TrajectoryTime = 1,         // one scalar at the start of each frame
+    TrajectoryPositions = 2     // dimension scalars per body, body after body
+};
+
+/// @brief flags of TrajectoryHeader::flags
+enum TrajectoryFlags : uint32_t
+{
+    TrajectoryPublished = 1     // nb_frames counts the frames after each one, even while it is 0
+};
+
+/// @brief first 64 bytes of a binary trajectory, followed by the frames
+///
+/// Every frame holds [t, x0, y0, x1, y1, ...] (or [t, x0, y0, z0, x1, ...] in 3D) as raw scalars of the type described by dtype,
+/// so the file can be opened with numpy.memmap(path, dtype, offset=header_size) and reshaped
+/// to (nb_frames, 1 + nb_bodies * dimension). The integers are in the byte order of the machine,
+/// given by the first character of dtype.
+struct TrajectoryHeader
+{
+    char magic[8];              // "TIPETRAJ"
+    uint32_t version;
+    uint32_t header_size;
+    char dtype[8];              // numpy descriptor of the scalars ("<f8" ...), "|V16" for quad
+    uint32_t scalar_size;
+    uint32_t nb_bodies;
+    uint32_t dimension;
+    uint32_t columns;           // TrajectoryColumns
+    uint64_t nb_frames;         // 0 if the simulation did not end, the size of the file gives it,
+                                // unless flags has TrajectoryPublished
+    double timestep;
+    uint32_t flags;             // TrajectoryFlags
+    uint8_t padding[4];
+};
+
+static_assert(sizeof(TrajectoryHeader) == 64, "the header of the binary trajectories must stay 64 bytes long");
+
+/// @brief numpy descriptor of T
+template<typename T>
+std::string numpyDtype()
+{
+    const uint16_t one = 1;
+    uint8_t first_byte;
+    std::memcpy(&first_byte, &one, 1);
+    const char order = first_byte == 1 ? '<' : '>';
+
+#ifdef USE_QUAD
+    // numpy has no binary128 type, the values are left as raw bytes
+    if(std::is_same<T, quad>::value)
+        return "|V16";
+#endif
+
+    return order + std::string("f") + std::to_string(sizeof(T));
+}
+
+
+/// @brief header of a trajectory of T scalars, without any frame yet
+template<typename T>
+TrajectoryHeader makeTrajectoryHeader(size_t nbBodies, int dimension, T timestep)
+{
+    TrajectoryHeader header = {};
+    std::memcpy(header.magic, "TIPETRAJ", 8);
+    header.version = 1;
+    header.header_size = sizeof(TrajectoryHeader);
+    std::strncpy(header.dtype, numpyDtype<T>().c_str(), sizeof(header.dtype) - 1);
+    header.scalar_size = sizeof(T);
+    header.nb_bodies = static_cast<uint32_t>(nbBodies);
+    header.dimension = static_cast<uint32_t>(dimension);
+    header.columns = TrajectoryTime | TrajectoryPositions;
+    header.nb_frames = 0;
+    header.timestep = static_cast<double>(timestep);
+    return header;
+}
+
+
+/// @brief copy of a scalar, without the padding bytes of the x87 long double (80 bits stored in 12 or 16 bytes)
+/// which would otherwise make two identical runs give different files
+template<typename T>
+inline void storeScalar(char* out, const T& value)
+{
+    std::memcpy(out, &value, sizeof(T));
+    if(std::is_same<T, long double>::value && std::numeric_limits<T>::digits == 64 && sizeof(T) > 10)
+        std::memset(out + 10, 0, sizeof(T) - 10);
+}
+
+
+/// @brief raw scalars behind a TrajectoryHeader, see its description for the layout
+///
+/// The frames are gathered in a buffer written by blocks. The number of frames is written
+/// in the header by End, when the stream can be rewound. Resumed, the writer appends to the
+/// stream, which must be placed after the header and the frames to keep.
+template<typename T>
+class BinaryTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    static constexpr size_t BufferSize = 1 << 20;
+
+    explicit BinaryTrajectoryWriter(std::ostream& stream)
+        : m_Stream(stream)
+    {
+        m_Buffer.reserve(BufferSize);
+    }
+
+    void Begin(size_t nbBodies, int dimension, T timestep) override
+    {
+        const TrajectoryHeader header = makeTrajectoryHeader<T>(nbBodies, dimension, timestep);
+
+        m_Header_position = m_Stream.tellp();
+        m_Stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        m_Dimension = dimension;
+        m_Nb_frames = 0;
+    }
+
+    void Resume(size_t nbBodies, int dimension, T, size_t, T, const T* const*) override
+    {
+        // the header is at the start of the file, the frames after it are counted from the size of the file
+        m_Header_position = 0;
+        m_Dimension = dimension;
+        const std::streamoff frames_size = m_Stream.tellp() - std::streampos(sizeof(TrajectoryHeader));
+        m_Nb_frames = frames_size > 0 ? frames_size / ((1 + dimension * nbBodies) * sizeof(T)) : 0;
+    }
+
+    void WriteFrame(T time, const T* const* position, size_t nbBodies) override
+    {
+        const size_t frame_size = (1 + m_Dimension * nbBodies) * sizeof(T);
+        if(m_Buffer.size() + frame_size > BufferSize)
+            WriteBuffer();
+
+        const size_t offset = m_Buffer.size();
+        m_Buffer.resize(offset + frame_size);
+        char* out = m_Buffer.data() + offset;
+
+        storeScalar(out, time);
+        out += sizeof(T);
+        for(size_t i = 0; i < nbBodies; i++)
+        {
+            for(int d = 0; d < m_Dimension; d++)
+            {
+                storeScalar(out, position[d][i]);
+                out += sizeof(T);
+            }
+        }
+
+        m_Nb_frames++;
+    }
+
+    void End() override
+    {
+        WriteBuffer();
+
+        // number of frames in the header, if the stream can go back
+        if(m_Header_position != std::streampos(-1))
+        {
+            const std::streampos end = m_Stream.tellp();
+            const uint64_t nb_frames = m_Nb_frames;
+            m_Stream.seekp(m_Header_position + std::streamoff(offsetof(TrajectoryHeader, nb_frames)));
+            m_Stream.write(reinterpret_cast<const char*>(&nb_frames), sizeof(nb_frames));
+            m_Stream.seekp(end);
+        }
+        m_Stream.flush();
+    }
+
+    void Flush() override
+    {
+        WriteBuffer();
+        m_Stream.flush();
+    }
+
+    size_t GetFrameCount() const { return m_Nb_frames; }
+
+private :
+    std::ostream& m_Stream;
+    std::vector<char> m_Buffer;
+    std::streampos m_Header_position = -1;
+    int m_Dimension = 2;
+    size_t m_Nb_frames = 0;
+
+
+    void WriteBuffer()
+    {
+        m_Stream.write(m_Buffer.data(), m_Buffer.size());
+        profileCount(Counter::BytesWritten, m_Buffer.size());
+        m_Buffer.clear();
+    }
+};
+
+
+/// @brief frames kept in memory, with the layout of the binary format : [t, x0, y0, x1, y1, ...] one frame after another
+///
+/// The frames are contiguous, so the whole trajectory can be handed over as one array of
+/// (GetFrameCount(), GetFrameSize()) scalars (to NumPy by the Python module, see cpp/bindings.cpp).
+/// A frame written past the capacity may move them : Reserve the frames of a run beforehand
+/// to keep the pointers given by GetData valid.
+template<typename T>
+class MemoryTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    void Begin(size_t nbBodies, int dimension, T timestep) override
+    {
+        m_Nb_bodies = nbBodies;
+        m_Dimension = dimension;
+        m_Timestep = timestep;
+        m_Data.clear();
+    }
+
+    void Resume(size_t nbBodies, int dimension, T timestep, size_t, T, const T* const*) override
+    {
+        m_Nb_bodies = nbBodies;
+        m_Dimension = dimension;
+        m_Timestep = timestep;
+    }
+
+    void WriteFrame(T time, const T* const* position, size_t nbBodies) override
+    {
+        m_Data.push_back(time);
+        for(size_t i = 0; i < nbBodies; i++)
+        {
+            for(int d = 0; d < m_Dimension; d++)
+                m_Data.push_back(position[d][i]);
+        }
+    }
+
+    void End() override {}
+
+    /// @brief room for nbFrames frames in total
+    void Reserve(size_t nbFrames) { m_Data.reserve(nbFrames * GetFrameSize()); }
+
+    /// @brief scalars that can be held without moving the frames
+    size_t GetCapacity() const { return m_Data.capacity(); }
+
+    /// @brief forget the frames, keeping the memory
+    void Clear() { m_Data.clear(); }
+
+    size_t GetBodyCount() const { return m_Nb_bodies; }
+    int GetDimension() const { return m_Dimension; }
+    T GetTimestep() const { return m_Timestep; }
+
+    /// @brief scalars in a frame, the time and the positions
+    size_t GetFrameSize() const { return 1 + m_Nb_bodies * m_Dimension; }
+    size_t GetFrameCount() const { return m_Data.size() / GetFrameSize(); }
+
+    const T* GetData() const { return m_Data.data(); }
+    const T* GetFrame(size_t k) const { return m_Data.data() + k * GetFrameSize(); }
+
+private :
+    std::vector<T> m_Data;
+    size_t m_Nb_bodies = 0;
+    int m_Dimension = 2;
+    T m_Timestep = 0;
+};
+
+
+/// @brief Mapped is the binary format written through a memory-mapped file (MappedTrajectory.h),
+/// Compressed the frames predicted from the previous ones (CompressedTrajectory.h)
+enum class TrajectoryFormat { Csv, Binary, Mapped, Compressed };
+
+inline bool parseTrajectoryFormat(const std::string& name, TrajectoryFormat& format)
+{
+    if(name == "csv")
+        format = TrajectoryFormat::Csv;
+    else if(name == "bin")
+        format = TrajectoryFormat::Binary;
+    else if(name == "mmap")
+        format = TrajectoryFormat::Mapped;
+    else if(name == "ctj")
+        format = TrajectoryFormat::Compressed;
+    else
+        return false;
+
+    return true;
+}
+
+template<typename T>
+std::unique_ptr<TrajectoryWriter<T>> makeTrajectoryWriter(TrajectoryFormat format, std::ostream& stream)
+{
+    if(format == TrajectoryFormat::Binary)
+        return std::unique_ptr<TrajectoryWriter<T>>(new BinaryTrajectoryWriter<T>(stream));
+
+    return std::unique_ptr<TrajectoryWriter<T>>(new CsvTrajectoryWriter<T>(stream));
+}
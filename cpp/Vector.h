@@ -5,9 +5,9 @@
 #include <cmath>
 #include <type_traits>
 #include <functional>
+#include <stdexcept>
 
-
-using ldouble = long double;
+#include "Scalar.h"
 
 
 
@@ -88,6 +88,13 @@ using substraction_equal_type = decltype(std::declval<Lhs>() -= std::declval<Rhs
 // type trait definition
 //
 
+/// @brief keeps T out of the template argument deduction (scalar * vector takes the type of the vector)
+template <class T>
+struct nondeduced { using type = T; };
+
+template <class T>
+using nondeduced_t = typename nondeduced<T>::type;
+
 template <class Lhs, class Rhs>
 constexpr bool can_multiply = is_detected<multiplication_type, Lhs, Rhs>::value;
 
@@ -116,788 +123,333 @@ template <class Lhs, class Rhs>
 constexpr bool can_substract_equal = is_detected<substraction_equal_type, Lhs, Rhs>::value;
 
 
-//////////// classes declaration
-template<typename t>
-class Vec2;
-
-template<typename t>
-class Vec3;
-
-
-
-//////////////////////////////////////////////////////////////
-//////////////////   Functions' signature   //////////////////
-//////////////////////////////////////////////////////////////
-
-
-
-/////// Vector 2
-
-// additions
-
-template<typename Lhs, typename Rhs>
-Vec2<addition_type<Lhs, Rhs>> operator+(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2);
-
-
-// substraction
-
-template<typename Lhs, typename Rhs>
-Vec2<substraction_type<Lhs, Rhs>> operator-(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2);
-
-
-
-// multiplications
-
-template <typename T>
-Vec2<division_type<ldouble, T>> operator*(ldouble f, const Vec2<T>& v);
-
-template<typename Lhs, typename Rhs>
-Vec2<division_type<Lhs, Rhs>> operator*(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2);
-
-
-
-// divisions
-
-template<typename Lhs, typename Rhs>
-Vec2<division_type<Lhs, Rhs>> operator/(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2);
-
-
-// print operator Vec2
-template<typename Ty>
-std::ostream& operator<<(std::ostream& os, const Vec2<Ty>& obj);
-
-
-/////// dot product
-
-template<typename Lhs, typename Rhs>
-ldouble dot(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2);
-
-
-
-/////// distance between 2 vector
-
-template<typename Lhs, typename Rhs>
-ldouble dist(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2);
-
-template<typename Lhs, typename Rhs>
-ldouble dist_square(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2);
-
-
-
-
-
-
-
-//////// Vector 3
-
-// additions
-
-template<typename Lhs, typename Rhs>
-Vec3<addition_type<Lhs, Rhs>> operator+(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2);
-
-
-// substraction
-
-template<typename Lhs, typename Rhs>
-Vec3<substraction_type<Lhs, Rhs>> operator-(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2);
-
-
-
-// multiplications
-
-template <typename T>
-Vec3<division_type<ldouble, T>> operator*(ldouble f, const Vec3<T>& v);
-
-template<typename Lhs, typename Rhs>
-Vec3<division_type<Lhs, Rhs>> operator*(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2);
-
-
-
-// divisions
-
-template<typename Lhs, typename Rhs>
-Vec3<division_type<Lhs, Rhs>> operator/(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2);
-
-
-// print operator Vec3
-template<typename Ty>
-std::ostream& operator<<(std::ostream& os, const Vec3<Ty>& obj);
-
-
-/////// dot product
-
-template<typename Lhs, typename Rhs>
-ldouble dot(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2);
-
-
-/////// distance between 2 vector
-
-template<typename Lhs, typename Rhs>
-ldouble dist(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2);
-
-template<typename Lhs, typename Rhs>
-ldouble dist_square(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2);
-
-
-
-
-
-
 
 
+////// Division by zero
+//
+//  The divisions of the vectors are not checked : they are in the innermost loop of every
+//  simulation, where a zero divisor gives inf / nan in the output. Compiled with
+//  -DVECTOR_CHECK_DIVISION, they throw std::domain_error instead (debug builds).
+//
 
-//////////////////////////////////////////////////
-//////////////////   Vector 2   //////////////////
-//////////////////////////////////////////////////
-
-template<typename T>
-struct Vec2 {
-    T x;
-    T y;
-
-    Vec2(T _x, T _y)
-        : x(_x), y(_y)
-    {
-    }
-
-    Vec2(const Vec2& vec)
-        : x(vec.x), y(vec.y)
-    {
-    }
-
-    //////////////// Basic methods
-
-    ldouble Magnitude() const
-    {
-        if(!can_multiply<T, T>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
-
-        if(!can_add<multiplication_type<T, T>, multiplication_type<T, T>>)
-        {
-            throw "Error, impossible addition\n";
-        }
-
-        return sqrt(x*x + y*y);
-    }
-
-    ldouble Magnitude_squared() const
-    {
-        if(!can_multiply<T, T>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
-
-        if(!can_add<multiplication_type<T, T>, multiplication_type<T, T>>)
-        {
-            throw "Error, impossible addition\n";
-        }
-
-        return x*x + y*y;
-    }
-
-
-    Vec2 Normalised() const
-    {
-        ldouble magnitude = Magnitude();
-        if(magnitude == 0)
-        {
-            return *this;
-        }
-
-        if(!can_divide<T, ldouble>)
-        {
-            throw "Error, impossible division\n";
-        }        
-
-        return Vec2(x/magnitude, y/magnitude);
-    }
-
-    Vec2 Normalise()
-    {
-        ldouble magnitude = Magnitude();
-        if(magnitude == 0)
-        {
-            return *this;
-        }
-
-        if(!can_divide_equal<T, ldouble>)
-            throw "Error, impossible division\n";
-
-        x /= magnitude;
-        y /= magnitude;
-        
-        return *this;
-    }
+#ifdef VECTOR_CHECK_DIVISION
+constexpr bool VectorCheckDivision = true;
+#else
+constexpr bool VectorCheckDivision = false;
+#endif
 
-    Vec2 ortho() const
+template<typename... Ty>
+constexpr void checkDivisors(const Ty&... divisors) noexcept(!VectorCheckDivision)
+{
+    if constexpr(VectorCheckDivision)
     {
-        return Vec2(-y, x);
+        if(((divisors == 0) || ...))
+            throw std::domain_error("Vector : division by zero");
     }
+}
 
 
 
 
+//////////////////////////////////////////////////////////////
+//////////////////   Components' storage   ///////////////////
+//////////////////////////////////////////////////////////////
 
+// The components are named x, y (and z) in 2D and 3D, the way the simulations use them, and
+// kept in an array for the other sizes. Component<I>() gives the component I known at compile
+// time : the operations of VecN are written once with it, as one expression per component.
 
-    /////////// add operators
-
-    template <typename Ty>
-    Vec2<addition_type<T, Ty>> operator+(const Vec2<Ty>& other) const
-    {
-        if(!can_add<T, Ty>)
-        {
-            throw "Error, impossible addition\n";
-        }
-
-        return Vec2<addition_type<T, Ty>>(x + other.x, y + other.y);
-    }
-
-    void operator+=(const Vec2& other) {
-        if(!can_add<T, T>)
-        {
-            std::cout << "test\n";
-            throw "Error, impossible addition\n";
-        }
-        x += other.x;
-        y += other.y;
-    }
-
-
-
-    /////////// substract operator
+template<typename T, int N>
+struct VecStorage {
+    T components[N];
 
-    template <typename Ty>
-    Vec2<substraction_type<T, Ty>> operator-(const Vec2<Ty>& other) const
+    template<typename... Ty, std::enable_if_t<sizeof...(Ty) == N, int> = 0>
+    constexpr VecStorage(Ty... _components) noexcept
+        : components{ static_cast<T>(_components)... }
     {
-        if(!can_substract<T, Ty>)
-        {
-            throw "Error, impossible substraction\n";
-        }
-        return Vec2<substraction_type<T, Ty>>(x - other.x, y - other.y);
-    }
-
-    void operator-=(const Vec2& other) {
-        if(!can_substract_equal<T, T>)
-        {
-            throw "Error, impossible substraction\n";
-        }
-
-        x -= other.x;
-        y -= other.y;
     }
 
+    template<int I> constexpr T& Component() noexcept { return components[I]; }
+    template<int I> constexpr const T& Component() const noexcept { return components[I]; }
 
+    constexpr T& operator[](int d) noexcept { return components[d]; }
+    constexpr const T& operator[](int d) const noexcept { return components[d]; }
+};
 
-    /////////// scalar multiplication
+template<typename T>
+struct VecStorage<T, 2> {
+    T x;
+    T y;
 
-    Vec2<multiplication_type<T, ldouble>> operator*(ldouble f) const
+    constexpr VecStorage(T _x, T _y) noexcept
+        : x(_x), y(_y)
     {
-        if(!can_multiply<ldouble, T>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
-
-        return Vec2<multiplication_type<T, ldouble>>(x * f, y * f);
     }
 
-    void operator*=(ldouble f)
-    {
-        if(!can_multiply_equal<T, ldouble>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
-
-        x *= f;
-        y *= f;
-    }
+    template<int I> constexpr T& Component() noexcept { if constexpr(I == 0) return x; else return y; }
+    template<int I> constexpr const T& Component() const noexcept { if constexpr(I == 0) return x; else return y; }
 
-    /////////// vector-vector multiplication (component-wise)
+    constexpr T& operator[](int d) noexcept { return d == 0 ? x : y; }
+    constexpr const T& operator[](int d) const noexcept { return d == 0 ? x : y; }
+};
 
-    template <typename Ty>
-    Vec2<multiplication_type<T, Ty>> operator*(const Vec2<Ty>& other) const
+template<typename T>
+struct VecStorage<T, 3> {
+    union
     {
-        if(!can_multiply<T, Ty>)
+        struct
         {
-            throw "Error, impossible multiplication\n";
-        }
-        return Vec2<multiplication_type<T, Ty>>(x * other.x, y * other.y);
-    }
+            T x, y, z;
+        };
 
-    template<typename Ty>
-    void operator*=(const Vec2<Ty>& v)
-    {
-        if(!can_multiply_equal<T, Ty>)
+        struct
         {
-            throw "Error, impossible multiplication\n";
-        }
-
-        x *= v.x;
-        y *= v.y;
-    }
-
-
-
-    /////////// scalar division
+            T r, g, b;
+        };
+    };
 
-    Vec2<division_type<T, ldouble>> operator/(ldouble f) const
+    constexpr VecStorage(T _x, T _y, T _z) noexcept
+        : x(_x), y(_y), z(_z)
     {
-        if(!can_divide<T, ldouble>)
-        {
-            throw "Error, impossible division\n";
-        }
-
-        if(f == 0)
-        {
-            throw "Division by zero\n";
-        }
-
-        return Vec2<division_type<T, ldouble>>(x / f, y / f);
     }
 
-    void operator/=(ldouble f)
-    {
-        if(!can_divide_equal<T, ldouble>)
-        {
-            throw "Error, impossible division\n";
-        }
+    template<int I> constexpr T& Component() noexcept { if constexpr(I == 0) return x; else if constexpr(I == 1) return y; else return z; }
+    template<int I> constexpr const T& Component() const noexcept { if constexpr(I == 0) return x; else if constexpr(I == 1) return y; else return z; }
 
-        if(f == 0)
-        {
-            throw "Division by zero\n";
-        }
+    constexpr T& operator[](int d) noexcept { return d == 0 ? x : d == 1 ? y : z; }
+    constexpr const T& operator[](int d) const noexcept { return d == 0 ? x : d == 1 ? y : z; }
+};
 
-        x /= f;
-        y /= f;
-    }
 
-    /////////// vector-vector division (component-wise)
 
-    template <typename Ty>
-    Vec2<division_type<T, Ty>> operator/(const Vec2<Ty>& other) const
-    {
-        if(!can_divide<T, Ty>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
 
-        if(other.x == 0 || other.y == 0)
-        {
-            throw "Division by zero\n";
-        }
 
-        return Vec2<division_type<T, Ty>>(x / other.x, y / other.y);
-    }
 
-    template<typename Ty>
-    void operator/=(const Vec2<Ty>& v)
-    {
-        if(!can_divide_equal<T, Ty>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
 
-        if(v.x == 0 || v.y == 0)
-        {
-            throw "Division by zero\n";
-        }
+//////////////////////////////////////////////////
+//////////////////   Vector N   //////////////////
+//////////////////////////////////////////////////
 
-        x /= v.x;
-        y /= v.y;
-    }
+// Every operation is a constexpr function expanded over the components at compile time (no loop,
+// no index at run time) and always inlined. A compound expression such as
+// position + velocity * dt + acceleration * (dt * dt / 2) makes temporaries only in the source :
+// once inlined they are scalar values that the compiler keeps in registers, so it compiles to the
+// same code as the expression written component by component.
 
-};
+template<typename T, int N>
+struct VecN;
 
+template<typename T>
+using Vec2 = VecN<T, 2>;
 
+template<typename T>
+using Vec3 = VecN<T, 3>;
 
 
+#define VECTOR_INLINE __attribute__((always_inline)) inline constexpr
 
+template<typename T, int N>
+struct VecN : public VecStorage<T, N> {
+    using Scalar = T;
+    static constexpr int Size = N;
+    using Indices = std::make_integer_sequence<int, N>;
 
+    using VecStorage<T, N>::VecStorage;
 
-//////////////////////////////////////////////////
-//////////////////   Vector 3   //////////////////
-//////////////////////////////////////////////////
+    // trivially copyable : copied with a memcpy and passed in registers
+    VecN(const VecN& vec) = default;
+    VecN& operator=(const VecN& vec) = default;
 
-template<typename T>
-struct Vec3 {
 
-    union
-    {
-        struct
-        {
-            T x, y, z;
-        };
+    /// @brief the null vector
+    static VECTOR_INLINE VecN Zero() noexcept { return Filled(T(0), Indices()); }
 
-        struct
-        {
-            T r, g, b;
-        };
-    };
+    /// @brief vector of the f(component I) for every I
+    template<typename F>
+    VECTOR_INLINE auto Map(F f) const noexcept { return Map(f, Indices()); }
 
-    Vec3(T _x, T _y, T _z)
-        : x(_x), y(_y), z(_z)
-    {
-    }
+    /// @brief f(component I) for every I, in order
+    template<typename F>
+    VECTOR_INLINE void Apply(F f) noexcept { Apply(f, Indices()); }
 
-    Vec3(const Vec3& vec)
-        : x(vec.x), y(vec.y), z(vec.vec3)
-    {
-    }
 
     //////////////// Basic methods
 
-    ldouble Magnitude() const
+    VECTOR_INLINE T Magnitude() const noexcept
     {
-        if(!can_multiply<T, T>)
-            throw "Error, impossible multiplication\n";
-        if(!can_add<multiplication_type<T, T>, multiplication_type<T, T>>)
-            throw "Error, impossible addition\n";
-
-        return sqrt(x*x + y*y + z*z);
+        return sqrt(Magnitude_squared());
     }
 
-    ldouble Magnitude_squared() const
+    VECTOR_INLINE T Magnitude_squared() const noexcept
     {
-        if(!can_multiply<T, T>)
-            throw "Error, impossible multiplication\n";
-        if(!can_add<multiplication_type<T, T>, multiplication_type<T, T>>)
-            throw "Error, impossible addition\n";
+        static_assert(can_multiply<T, T>, "Error, impossible multiplication");
+        static_assert(can_add<multiplication_type<T, T>, multiplication_type<T, T>>, "Error, impossible addition");
 
-        return x*x + y*y + z*z;
+        return Sum([](const T& c) { return c * c; }, Indices());
     }
 
 
-    Vec3 Normalised() const
+    /// @brief the null vector stays null
+    VECTOR_INLINE VecN Normalised() const noexcept
     {
-        ldouble magnitude = Magnitude();
-        if(magnitude == 0)
-        {
-            return *this;
-        }
-
-        if(!can_divide<T, ldouble>)
-            throw "Error, impossible division\n";
+        static_assert(can_divide<T, T>, "Error, impossible division");
 
-        return Vec3(x/magnitude, y/magnitude, z/magnitude);
+        // 1 for the null vector, without a branch : a comparison mask rather than a jump
+        const T magnitude = Magnitude();
+        const T divisor = magnitude + T(magnitude == 0);
+        return Map([divisor](const T& c) { return c / divisor; });
     }
 
-    Vec3 Normalise() const
+    VECTOR_INLINE VecN& Normalise() noexcept
     {
-        ldouble magnitude = Magnitude();
-        if(magnitude == 0)
-        {
-            return *this;
-        }
-
-        if(!can_divide_equal<T, ldouble>)
-            throw "Error, impossible division\n";
-
-        x /= magnitude;
-        y /= magnitude;
-        z /= magnitude;
-        
+        *this = Normalised();
         return *this;
     }
 
-
-    /////////// add operators
-
-    template <typename Ty>
-    Vec3<addition_type<T, Ty>> operator+(const Vec3<Ty>& other) const
+    VECTOR_INLINE VecN ortho() const noexcept
     {
-        if(!can_add<T, Ty>)
-        {
-            throw "Error, impossible addition\n";
-        }
-
-        return Vec3<addition_type<T, Ty>>(x + other.x, y + other.y, z + other.z);
-    }
-
-    void operator+=(const Vec3& other) {
-        if(!can_add_equal<T, T>)
-        {
-            throw "Error, impossible addition\n";
-        }
-        x += other.x;
-        y += other.y;
-        z += other.z;
+        static_assert(N == 2, "ortho is the vector turned by 90° in the plane");
+        return VecN(-this->y, this->x);
     }
 
 
 
-    /////////// substract operator
+    /////////// add / substract operators
 
-    template <typename Ty>
-    Vec3<substraction_type<T, Ty>> operator-(const Vec3<Ty>& other) const
+    VECTOR_INLINE VecN& operator+=(const VecN& other) noexcept
     {
-        if(!can_substract<T, Ty>)
-        {
-            throw "Error, impossible substraction\n";
-        }
-        return Vec3<substraction_type<T, Ty>>(x - other.x, y - other.y, z - other.z);
+        static_assert(can_add_equal<T&, T>, "Error, impossible addition");
+
+        return ApplyWith(other, [](T& c, const T& o) { c += o; });
     }
 
-    void operator-=(const Vec3& other) {
-        if(!can_substract_equal<T, T>)
-        {
-            throw "Error, impossible substraction\n";
-        }
+    VECTOR_INLINE VecN& operator-=(const VecN& other) noexcept
+    {
+        static_assert(can_substract_equal<T&, T>, "Error, impossible substraction");
 
-        x -= other.x;
-        y -= other.y;
-        z -= other.z;
+        return ApplyWith(other, [](T& c, const T& o) { c -= o; });
     }
 
 
 
     /////////// scalar multiplication
 
-    Vec3<multiplication_type<T, ldouble>> operator*(ldouble f) const
+    VECTOR_INLINE VecN<multiplication_type<T, T>, N> operator*(T f) const noexcept
     {
-        if(!can_multiply<ldouble, T>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
-
-        return Vec3<multiplication_type<T, ldouble>>(x * f, y * f, z * f);
+        return Map([f](const T& c) { return c * f; });
     }
 
-    void operator*=(ldouble f)
+    VECTOR_INLINE VecN& operator*=(T f) noexcept
     {
-        if(!can_multiply_equal<T, ldouble>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
+        static_assert(can_multiply_equal<T&, T>, "Error, impossible multiplication");
 
-        x *= f;
-        y *= f;
-        z *= f;
+        Apply([f](T& c) { c *= f; });
+        return *this;
     }
 
     /////////// vector-vector multiplication (component-wise)
 
-    template <typename Ty>
-    Vec3<multiplication_type<T, Ty>> operator*(const Vec3<Ty>& other) const
-    {
-        if(!can_multiply<T, Ty>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
-        return Vec3<multiplication_type<T, Ty>>(x * other.x, y * other.y, z * other.z);
-    }
-
     template<typename Ty>
-    void operator*=(const Vec3<Ty>& v)
+    VECTOR_INLINE VecN& operator*=(const VecN<Ty, N>& v) noexcept
     {
-        if(!can_multiply_equal<T, Ty>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
+        static_assert(can_multiply_equal<T&, Ty>, "Error, impossible multiplication");
 
-        x *= v.x;
-        y *= v.y;
-        z *= v.z;
+        return ApplyWith(v, [](T& c, const Ty& o) { c *= o; });
     }
 
 
 
     /////////// scalar division
 
-    Vec3<division_type<T, ldouble>> operator/(ldouble f) const
+    VECTOR_INLINE VecN<division_type<T, T>, N> operator/(T f) const noexcept(!VectorCheckDivision)
     {
-        if(!can_divide<T, ldouble>)
-        {
-            throw "Error, impossible division\n";
-        }
-
-        if(f == 0)
-        {
-            throw "Division by zero\n";
-        }
+        checkDivisors(f);
 
-        return Vec3<division_type<T, ldouble>>(x / f, y / f, z / f);
+        return Map([f](const T& c) { return c / f; });
     }
 
-    void operator/=(ldouble f)
+    VECTOR_INLINE VecN& operator/=(T f) noexcept(!VectorCheckDivision)
     {
-        if(!can_divide<T, ldouble>)
-        {
-            throw "Error, impossible division\n";
-        }
-
-        if(f == 0)
-        {
-            throw "Division by zero\n";
-        }
+        static_assert(can_divide_equal<T&, T>, "Error, impossible division");
+        checkDivisors(f);
 
-        x /= f;
-        y /= f;
-        z /= f;
+        Apply([f](T& c) { c /= f; });
+        return *this;
     }
 
     /////////// vector-vector division (component-wise)
 
-    template <typename Ty>
-    Vec3<division_type<T, Ty>> operator*(const Vec3<Ty>& other) const
-    {
-        if(!can_divide<T, Ty>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
-
-        if(other.x == 0 || other.y == 0)
-        {
-            throw "Division by zero\n";
-        }
-
-        return Vec3<division_type<T, Ty>>(x / other.x, y / other.y, z / other.z);
-    }
-
     template<typename Ty>
-    void operator/=(const Vec3<Ty>& v)
+    VECTOR_INLINE VecN& operator/=(const VecN<Ty, N>& v) noexcept(!VectorCheckDivision)
     {
-        if(!can_multiply<T, Ty>)
-        {
-            throw "Error, impossible multiplication\n";
-        }
+        static_assert(can_divide_equal<T&, Ty>, "Error, impossible division");
+        v.CheckDivisors(Indices());
 
-        if(v.x == 0 || v.y == 0)
-        {
-            throw "Division by zero\n";
-        }
-
-        x /= v.x;
-        y /= v.y;
-        z /= v.z;
+        return ApplyWith(v, [](T& c, const Ty& o) { c /= o; });
     }
-};
-
-
-
-
-
-
-
-
-
 
 
-/////// Vector 2
+    ////// Expansion over the components
 
-// additions
-
-template<typename Lhs, typename Rhs>
-Vec2<addition_type<Lhs, Rhs>> operator+(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
-{
-    if(!can_add<Lhs, Rhs>)
+    template<int... I>
+    static VECTOR_INLINE VecN Filled(const T& value, std::integer_sequence<int, I...>) noexcept
     {
-        throw "Error, impossible addition\n";
+        return VecN((static_cast<void>(I), value)...);
     }
 
-    return Vec2<addition_type<Lhs, Rhs>>(v1.x + v2.x, v1.y + v2.y);
-}
-
-
-
-
-// substraction
-
-template<typename Lhs, typename Rhs>
-Vec2<substraction_type<Lhs, Rhs>> operator-(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
-{
-    if(!can_substract<Lhs, Rhs>)
+    template<typename F, int... I>
+    VECTOR_INLINE auto Map(F f, std::integer_sequence<int, I...>) const noexcept
     {
-        throw "Error, impossible addition\n";
+        return VecN<decltype(f(this->template Component<0>())), N>(f(this->template Component<I>())...);
     }
 
-    return Vec2<substraction_type<Lhs, Rhs>>(v1.x - v2.x, v1.y - v2.y);
-}
-
-
-
-// multiplications
-
-template <typename T>
-Vec2<division_type<ldouble, T>> operator*(ldouble f, const Vec2<T>& v)
-{
-    if(!can_multiply<ldouble, T>)
+    template<typename F, int... I>
+    VECTOR_INLINE void Apply(F f, std::integer_sequence<int, I...>) noexcept
     {
-        throw "Error, impossible multiplication\n";
+        (f(this->template Component<I>()), ...);
     }
 
-    return Vec2<division_type<ldouble, T>>(f * v.x, f * v.y);
-}
-
-template<typename Lhs, typename Rhs>
-Vec2<division_type<Lhs, Rhs>> operator*(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
-{
-    if(!can_multiply<Lhs, Rhs>)
+    /// @brief f(c0) + f(c1) + ..., added from the first component as x*x + y*y + z*z
+    template<typename F, int... I>
+    VECTOR_INLINE auto Sum(F f, std::integer_sequence<int, I...>) const noexcept
     {
-        throw "Error, impossible multiplication\n";
+        return (... + f(this->template Component<I>()));
     }
 
-    return Vec2<division_type<Lhs, Rhs>>(v1.x * v2.x, v1.y * v2.y);
-}
-
-
-
-// divisions
-
-template<typename Lhs, typename Rhs>
-Vec2<division_type<Lhs, Rhs>> operator/(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
-{
-    if(!can_divide<Lhs, Rhs>)
+    template<typename Ty, typename F>
+    VECTOR_INLINE VecN& ApplyWith(const VecN<Ty, N>& other, F f) noexcept
     {
-        throw "Error, impossible division\n";
+        ApplyWith(other, f, Indices());
+        return *this;
     }
 
-    if (v2.x == 0 || v2.y == 0)
+    template<typename Ty, typename F, int... I>
+    VECTOR_INLINE void ApplyWith(const VecN<Ty, N>& other, F f, std::integer_sequence<int, I...>) noexcept
     {
-        throw "Division by zero\n";
+        (f(this->template Component<I>(), other.template Component<I>()), ...);
     }
 
-    return Vec2<division_type<Lhs, Rhs>>(v1.x / v2.x, v1.y / v2.y);
-}
-
+    template<int... I>
+    VECTOR_INLINE void CheckDivisors(std::integer_sequence<int, I...>) const noexcept(!VectorCheckDivision)
+    {
+        checkDivisors(this->template Component<I>()...);
+    }
+};
 
-// print operator Vec2
-template<typename Ty>
-std::ostream& operator<<(std::ostream& os, const Vec2<Ty>& obj) {
-    os << "(" << obj.x << ", " << obj.y << ")";
-    return os;
-}
 
-/////// dot product
 
-template<typename Lhs, typename Rhs>
-ldouble dot(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
+/// @brief vector of the f(v1 component I, v2 component I) for every I
+template<typename Lhs, typename Rhs, int N, typename F, int... I>
+VECTOR_INLINE auto zipComponents(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2, F f, std::integer_sequence<int, I...>) noexcept
 {
-    if(!can_multiply<Lhs, Rhs>)
-        throw "Error, impossible multiplication\n";
-    if(!can_add<multiplication_type<Lhs, Rhs>, multiplication_type<Lhs, Rhs>>)
-        throw "Error, Impossible addition\n";
-
-    return v1.x * v2.x + v1.y * v2.y;
+    using Result = decltype(f(v1.template Component<0>(), v2.template Component<0>()));
+    return VecN<Result, N>(f(v1.template Component<I>(), v2.template Component<I>())...);
 }
 
-
-/////// distance between 2 vector
-
-template<typename Lhs, typename Rhs>
-ldouble dist(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
+template<typename Lhs, typename Rhs, int N, typename F>
+VECTOR_INLINE auto zipComponents(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2, F f) noexcept
 {
-    const Vec2<substraction_type<Lhs, Rhs>> deplacement_vector =  v2 - v1;
-
-    return deplacement_vector.Magnitude();
-}
-
-template<typename Lhs, typename Rhs>
-ldouble dist_square(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
-{
-    const Vec2<substraction_type<Lhs, Rhs>> deplacement_vector =  v2 - v1;
-
-    return dot(deplacement_vector, deplacement_vector);
+    return zipComponents(v1, v2, f, std::make_integer_sequence<int, N>());
 }
 
 
@@ -905,123 +457,117 @@ ldouble dist_square(const Vec2<Lhs>& v1, const Vec2<Rhs>& v2)
 
 
 
+//////////////////////////////////////////////////////////////
+//////////////////   Free functions   ////////////////////////
+//////////////////////////////////////////////////////////////
 
+// The operations between two vectors are only free functions : with a member operator as well,
+// v1 + v2 would be ambiguous. The impossible ones (Vec2<std::string> * Vec2<int> ...) are removed
+// from the overloads by their return type, so they do not compile.
 
 
-//////// Vector 3
-
 // additions
 
-template<typename Lhs, typename Rhs>
-Vec3<addition_type<Lhs, Rhs>> operator+(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2)
+template<typename Lhs, typename Rhs, int N>
+VECTOR_INLINE VecN<addition_type<Lhs, Rhs>, N> operator+(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2) noexcept
 {
-    if(!can_add<Lhs, Rhs>)
-    {
-        throw "Error, impossible addition\n";
-    }
-
-    return Vec3<addition_type<Lhs, Rhs>>(v1.x + v2.x, v1.y + v2.y, v1.z + v2.z);
+    return zipComponents(v1, v2, [](const Lhs& a, const Rhs& b) { return a + b; });
 }
 
 
-
-
 // substraction
 
-template<typename Lhs, typename Rhs>
-Vec3<substraction_type<Lhs, Rhs>> operator-(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2)
+template<typename Lhs, typename Rhs, int N>
+VECTOR_INLINE VecN<substraction_type<Lhs, Rhs>, N> operator-(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2) noexcept
 {
-    if(!can_substract<Lhs, Rhs>)
-    {
-        throw "Error, impossible addition\n";
-    }
-
-    return Vec3<substraction_type<Lhs, Rhs>>(v1.x - v2.x, v1.y - v2.y, v1.z - v2.z);
+    return zipComponents(v1, v2, [](const Lhs& a, const Rhs& b) { return a - b; });
 }
 
 
-
 // multiplications
 
-template <typename T>
-Vec3<division_type<ldouble, T>> operator*(ldouble f, const Vec3<T>& v)
+template <typename T, int N>
+VECTOR_INLINE VecN<multiplication_type<T, T>, N> operator*(nondeduced_t<T> f, const VecN<T, N>& v) noexcept
 {
-    if(!can_multiply<ldouble, T>)
-    {
-        throw "Error, impossible multiplication\n";
-    }
-
-    return Vec3<division_type<ldouble, T>>(f * v.x, f * v.y, f * v.z);
+    return v.Map([f](const T& c) { return f * c; });
 }
 
-template<typename Lhs, typename Rhs>
-Vec3<division_type<Lhs, Rhs>> operator*(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2)
+template<typename Lhs, typename Rhs, int N>
+VECTOR_INLINE VecN<multiplication_type<Lhs, Rhs>, N> operator*(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2) noexcept
 {
-    if(!can_multiply<Lhs, Rhs>)
-    {
-        throw "Error, impossible multiplication\n";
-    }
-
-    return Vec3<division_type<Lhs, Rhs>>(v1.x * v2.x, v1.y * v2.y, v1.z * v2.z);
+    return zipComponents(v1, v2, [](const Lhs& a, const Rhs& b) { return a * b; });
 }
 
 
-
 // divisions
 
-template<typename Lhs, typename Rhs>
-Vec3<division_type<Lhs, Rhs>> operator/(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2)
+template<typename Lhs, typename Rhs, int N>
+VECTOR_INLINE VecN<division_type<Lhs, Rhs>, N> operator/(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2) noexcept(!VectorCheckDivision)
 {
-    if(!can_divide<Lhs, Rhs>)
-    {
-        throw "Error, impossible division\n";
-    }
-
-    if (v2.x == 0 || v2.y == 0 || v2.z == 0)
-    {
-        throw "Division by zero\n";
-    }
+    v2.CheckDivisors(std::make_integer_sequence<int, N>());
 
-    return Vec3<division_type<Lhs, Rhs>>(v1.x / v2.x, v1.y / v2.y, v1.z / v2.z);
+    return zipComponents(v1, v2, [](const Lhs& a, const Rhs& b) { return a / b; });
 }
 
 
-// print operator Vec3
-template<typename Ty>
-std::ostream& operator<<(std::ostream& os, const Vec3<Ty>& obj) {
-    os << "(" << obj.x << ", " << obj.y << ", " << obj.z << ")";
+// print operator, "(x, y)" or "(x, y, z)"
+template<typename Ty, int N>
+std::ostream& operator<<(std::ostream& os, const VecN<Ty, N>& obj) {
+    os << "(";
+    for(int d = 0; d < N; d++)
+        os << (d == 0 ? "" : ", ") << obj[d];
+    os << ")";
     return os;
 }
 
 
 /////// dot product
 
-template<typename Lhs, typename Rhs>
-ldouble dot(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2)
+template<typename Lhs, typename Rhs, int N>
+VECTOR_INLINE multiplication_type<Lhs, Rhs> dot(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2) noexcept
 {
-    if(!can_multiply<Lhs, Rhs>)
-        throw "Error, impossible multiplication\n";
-    if(!can_add<multiplication_type<Lhs, Rhs>, multiplication_type<Lhs, Rhs>>)
-        throw "Error, Impossible addition\n";
+    static_assert(can_add<multiplication_type<Lhs, Rhs>, multiplication_type<Lhs, Rhs>>, "Error, Impossible addition");
 
-    return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+    const VecN<multiplication_type<Lhs, Rhs>, N> products = v1 * v2;
+    return products.Sum([](const multiplication_type<Lhs, Rhs>& p) { return p; }, std::make_integer_sequence<int, N>());
 }
 
 
-/////// distance between 2 vector
+/////// cross product
 
 template<typename Lhs, typename Rhs>
-ldouble dist(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2)
+VECTOR_INLINE Vec3<multiplication_type<Lhs, Rhs>> cross(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2) noexcept
 {
-    const Vec3<substraction_type<Lhs, Rhs>> deplacement_vector =  v2 - v1;
+    return Vec3<multiplication_type<Lhs, Rhs>>(v1.y * v2.z - v1.z * v2.y,
+                                              v1.z * v2.x - v1.x * v2.z,
+                                              v1.x * v2.y - v1.y * v2.x);
+}
+
+
+/////// distance between 2 vector
+
+template<typename Lhs, typename Rhs, int N>
+VECTOR_INLINE multiplication_type<Lhs, Rhs> dist(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2) noexcept
+{
+    const VecN<substraction_type<Lhs, Rhs>, N> deplacement_vector =  v2 - v1;
 
     return deplacement_vector.Magnitude();
 }
 
-template<typename Lhs, typename Rhs>
-ldouble dist_square(const Vec3<Lhs>& v1, const Vec3<Rhs>& v2)
+template<typename Lhs, typename Rhs, int N>
+VECTOR_INLINE multiplication_type<Lhs, Rhs> dist_square(const VecN<Lhs, N>& v1, const VecN<Rhs, N>& v2) noexcept
 {
-    const Vec3<substraction_type<Lhs, Rhs>> deplacement_vector = v2 - v1;
+    const VecN<substraction_type<Lhs, Rhs>, N> deplacement_vector =  v2 - v1;
 
     return dot(deplacement_vector, deplacement_vector);
-}
\ No newline at end of file
+}
+
+#undef VECTOR_INLINE
+
+
+
+static_assert(std::is_trivially_copyable<Vec2<double>>::value && std::is_trivially_copyable<Vec3<double>>::value,
+              "the vectors must stay trivially copyable to be passed in registers");
+static_assert(dot(Vec2<int>(1, 2) + Vec2<int>(3, 4), Vec2<int>(2, 1) * 2) == 28, "the vector operations must be usable at compile time");
+static_assert(dist_square(VecN<int, 4>(1, 2, 3, 4), VecN<int, 4>(2, 2, 2, 2)) == 6, "the vector operations must be usable at compile time");
+static_assert(cross(Vec3<int>(1, 0, 0), Vec3<int>(0, 1, 0)).z == 1, "the vector operations must be usable at compile time");
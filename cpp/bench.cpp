@@ -0,0 +1,1071 @@
+#define TESTS
+#include "rk4.cpp"
+
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <iomanip>
+#include <random>
+
+
+
+////////// Helpers
+
+/// @brief run the function `repetitions` times and return the best time in seconds
+template<typename Function>
+double bestTime(int repetitions, Function&& function)
+{
+    double best = 1e300;
+    for(int r = 0; r < repetitions; r++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const auto end = std::chrono::steady_clock::now();
+
+        best = std::min(best, std::chrono::duration<double>(end - start).count());
+    }
+    return best;
+}
+
+/// @brief bodies spread on a square (a cube in 3D) of one astronomical unit, with random velocities
+template<typename T, int D = 2>
+Bodies<T, D> randomBodies(size_t nbBodies)
+{
+    std::mt19937_64 generator(42);
+    std::uniform_real_distribution<double> position(-1.5e11, 1.5e11);
+    std::uniform_real_distribution<double> velocity(-3e4, 3e4);
+    std::uniform_real_distribution<double> mass(1e22, 1e25);
+
+    Bodies<T, D> bodies;
+    bodies.Reserve(nbBodies);
+    for(size_t i = 0; i < nbBodies; i++)
+    {
+        const T m = mass(generator);
+        if constexpr(D == 3)
+        {
+            const T x = position(generator), y = position(generator), z = position(generator);
+            const T vx = velocity(generator), vy = velocity(generator), vz = velocity(generator);
+            bodies.AddBody(m, Vec3<T>(x, y, z), Vec3<T>(vx, vy, vz));
+        }
+        else
+        {
+            const T x = position(generator), y = position(generator);
+            const T vx = velocity(generator), vy = velocity(generator);
+            bodies.AddBody(m, Vec2<T>(x, y), Vec2<T>(vx, vy));
+        }
+    }
+    return bodies;
+}
+
+/// @brief inner planets of the solar system (same as bodies_example.txt)
+template<typename T>
+Bodies<T> innerSolarSystem()
+{
+    Bodies<T> bodies;
+    bodies.AddBody(1.9891e30, Vec2<T>(0, 0),         Vec2<T>(0, 0));
+    bodies.AddBody(3.3011e23, Vec2<T>(57.9e9, 0),    Vec2<T>(0, 47.36e3));
+    bodies.AddBody(4.8675e24, Vec2<T>(108.2e9, 0),   Vec2<T>(0, 35.02e3));
+    bodies.AddBody(5.9722e24, Vec2<T>(149.6e9, 0),   Vec2<T>(0, 29.78e3));
+    bodies.AddBody(6.4171e23, Vec2<T>(227.9e9, 0),   Vec2<T>(0, 24.07e3));
+    return bodies;
+}
+
+/// @brief gravityRows on every body
+template<typename T, int D>
+void gravityRowsOf(SimdLevel level, Bodies<T, D>& bodies)
+{
+    const T* pos[D];
+    T* acc[D];
+    for(int d = 0; d < D; d++)
+    {
+        pos[d] = bodies.pos[d].data();
+        acc[d] = bodies.acc[d].data();
+    }
+    gravityRows(level, pos, bodies.mass.data(), bodies.Size(), G<T>, T(0), 0, bodies.Size(), acc);
+}
+
+/// @brief kinetic + potential energy, computed in R whatever the precision of the bodies
+template<typename R, typename T>
+R totalEnergy(const Bodies<T>& bodies)
+{
+    R energy = 0;
+    for(size_t i = 0; i < bodies.Size(); i++)
+    {
+        const R vx = bodies.vel[0][i], vy = bodies.vel[1][i];
+        energy += R(0.5) * R(bodies.mass[i]) * (vx*vx + vy*vy);
+
+        for(size_t j = i + 1; j < bodies.Size(); j++)
+        {
+            const R dx = R(bodies.pos[0][j]) - R(bodies.pos[0][i]);
+            const R dy = R(bodies.pos[1][j]) - R(bodies.pos[1][i]);
+            energy -= G<R> * R(bodies.mass[i]) * R(bodies.mass[j]) / sqrt(dx*dx + dy*dy);
+        }
+    }
+    return energy;
+}
+
+
+/// @brief rms relative error of the accelerations against a reference computation
+template<typename T, typename R>
+double accelerationError(const Bodies<T>& bodies, const Bodies<R>& reference)
+{
+    double error = 0;
+    for(size_t i = 0; i < bodies.Size(); i++)
+    {
+        const double rx = double(reference.acc[0][i]), ry = double(reference.acc[1][i]);
+        const double dx = double(bodies.acc[0][i]) - rx;
+        const double dy = double(bodies.acc[1][i]) - ry;
+        error += (dx*dx + dy*dy) / (rx*rx + ry*ry);
+    }
+    return std::sqrt(error / bodies.Size());
+}
+
+
+
+////////// Benchmarks
+
+/// @brief compare the structure of arrays Bodies with a vector of Object
+///
+/// The force loop is measured on the first `nbTargets` bodies against all the others, so the
+/// whole array is streamed through for every target without the O(N²) cost of 100k bodies.
+void benchLayouts()
+{
+    std::cout << "\n=== Bodies layout : Object (AoS) vs Bodies (SoA) ===\n";
+    std::cout << std::setw(10) << "bodies"
+              << std::setw(22) << "Object ns/interaction" << std::setw(22) << "SoA ns/interaction"
+              << std::setw(18) << "Object ns/update" << std::setw(18) << "SoA ns/update" << "\n";
+
+    constexpr size_t nbTargets = 64;
+    constexpr int nbSteps = 4;
+    constexpr ldouble dt = 100;
+
+    for(size_t nbBodies : {1000, 10000, 100000})
+    {
+        const Bodies<ldouble> reference = randomBodies<ldouble>(nbBodies);
+
+        // current layout : one Object per body, each holding its own vectors of Vec2<ldouble>
+        std::vector<Object<ldouble>> objects;
+        objects.reserve(nbBodies);
+        for(size_t i = 0; i < nbBodies; i++)
+            objects.emplace_back(reference.mass[i], reference.GetPosition(i), reference.GetVelocity(i), nbSteps + 1);
+
+        ldouble sink = 0;
+        const double object_force = bestTime(3, [&]() {
+            for(size_t i = 0; i < nbTargets; i++)
+            {
+                Vec2<ldouble> force(0, 0);
+                for(size_t j = 0; j < nbBodies; j++)
+                {
+                    if(i != j)
+                        force += AttractionForce(objects[j], objects[i]);
+                }
+                sink += force.x;
+            }
+        });
+
+        const double object_update = bestTime(1, [&]() {
+            for(int s = 0; s < nbSteps; s++)
+            {
+                for(Object<ldouble>& object : objects)
+                {
+                    const Vec2<ldouble> velocity = object.GetCurrentVelocity();
+                    object.Update_state(object.GetCurrentPosition() + velocity * dt, velocity);
+                }
+            }
+        });
+
+        // structure of arrays
+        Bodies<ldouble> bodies = reference;
+        const double soa_force = bestTime(3, [&]() {
+            const ldouble* x = bodies.pos[0].data();
+            const ldouble* y = bodies.pos[1].data();
+            const ldouble* m = bodies.mass.data();
+            for(size_t i = 0; i < nbTargets; i++)
+            {
+                ldouble ax = 0;
+                for(size_t j = 0; j < nbBodies; j++)
+                {
+                    const ldouble dx = x[j] - x[i];
+                    const ldouble dy = y[j] - y[i];
+                    const ldouble distance_squared = dx*dx + dy*dy + 1;
+                    ax += G<ldouble> * m[j] * dx / (distance_squared * std::sqrt(distance_squared));
+                }
+                sink += ax;
+            }
+        });
+
+        const double soa_update = bestTime(1, [&]() {
+            for(int s = 0; s < nbSteps; s++)
+            {
+                for(int d = 0; d < Bodies<ldouble>::Dim; d++)
+                {
+                    ldouble* p = bodies.pos[d].data();
+                    const ldouble* v = bodies.vel[d].data();
+                    for(size_t i = 0; i < nbBodies; i++)
+                        p[i] += v[i] * dt;
+                }
+            }
+        });
+
+        const double interactions = double(nbTargets) * nbBodies;
+        const double updates = double(nbSteps) * nbBodies;
+        std::cout << std::setw(10) << nbBodies
+                  << std::setw(22) << object_force / interactions * 1e9 << std::setw(22) << soa_force / interactions * 1e9
+                  << std::setw(18) << object_update / updates * 1e9 << std::setw(18) << soa_update / updates * 1e9
+                  << (sink == 42 ? " " : "") << "\n";
+    }
+}
+
+
+/// @brief speed and energy drift of the N-body simulation for one scalar type
+template<typename T>
+void benchPrecisionFor()
+{
+    constexpr int nbSteps = 24 * 365 * 10;     // ten years
+    const T dt = 3600;
+
+    Bodies<T> bodies = innerSolarSystem<T>();
+    const ldouble initial_energy = totalEnergy<ldouble>(bodies);
+
+    Integrator<T> integrator(IntegratorType::Verlet);
+    const auto force = [](Bodies<T>& state) { ComputeAccelerations(state); };
+
+    const double time = bestTime(1, [&]() {
+        for(int s = 0; s < nbSteps; s++)
+            integrator.Step(bodies, dt, force);
+    });
+
+    const ldouble drift = abs((totalEnergy<ldouble>(bodies) - initial_energy) / initial_energy);
+    std::cout << std::setw(10) << scalarName<T>()
+              << std::setw(16) << nbSteps / time
+              << std::setw(20) << static_cast<double>(drift) << "\n";
+}
+
+/// @brief trade-off between speed and energy conservation for each scalar type
+void benchPrecision()
+{
+    std::cout << "\n=== Precision : 5 bodies, 10 years, dt = 1 h ===\n";
+    std::cout << std::setw(10) << "scalar" << std::setw(16) << "steps/s" << std::setw(20) << "energy drift" << "\n";
+
+    benchPrecisionFor<float>();
+    benchPrecisionFor<double>();
+    benchPrecisionFor<ldouble>();
+#ifdef USE_QUAD
+    benchPrecisionFor<quad>();
+#endif
+}
+
+
+/// @brief energy drift and run time of each integrator for growing timesteps
+void benchIntegrators()
+{
+    std::cout << "\n=== Integrators : 5 bodies, 10 years, double ===\n";
+    std::cout << std::setw(10) << "scheme" << std::setw(10) << "dt (h)" << std::setw(14) << "time (ms)" << std::setw(20) << "energy drift" << "\n";
+
+    const double duration = 10 * 365 * 24 * 3600.;
+    const auto force = [](Bodies<double>& state) { ComputeAccelerations(state); };
+
+    for(IntegratorType type : { IntegratorType::Euler, IntegratorType::Verlet, IntegratorType::RK4, IntegratorType::Yoshida4 })
+    {
+        for(double hours : { 1, 6, 24, 96 })
+        {
+            const double dt = hours * 3600;
+            const int nbSteps = duration / dt;
+
+            Bodies<double> bodies = innerSolarSystem<double>();
+            const ldouble initial_energy = totalEnergy<ldouble>(bodies);
+            Integrator<double> integrator(type);
+
+            const double time = bestTime(1, [&]() {
+                for(int s = 0; s < nbSteps; s++)
+                    integrator.Step(bodies, dt, force);
+            });
+
+            const ldouble drift = abs((totalEnergy<ldouble>(bodies) - initial_energy) / initial_energy);
+            std::cout << std::setw(10) << integratorName(type) << std::setw(10) << hours
+                      << std::setw(14) << time * 1e3 << std::setw(20) << static_cast<double>(drift) << "\n";
+        }
+    }
+}
+
+
+/// @brief time of one force evaluation and error of the quadtree against the direct summation
+void benchBarnesHut()
+{
+    std::cout << "\n=== Barnes-Hut vs direct summation, double ===\n";
+    std::cout << std::setw(10) << "bodies" << std::setw(14) << "direct (ms)";
+    for(const char* theta : { "0.3", "0.5", "0.8" })
+        std::cout << std::setw(16) << "theta " + std::string(theta) + " (ms)" << std::setw(12) << "rms error";
+    std::cout << "\n";
+
+    for(size_t nbBodies : { 256, 1024, 4096, 16384, 32768 })
+    {
+        Bodies<double> direct = randomBodies<double>(nbBodies);
+        const double direct_time = bestTime(nbBodies > 4096 ? 1 : 3, [&]() { ComputeAccelerations(direct); });
+        std::cout << std::setw(10) << nbBodies << std::setw(14) << direct_time * 1e3;
+
+        for(double theta : { 0.3, 0.5, 0.8 })
+        {
+            Bodies<double> bodies = direct;
+            QuadTree<double> tree(theta);
+            const double tree_time = bestTime(3, [&]() { tree.ComputeAccelerations(bodies); });
+
+            // relative error of the acceleration of each body
+            double error = 0;
+            for(size_t i = 0; i < nbBodies; i++)
+            {
+                const double dx = bodies.acc[0][i] - direct.acc[0][i];
+                const double dy = bodies.acc[1][i] - direct.acc[1][i];
+                const double norm = direct.acc[0][i] * direct.acc[0][i] + direct.acc[1][i] * direct.acc[1][i];
+                error += (dx*dx + dy*dy) / norm;
+            }
+            error = std::sqrt(error / nbBodies);
+
+            std::cout << std::setw(16) << tree_time * 1e3 << std::setw(12) << error;
+        }
+        std::cout << "\n";
+    }
+}
+
+
+/// @brief speed-up of the force evaluation from 1 thread to every core
+void benchThreads()
+{
+    const size_t nbCores = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "\n=== Thread scaling, double, " << nbCores << " cores ===\n";
+    std::cout << std::setw(10) << "threads"
+              << std::setw(22) << "direct 8192 (ms)" << std::setw(12) << "efficiency"
+              << std::setw(22) << "barneshut 65536 (ms)" << std::setw(12) << "efficiency" << "\n";
+
+    Bodies<double> direct_bodies = randomBodies<double>(8192);
+    Bodies<double> tree_bodies = randomBodies<double>(65536);
+    double direct_reference = 0, tree_reference = 0;
+
+    // 1, 2, 4, ... and every core
+    std::vector<size_t> thread_counts;
+    for(size_t nbThreads = 1; nbThreads < nbCores; nbThreads *= 2)
+        thread_counts.push_back(nbThreads);
+    thread_counts.push_back(nbCores);
+
+    for(size_t nbThreads : thread_counts)
+    {
+        ThreadPool pool(nbThreads);
+        ParallelDirectForce<double> direct(pool);
+        QuadTree<double> tree(0.5);
+
+        const double direct_time = bestTime(3, [&]() { direct(direct_bodies); });
+        const double tree_time = bestTime(3, [&]() { tree.ComputeAccelerations(tree_bodies, &pool); });
+
+        if(nbThreads == 1)
+        {
+            direct_reference = direct_time;
+            tree_reference = tree_time;
+        }
+
+        std::cout << std::setw(10) << nbThreads
+                  << std::setw(22) << direct_time * 1e3 << std::setw(12) << direct_reference / (direct_time * nbThreads)
+                  << std::setw(22) << tree_time * 1e3 << std::setw(12) << tree_reference / (tree_time * nbThreads) << "\n";
+    }
+}
+
+
+/// @brief accelerations of the bodies with AttractionForce, every pair computed twice
+///
+/// Not inlined, so its code can be looked at with objdump. The Vec2 operations have no check left
+/// at run time (division by zero is only checked with -DVECTOR_CHECK_DIVISION) : AttractionForce
+/// is inlined in the loops over j, and with -O3 -fno-math-errno they are vectorised two pairs at
+/// a time without any jump but the loop itself (the null vector of Normalised is a compare mask).
+template<typename T>
+__attribute__((noinline)) void attractionForceRows(Bodies<T>& bodies)
+{
+    const size_t n = bodies.Size();
+    for(size_t i = 0; i < n; i++)
+    {
+        const Vec2<T> position = bodies.GetPosition(i);
+        const T mass = bodies.mass[i];
+        Vec2<T> acceleration(0, 0);
+
+        // j != i without a test in the loop
+        for(size_t j = 0; j < i; j++)
+            acceleration += AttractionForce(bodies.mass[j], bodies.GetPosition(j), mass, position) / mass;
+        for(size_t j = i + 1; j < n; j++)
+            acceleration += AttractionForce(bodies.mass[j], bodies.GetPosition(j), mass, position) / mass;
+
+        bodies.acc[0][i] = acceleration.x;
+        bodies.acc[1][i] = acceleration.y;
+    }
+}
+
+/// @brief cost of one body-body interaction for each way of computing the direct summation
+///
+/// Every kernel is timed on the same bodies, single thread, and its error is measured against
+/// the pairs kernel in long double. The time is divided by N(N-1), the number of interactions
+/// actually needed, whether the kernel uses the third law or not.
+template<typename T>
+void benchKernelRow(const char* name, size_t nbBodies, const Bodies<ldouble>& reference, const std::function<void(Bodies<T>&)>& force)
+{
+    Bodies<T> bodies = randomBodies<T>(nbBodies);
+    const double time = bestTime(3, [&]() { force(bodies); });
+    const double interactions = double(nbBodies) * double(nbBodies - 1);
+
+    std::cout << std::setw(34) << name << std::setw(16) << time / interactions * 1e9
+              << std::setw(14) << accelerationError(bodies, reference) << "\n";
+}
+
+void benchSimdKernel()
+{
+    const size_t nbBodies = 4096;
+    const SimdLevel level = detectSimdLevel();
+
+    std::cout << "\n=== Direct summation kernels, " << nbBodies << " bodies, best SIMD : " << simdLevelName(level) << " ===\n";
+    std::cout << std::setw(34) << "kernel" << std::setw(16) << "ns/interaction" << std::setw(14) << "rms error" << "\n";
+
+    Bodies<ldouble> reference = randomBodies<ldouble>(nbBodies);
+    ComputeAccelerations(reference);
+
+    // the original per-object force, Vec2 operations
+    benchKernelRow<ldouble>("AttractionForce Vec2<long double>", nbBodies, reference, [](Bodies<ldouble>& bodies) { attractionForceRows(bodies); });
+    benchKernelRow<double>("AttractionForce Vec2<double>", nbBodies, reference, [](Bodies<double>& bodies) { attractionForceRows(bodies); });
+
+    benchKernelRow<ldouble>("pairs long double", nbBodies, reference, [](Bodies<ldouble>& bodies) { ComputeAccelerations(bodies); });
+    benchKernelRow<double>("pairs double", nbBodies, reference, [](Bodies<double>& bodies) { ComputeAccelerations(bodies); });
+    benchKernelRow<float>("pairs float", nbBodies, reference, [](Bodies<float>& bodies) { ComputeAccelerations(bodies); });
+
+    for(SimdLevel kernel : { SimdLevel::Portable, SimdLevel::AVX2, SimdLevel::AVX512 })
+    {
+        if(kernel > level)
+            break;
+
+        const std::string name = std::string("rows ") + simdLevelName(kernel);
+        benchKernelRow<double>((name + " double").c_str(), nbBodies, reference, [kernel](Bodies<double>& bodies) {
+            gravityRowsOf(kernel, bodies);
+        });
+        benchKernelRow<float>((name + " float").c_str(), nbBodies, reference, [kernel](Bodies<float>& bodies) {
+            gravityRowsOf(kernel, bodies);
+        });
+    }
+}
+
+
+
+/// @brief one drift of the positions, position + velocity * dt + acceleration * dt²/2, on arrays of VecN
+///
+/// The compound expression makes three temporary vectors in the source. Once the operations are
+/// inlined they are only registers, so it has to run as fast as the same drift written component
+/// by component, and give the same bits.
+template<typename T, int N>
+void benchVectorRow(const char* name)
+{
+    const size_t nbVectors = 1 << 16;
+    const int repetitions = 64;
+    const T dt = 3600;
+    const T half_dt_squared = dt * dt / 2;
+
+    std::mt19937_64 generator(42);
+    std::uniform_real_distribution<double> value(-1e11, 1e11);
+    std::vector<VecN<T, N>> position, velocity, acceleration;
+    for(size_t i = 0; i < nbVectors; i++)
+    {
+        VecN<T, N> p = VecN<T, N>::Zero(), v = p, a = p;
+        for(int d = 0; d < N; d++)
+        {
+            p[d] = static_cast<T>(value(generator));
+            v[d] = static_cast<T>(value(generator) * 1e-7);
+            a[d] = static_cast<T>(value(generator) * 1e-14);
+        }
+        position.push_back(p);
+        velocity.push_back(v);
+        acceleration.push_back(a);
+    }
+
+    std::vector<VecN<T, N>> expression = position, components = position;
+
+    const double expression_time = bestTime(3, [&]() {
+        for(int r = 0; r < repetitions; r++)
+            for(size_t i = 0; i < nbVectors; i++)
+                expression[i] = position[i] + velocity[i] * dt + acceleration[i] * half_dt_squared;
+    });
+
+    const double components_time = bestTime(3, [&]() {
+        for(int r = 0; r < repetitions; r++)
+            for(size_t i = 0; i < nbVectors; i++)
+                for(int d = 0; d < N; d++)
+                    components[i][d] = position[i][d] + velocity[i][d] * dt + acceleration[i][d] * half_dt_squared;
+    });
+
+    bool same = true;
+    for(size_t i = 0; i < nbVectors; i++)
+        for(int d = 0; d < N; d++)
+            same = same && expression[i][d] == components[i][d];
+
+    const double updates = double(nbVectors) * repetitions;
+    std::cout << std::setw(20) << name << std::setw(16) << expression_time / updates * 1e9
+              << std::setw(16) << components_time / updates * 1e9 << std::setw(12) << (same ? "yes" : "NO") << "\n";
+}
+
+void benchVectors()
+{
+    std::cout << "\n=== VecN compound expression against the same drift written per component ===\n";
+    std::cout << std::setw(20) << "vector" << std::setw(16) << "expression ns" << std::setw(16) << "components ns"
+              << std::setw(12) << "same bits" << "\n";
+
+    benchVectorRow<float, 2>("Vec2<float>");
+    benchVectorRow<double, 2>("Vec2<double>");
+    benchVectorRow<double, 3>("Vec3<double>");
+    benchVectorRow<ldouble, 2>("Vec2<long double>");
+    benchVectorRow<ldouble, 3>("Vec3<long double>");
+}
+
+
+/// @brief cost per body of the 3D engine compared to the 2D one, on the same number of bodies
+///
+/// The kernels only have one more array to stream and one more FMA per interaction, the
+/// octree has twice as many children per cell as the quadtree.
+template<int D>
+void benchDimensionRow(SimdLevel level)
+{
+    const size_t nbDirect = 4096;
+    const size_t nbTree = 32768;
+    const double interactions = double(nbDirect) * (nbDirect - 1);
+
+    Bodies<double, D> direct_double = randomBodies<double, D>(nbDirect);
+    Bodies<float, D> direct_float = randomBodies<float, D>(nbDirect);
+    Bodies<double, D> tree_bodies = randomBodies<double, D>(nbTree);
+
+    const double rows_double = bestTime(3, [&]() { gravityRowsOf(level, direct_double); });
+    const double rows_float = bestTime(3, [&]() { gravityRowsOf(level, direct_float); });
+    const double pairs = bestTime(3, [&]() { ComputeAccelerations(direct_double); });
+
+    BarnesHutTree<double, D> tree(0.5);
+    const double tree_time = bestTime(3, [&]() { tree.ComputeAccelerations(tree_bodies); });
+
+    // one Verlet step, forces and integration, with the SIMD kernel
+    ThreadPool pool(1);
+    ParallelDirectForce<double, D> force(pool, DirectKernel::Simd);
+    Integrator<double, D> integrator(IntegratorType::Verlet);
+    const double step = bestTime(3, [&]() { integrator.Step(direct_double, 3600.0, force); });
+
+    std::cout << std::setw(6) << D << "D"
+              << std::setw(16) << rows_double / interactions * 1e9 << std::setw(16) << rows_float / interactions * 1e9
+              << std::setw(16) << pairs / interactions * 1e9 << std::setw(18) << tree_time / nbTree * 1e9
+              << std::setw(18) << step / nbDirect * 1e9 << std::setw(12) << tree.GetNodeCount() << "\n";
+}
+
+void benchDimensions()
+{
+    const SimdLevel level = detectSimdLevel();
+
+    std::cout << "\n=== 2D and 3D engines, rows " << simdLevelName(level) << " and pairs on 4096 bodies, Barnes-Hut on 32768 ===\n";
+    std::cout << std::setw(7) << "dim" << std::setw(16) << "rows double" << std::setw(16) << "rows float"
+              << std::setw(16) << "pairs double" << std::setw(18) << "tree ns/body" << std::setw(18) << "step ns/body"
+              << std::setw(12) << "tree nodes" << "\n";
+    std::cout << std::setw(7) << "" << std::setw(16) << "ns/interaction" << std::setw(16) << "ns/interaction"
+              << std::setw(16) << "ns/interaction" << "\n";
+
+    benchDimensionRow<2>(level);
+    benchDimensionRow<3>(level);
+}
+
+
+/// @brief time to write the same trajectory with each writer, to a real file
+///
+/// With `streamed`, the frames go through a StreamingTrajectoryWriter of 1024 frames and the
+/// time includes waiting for the writer thread at the end.
+template<typename T>
+void benchWriter(const char* name, TrajectoryFormat format, size_t nbBodies, size_t nbFrames, bool streamed = false)
+{
+    const char* filepath = "bench_trajectory.tmp";
+    Bodies<T> bodies = randomBodies<T>(nbBodies);
+    std::streamoff size = 0;
+
+    const double time = bestTime(3, [&]() {
+        std::ofstream stream(filepath, std::fstream::trunc | std::fstream::binary);
+        const std::unique_ptr<TrajectoryWriter<T>> file_writer = makeTrajectoryWriter<T>(format, stream);
+        StreamingTrajectoryWriter<T> streaming_writer(*file_writer);
+        TrajectoryWriter<T>* writer = streamed ? &streaming_writer : file_writer.get();
+
+        writer->Begin(nbBodies, 2, T(1));
+        for(size_t frame = 0; frame < nbFrames; frame++)
+        {
+            bodies.pos[0][frame % nbBodies] += T(1);
+            writer->WriteFrame(T(frame), bodies);
+        }
+        writer->End();
+        size = stream.tellp();
+    });
+    std::remove(filepath);
+
+    std::cout << std::setw(20) << name << std::setw(10) << nbBodies
+              << std::setw(16) << time / nbFrames * 1e6
+              << std::setw(16) << double(size) / nbFrames
+              << std::setw(14) << double(size) / time / 1e6 << "\n";
+}
+
+void benchWriters()
+{
+    std::cout << "\n=== Trajectory writers ===\n";
+    std::cout << std::setw(20) << "writer" << std::setw(10) << "bodies" << std::setw(16) << "us/frame"
+              << std::setw(16) << "bytes/frame" << std::setw(14) << "MB/s" << "\n";
+
+    for(size_t nbBodies : { 5, 1000 })
+    {
+        const size_t nbFrames = 2000000 / nbBodies;
+        benchWriter<ldouble>("csv long double", TrajectoryFormat::Csv, nbBodies, nbFrames);
+        benchWriter<double>("csv double", TrajectoryFormat::Csv, nbBodies, nbFrames);
+        benchWriter<ldouble>("bin long double", TrajectoryFormat::Binary, nbBodies, nbFrames);
+        benchWriter<double>("bin double", TrajectoryFormat::Binary, nbBodies, nbFrames);
+        benchWriter<float>("bin float", TrajectoryFormat::Binary, nbBodies, nbFrames);
+        benchWriter<double>("csv double streamed", TrajectoryFormat::Csv, nbBodies, nbFrames, true);
+        benchWriter<double>("bin double streamed", TrajectoryFormat::Binary, nbBodies, nbFrames, true);
+    }
+}
+
+
+
+/// @brief frames kept by each policy on an eccentric orbit, and the largest distance between
+/// the full trajectory and the polyline through the frames kept, relative to the semi-major axis
+void benchDecimation()
+{
+    std::cout << "\n=== Output decimation, one year of an e = 0.6 orbit, dt = 100 s ===\n";
+    std::cout << std::setw(22) << "policy" << std::setw(12) << "frames" << std::setw(16) << "max error / a" << "\n";
+
+    // full trajectory
+    const double sun = 1.9891e30, r = 75e9;
+    const double a = r / (1 - 0.6);
+    Bodies<double> bodies;
+    bodies.AddBody(5.9722e24, Vec2<double>(r, 0), Vec2<double>(0, std::sqrt(G<double> * sun * 1.6 / r)));
+    const auto force = [sun](Bodies<double>& state) {
+        const double x = state.pos[0][0], y = state.pos[1][0];
+        const double r3 = std::pow(x*x + y*y, 1.5);
+        state.acc[0][0] = -G<double> * sun * x / r3;
+        state.acc[1][0] = -G<double> * sun * y / r3;
+    };
+
+    MemoryTrajectoryWriter<double> full;
+    Integrator<double> integrator(IntegratorType::Verlet);
+    const size_t nbSteps = 365 * 864;
+    full.Begin(1, 2, 100.0);
+    full.WriteFrame(0, bodies);
+    for(size_t i = 0; i < nbSteps; i++)
+    {
+        integrator.Step(bodies, 100.0, force);
+        full.WriteFrame((i + 1) * 100.0, bodies);
+    }
+
+    for(const char* name : { "every:100", "interval:86400", "curvature:1e-3", "curvature:1e-4", "curvature:1e-5" })
+    {
+        DecimationPolicy policy;
+        parseDecimationPolicy(name, policy);
+
+        MemoryTrajectoryWriter<double> kept;
+        DecimatingTrajectoryWriter<double> writer(kept, policy);
+        writer.Begin(1, 2, 100.0);
+        for(size_t i = 0; i < full.GetFrameCount(); i++)
+        {
+            const double* frame = full.GetFrame(i);
+            const double* position[2] = { frame + 1, frame + 2 };
+            writer.WriteFrame(frame[0], position, 1);
+        }
+        writer.End();
+
+        // distance of each full frame to the segment of the frames kept around it
+        double error = 0;
+        size_t segment = 0;
+        for(size_t i = 0; i < full.GetFrameCount(); i++)
+        {
+            // [t, x, y] frames
+            const double* f = full.GetFrame(i);
+            while(segment + 2 < kept.GetFrameCount() && kept.GetFrame(segment + 1)[0] < f[0])
+                segment++;
+
+            const double* k0 = kept.GetFrame(segment);
+            const double* k1 = kept.GetFrame(segment + 1);
+            const double ax = k0[1], ay = k0[2];
+            const double bx = k1[1] - ax, by = k1[2] - ay;
+            const double px = f[1] - ax, py = f[2] - ay;
+            const double u = std::max(0.0, std::min(1.0, (px * bx + py * by) / (bx * bx + by * by)));
+            error = std::max(error, std::hypot(px - u * bx, py - u * by));
+        }
+
+        std::cout << std::setw(22) << name << std::setw(12) << kept.GetFrameCount() << std::setw(16) << error / a << "\n";
+    }
+    std::cout << std::setw(22) << "all" << std::setw(12) << full.GetFrameCount() << std::setw(16) << 0 << "\n";
+}
+
+
+
+/// @brief size and speed of the compressed trajectories of a sun and 4 planets, against the binary frames
+void benchCompression()
+{
+    const size_t nbFrames = 200000;
+    std::cout << "\n=== Compressed trajectories, a sun and 4 planets, " << nbFrames << " frames of 1 h, double ===\n";
+    std::cout << std::setw(18) << "tolerance (m)" << std::setw(10) << "ratio" << std::setw(16) << "encode MB/s"
+              << std::setw(16) << "decode MB/s" << std::setw(18) << "decode 4 thr MB/s" << std::setw(16) << "max error (m)" << "\n";
+
+    Bodies<double> bodies;
+    bodies.AddBody(1.9891e30, Vec2<double>(0, 0), Vec2<double>(0, 0));
+    for(const double r : { 58e9, 108e9, 150e9, 228e9 })
+        bodies.AddBody(5.9722e24, Vec2<double>(r, 0), Vec2<double>(0, std::sqrt(G<double> * 1.9891e30 / r)));
+    const auto force = [](Bodies<double>& state) { ComputeAccelerations(state); };
+
+    MemoryTrajectoryWriter<double> full;
+    Integrator<double> integrator(IntegratorType::Verlet);
+    full.Begin(bodies.Size(), 2, 3600.0);
+    full.WriteFrame(0, bodies);
+    for(size_t i = 1; i < nbFrames; i++)
+    {
+        integrator.Step(bodies, 3600.0, force);
+        full.WriteFrame(i * 3600.0, bodies);
+    }
+
+    const size_t frame_size = full.GetFrameSize();
+    const double raw_size = double(nbFrames * frame_size * sizeof(double));
+    const char* filepath = "bench_trajectory.tmp";
+
+    for(const double tolerance : { 0.0, 1e-3, 1.0, 1e3 })
+    {
+        const double encode = bestTime(3, [&]() {
+            std::ofstream stream(filepath, std::fstream::trunc | std::fstream::binary);
+            CompressedTrajectoryWriter<double> writer(stream, tolerance);
+            writer.Begin(bodies.Size(), 2, 3600.0);
+            for(size_t k = 0; k < nbFrames; k++)
+            {
+                const double* frame = full.GetFrame(k);
+                double x[5], y[5];
+                for(size_t i = 0; i < bodies.Size(); i++)
+                {
+                    x[i] = frame[1 + 2 * i];
+                    y[i] = frame[2 + 2 * i];
+                }
+                const double* position[2] = { x, y };
+                writer.WriteFrame(frame[0], position, bodies.Size());
+            }
+            writer.End();
+        });
+
+        CompressedTrajectoryReader<double> reader;
+        std::string error;
+        reader.Open(filepath, error);
+        std::vector<double> decoded(nbFrames * frame_size);
+        const double decode = bestTime(3, [&]() { reader.ReadFrames(0, nbFrames, decoded.data()); });
+        ThreadPool pool(4);
+        const double decode_parallel = bestTime(3, [&]() { reader.ReadFrames(0, nbFrames, decoded.data(), &pool); });
+
+        double max_error = 0;
+        for(size_t v = 0; v < decoded.size(); v++)
+            max_error = std::max(max_error, std::abs(decoded[v] - full.GetData()[v]));
+
+        std::ifstream file(filepath, std::ifstream::ate | std::ifstream::binary);
+        const double size = double(file.tellg());
+
+        std::cout << std::setw(18) << (tolerance == 0 ? std::string("lossless") : toString(tolerance)) << std::setw(10) << raw_size / size
+                  << std::setw(16) << raw_size / encode / 1e6 << std::setw(16) << raw_size / decode / 1e6
+                  << std::setw(18) << raw_size / decode_parallel / 1e6 << std::setw(16) << max_error << "\n";
+    }
+    std::remove(filepath);
+}
+
+
+
+/// @brief cases per second of an ensemble sweeping the initial velocity of the Earth
+void benchEnsemble()
+{
+    const size_t nbCases = 1000;
+    const size_t nbCores = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "\n=== Ensemble, " << nbCases << " two-body cases of one year, dt = 3600 s, double ===\n";
+    std::cout << std::setw(10) << "threads" << std::setw(14) << "time (ms)" << std::setw(14) << "cases/s" << "\n";
+
+    std::vector<EnsembleCase<double>> cases(nbCases);
+    for(size_t c = 0; c < nbCases; c++)
+    {
+        cases[c].days = 365;
+        cases[c].timestep = 3600;
+        cases[c].source_mass = 1.9891e30;
+        cases[c].mass = 5.9722e24;
+        cases[c].position = Vec2<double>(149.6e9, 0);
+        cases[c].velocity = Vec2<double>(0, 20e3 + 15e3 * c / nbCases);
+    }
+
+    const Options options;
+    std::vector<EnsembleSummary<double>> summaries(nbCases);
+
+    for(size_t nbThreads : { size_t(1), nbCores })
+    {
+        ThreadPool pool(nbThreads);
+        const double time = bestTime(1, [&]() {
+            std::atomic<size_t> next_case(0);
+            pool.Run([&](size_t) {
+                for(size_t c = next_case++; c < nbCases; c = next_case++)
+                    summaries[c] = runEnsembleCase<double>(cases[c], options, nullptr);
+            });
+        });
+
+        std::cout << std::setw(10) << nbThreads << std::setw(14) << time * 1e3 << std::setw(14) << nbCases / time << "\n";
+        if(nbCores == 1)
+            break;
+    }
+}
+
+
+
+
+/// @brief largest distance to the long double solution, relative to a, over one sample in `stride`
+double keplerError(double a, double e, double dq, size_t first, size_t n, const double* x, const double* y, size_t stride)
+{
+    const ldouble b = a * sqrt(1 - ldouble(e) * e);
+    double error = 0;
+    for(size_t i = 0; i < n; i += stride)
+    {
+        const ldouble M = keplerMeanAnomaly<ldouble>(first + i, dq);
+        const ldouble E = solveKepler<ldouble>(M, e, keplerStart<ldouble>(M, e));
+        const ldouble dx = a * (cos(E) - e) - x[i];
+        const ldouble dy = b * sin(E) - y[i];
+        error = std::max(error, static_cast<double>(sqrt(dx*dx + dy*dy) / a));
+    }
+    return error;
+}
+
+/// @brief samples of the analytic orbit (simu) per second : one newton() per sample, then the batched solver
+///
+/// The large runs are computed by chunks of one buffer, as simu would do to write them.
+void benchKepler()
+{
+    const double a = (150e9 + 228e9) / 2;
+    const double e = (228e9 - 150e9) / (228e9 + 150e9);
+    const double dt = 3600;
+    const double dq = dt / periode(a, 1.9891e30);
+    const size_t chunk = size_t(1) << 20;
+    const SimdLevel level = detectSimdLevel();
+
+    std::cout << "\n=== Analytic orbit, e = " << e << ", dt = " << dt << " s, best SIMD : " << simdLevelName(level) << " ===\n";
+    std::cout << std::setw(22) << "solver" << std::setw(12) << "samples" << std::setw(14) << "time (ms)"
+              << std::setw(14) << "ns/sample" << std::setw(14) << "max error" << "\n";
+
+    std::vector<double> x(chunk), y(chunk);
+
+    // the original solver, too slow for the large runs : 10^5 samples
+    {
+        const size_t n = 100000;
+        const double T = periode(a, 1.9891e30);
+        const double b = a * sqrt(1 - e * e);
+        const double time = bestTime(1, [&]() {
+            for(size_t i = 0; i < n; i++)
+            {
+                const double psi = newton<double>(T, i * dt, e, 0);
+                x[i] = a * (cos(psi) - e);
+                y[i] = b * sin(psi);
+            }
+        });
+        std::cout << std::setw(22) << "newton()" << std::setw(12) << n << std::setw(14) << time * 1e3
+                  << std::setw(14) << time * 1e9 / n << std::setw(14) << keplerError(a, e, dq, 0, n, x.data(), y.data(), 7) << "\n";
+    }
+
+    for(SimdLevel solver : { SimdLevel::Portable, SimdLevel::AVX2, SimdLevel::AVX512 })
+    {
+        if(solver > level)
+            break;
+
+        for(size_t n : { size_t(1000000), size_t(10000000), size_t(100000000) })
+        {
+            const double time = bestTime(1, [&]() {
+                for(size_t first = 0; first < n; first += chunk)
+                    keplerOrbit(solver, a, e, dq, first, std::min(chunk, n - first), x.data(), y.data());
+            });
+
+            // error of the last chunk, the farthest from the start
+            const size_t last = (n - 1) / chunk * chunk;
+            const double error = keplerError(a, e, dq, last, n - last, x.data(), y.data(), 7);
+
+            const std::string name = std::string("batched ") + simdLevelName(solver);
+            std::cout << std::setw(22) << name << std::setw(12) << n << std::setw(14) << time * 1e3
+                      << std::setw(14) << time * 1e9 / n << std::setw(14) << error << "\n";
+        }
+    }
+}
+
+
+/// @brief TrajectoryWriter only counting the frames, to time what produces them
+template<typename T>
+class NullTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    using TrajectoryWriter<T>::WriteFrame;
+
+    size_t frames = 0;
+
+    void Begin(size_t, int, T) override { frames = 0; }
+    void WriteFrame(T, const T* const*, size_t) override { frames++; }
+    void End() override {}
+};
+
+/// @brief simu() on 1, 2, 4, ... threads, the frames being dropped by the writer
+void benchSimu()
+{
+    const size_t nbCores = std::max(1u, std::thread::hardware_concurrency());
+    const size_t nbSamples = 20000000;
+
+    std::cout << "\n=== Analytic orbit simu(), " << nbSamples << " samples, double, " << nbCores << " cores ===\n";
+    std::cout << std::setw(10) << "threads" << std::setw(14) << "time (ms)" << std::setw(14) << "ns/sample"
+              << std::setw(12) << "efficiency" << std::setw(22) << "with polaire (ms)" << "\n";
+
+    std::vector<size_t> thread_counts;
+    for(size_t nbThreads = 1; nbThreads < nbCores; nbThreads *= 2)
+        thread_counts.push_back(nbThreads);
+    thread_counts.push_back(nbCores);
+
+    NullTrajectoryWriter<double> writer;
+    std::vector<Vec2<double>> polaire;
+    double reference = 0;
+
+    for(size_t nbThreads : thread_counts)
+    {
+        ThreadPool pool(nbThreads);
+        const double time = bestTime(3, [&]() { simu<double>(150e9, 228e9, 1.9891e30, nbSamples, 100, writer, pool); });
+        const double polar_time = bestTime(1, [&]() { simu<double>(150e9, 228e9, 1.9891e30, nbSamples, 100, writer, pool, &polaire); });
+
+        if(nbThreads == 1)
+            reference = time;
+
+        std::cout << std::setw(10) << nbThreads << std::setw(14) << time * 1e3 << std::setw(14) << time * 1e9 / nbSamples
+                  << std::setw(12) << reference / (time * nbThreads) << std::setw(22) << polar_time * 1e3 << "\n";
+    }
+}
+
+
+
+
+/// @brief cost of the checkpoints relative to the step they are taken after
+///
+/// Save is what the simulation loop waits for (flush of the writer and copy of the state),
+/// the write is done by the background thread meanwhile. Due is called after every step.
+void benchCheckpoint()
+{
+    const char* filepath = "bench_checkpoint.tmp";
+
+    std::cout << "\n=== Checkpoints, double, Verlet with Barnes-Hut theta = 0.5 ===\n";
+    std::cout << std::setw(10) << "bodies" << std::setw(14) << "step (ms)" << std::setw(12) << "Due (ns)"
+              << std::setw(12) << "Save (us)" << std::setw(14) << "Save / step" << std::setw(14) << "write (ms)"
+              << std::setw(12) << "size (MB)" << std::setw(12) << "Load (ms)" << "\n";
+
+    for(size_t nbBodies : { 1, 1000, 16384, 131072 })
+    {
+        Bodies<double> bodies = randomBodies<double>(nbBodies);
+        BarnesHutTree<double> tree;
+        const auto force = [&tree](Bodies<double>& state) { tree.ComputeAccelerations(state); };
+        Integrator<double> integrator(IntegratorType::Verlet);
+        integrator.Step(bodies, 3600.0, force);
+
+        const double step = bestTime(3, [&]() { integrator.Step(bodies, 3600.0, force); });
+
+        NullTrajectoryWriter<double> writer;
+        Checkpointer<double, 2> checkpointer(filepath, 1e9, nullptr);
+
+        const size_t nbCalls = 1 << 20;
+        const double due = bestTime(3, [&]() {
+            for(size_t i = 0; i < nbCalls; i++)
+                checkpointer.Due();
+        }) / nbCalls;
+
+        // the first checkpoint allocates the copy of the state, the next ones reuse it
+        checkpointer.Save(1, 2, 3600.0, bodies, integrator, writer, 3600.0);
+        double save = 1e300;
+        for(int r = 0; r < 3; r++)
+        {
+            bool saved = false;
+            while(!saved)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                const auto start = std::chrono::steady_clock::now();
+                saved = checkpointer.Save(1, 2, 3600.0, bodies, integrator, writer, 3600.0);
+                if(saved)
+                    save = std::min(save, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+        }
+        checkpointer.Finish();
+        const double write = checkpointer.GetLastWriteTime();
+
+        Checkpointer<double, 2> loader("", 0, nullptr);
+        std::string error;
+        const double load = bestTime(3, [&]() { loader.Load(filepath, nbBodies, checkpointIntegrator(IntegratorType::Verlet), 3600.0, error); });
+        const double size = std::filesystem::file_size(filepath) / 1e6;
+        std::remove(filepath);
+
+        std::cout << std::setw(10) << nbBodies << std::setw(14) << step * 1e3 << std::setw(12) << due * 1e9
+                  << std::setw(12) << save * 1e6 << std::setw(13) << save / step * 100 << "%"
+                  << std::setw(14) << write * 1e3 << std::setw(12) << size << std::setw(12) << load * 1e3 << "\n";
+    }
+}
+
+
+
+/// @brief cost of the potential taken by the force kernels for the diagnostics, and of a record
+void benchDiagnostics()
+{
+    std::cout << "\n=== Potential with the forces, double, 1 thread ===\n";
+    std::cout << std::setw(22) << "kernel" << std::setw(10) << "bodies" << std::setw(16) << "forces (ms)"
+              << std::setw(22) << "with potential (ms)" << std::setw(14) << "record (us)" << "\n";
+
+    ThreadPool pool(1);
+    for(size_t nbBodies : { 1000, 16384 })
+    {
+        Bodies<double> bodies = randomBodies<double>(nbBodies);
+        std::vector<double> potential(nbBodies);
+
+        ParallelDirectForce<double> simd(pool, DirectKernel::Simd);
+        ParallelDirectForce<double> pairs(pool, DirectKernel::Pairs);
+        BarnesHutTree<double> tree;
+
+        const std::pair<const char*, std::function<void(double*)>> kernels[] = {
+            { "simd", [&](double* out) { simd(bodies, out); } },
+            { "pairs", [&](double* out) { pairs(bodies, out); } },
+            { "barneshut 0.5", [&](double* out) { tree.ComputeAccelerations(bodies, nullptr, out); } },
+        };
+
+        for(const auto& kernel : kernels)
+        {
+            const int repetitions = nbBodies > 4096 ? 1 : 5;
+            const double forces = bestTime(repetitions, [&]() { kernel.second(nullptr); });
+            const double with_potential = bestTime(repetitions, [&]() { kernel.second(potential.data()); });
+
+            std::cout << std::setw(22) << kernel.first << std::setw(10) << nbBodies << std::setw(16) << forces * 1e3
+                      << std::setw(22) << with_potential * 1e3 << std::setw(14) << "" << "\n";
+        }
+
+        // a record after a Verlet step : the potential of its last evaluation, then O(N)
+        Diagnostics<double, 2> diagnostics(1);
+        Integrator<double> integrator(IntegratorType::Verlet);
+        const auto force = [&](Bodies<double>& state) { tree.ComputeAccelerations(state, nullptr, diagnostics.Potential(state.Size())); };
+        diagnostics.Capture();
+        integrator.Step(bodies, 3600.0, force);
+        const double record = bestTime(5, [&]() {
+            diagnostics.Capture();
+            diagnostics.Record(0.0, bodies, integrator, force);
+        });
+        std::cout << std::setw(22) << "record after verlet" << std::setw(10) << nbBodies << std::setw(16) << ""
+                  << std::setw(22) << "" << std::setw(14) << record * 1e6 << "\n";
+    }
+}
+
+
+
+int main() {
+    benchLayouts();
+    benchPrecision();
+    benchIntegrators();
+    benchBarnesHut();
+    benchThreads();
+    benchSimdKernel();
+    benchVectors();
+    benchDimensions();
+    benchWriters();
+    benchDecimation();
+    benchCompression();
+    benchEnsemble();
+    benchKepler();
+    benchSimu();
+    benchCheckpoint();
+    benchDiagnostics();
+}
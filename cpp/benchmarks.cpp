@@ -0,0 +1,385 @@
+#define TESTS
+#include "rk4.cpp"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+
+////// Benchmarks of the physics kernels
+//
+//  Google Benchmark suite, built by CMake as the `benchmarks` target. The results of a commit
+//  are kept in JSON to compare them with the next ones :
+//
+//      ./benchmarks --benchmark_out=benchmarks.json --benchmark_out_format=json
+//
+//  (or `cmake --build build --target run_benchmarks`). The argument of each benchmark is its
+//  number of bodies, frames or samples, and the items/s counters are per pair, frame or sample,
+//  so the sizes can be compared with each other. bench.cpp has the tables of the other studies.
+//
+
+
+////////// Helpers
+
+/// @brief bodies spread on a square (a cube in 3D) of one astronomical unit, with random velocities
+template<typename T, int D = 2>
+Bodies<T, D> randomBodies(size_t nbBodies)
+{
+    std::mt19937_64 generator(42);
+    std::uniform_real_distribution<double> position(-1.5e11, 1.5e11);
+    std::uniform_real_distribution<double> velocity(-3e4, 3e4);
+    std::uniform_real_distribution<double> mass(1e22, 1e25);
+
+    Bodies<T, D> bodies;
+    bodies.Reserve(nbBodies);
+    for(size_t i = 0; i < nbBodies; i++)
+    {
+        const T m = mass(generator);
+        VecN<T, D> r = VecN<T, D>::Zero(), v = VecN<T, D>::Zero();
+        for(int d = 0; d < D; d++)
+        {
+            r[d] = position(generator);
+            v[d] = velocity(generator);
+        }
+        bodies.AddBody(m, r, v);
+    }
+    return bodies;
+}
+
+/// @brief a writer dropping the frames, to time the simulations without the disk
+template<typename T>
+class NullTrajectoryWriter : public TrajectoryWriter<T> {
+public :
+    void Begin(size_t, int, T) override {}
+    void WriteFrame(T, const T* const*, size_t) override {}
+    void End() override {}
+};
+
+/// @brief std::cout is muted while it lives, the simulations printing their progress
+class MutedOutput {
+public :
+    MutedOutput() : m_Buffer(std::cout.rdbuf(nullptr)) {}
+    ~MutedOutput()
+    {
+        std::cout.rdbuf(m_Buffer);
+        std::cout.clear();
+    }
+
+private :
+    std::streambuf* m_Buffer;
+};
+
+
+
+
+////////// Vectors
+
+template<typename T>
+std::vector<Vec2<T>> randomVectors(size_t n)
+{
+    std::mt19937_64 generator(42);
+    std::uniform_real_distribution<double> coordinate(-1e11, 1e11);
+
+    std::vector<Vec2<T>> vectors;
+    vectors.reserve(n);
+    for(size_t i = 0; i < n; i++)
+        vectors.emplace_back(coordinate(generator), coordinate(generator));
+    return vectors;
+}
+
+/// @brief the Vec2 operators on arrays of vectors, `operation` being applied to each pair (a[i], b[i])
+template<typename T, typename Operation>
+void vectorBenchmark(benchmark::State& state, Operation&& operation)
+{
+    const size_t n = state.range(0);
+    const std::vector<Vec2<T>> a = randomVectors<T>(n);
+    std::vector<Vec2<T>> b = randomVectors<T>(n + 1);
+    b.erase(b.begin());
+    std::vector<Vec2<T>> result(n, Vec2<T>::Zero());
+
+    for(auto _ : state)
+    {
+        for(size_t i = 0; i < n; i++)
+            result[i] = operation(a[i], b[i]);
+        benchmark::DoNotOptimize(result.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+template<typename T>
+void BM_Vec2Add(benchmark::State& state)
+{
+    vectorBenchmark<T>(state, [](const Vec2<T>& a, const Vec2<T>& b) { return a + b; });
+}
+
+template<typename T>
+void BM_Vec2Scale(benchmark::State& state)
+{
+    vectorBenchmark<T>(state, [](const Vec2<T>& a, const Vec2<T>& b) { return a * b.x; });
+}
+
+template<typename T>
+void BM_Vec2Divide(benchmark::State& state)
+{
+    vectorBenchmark<T>(state, [](const Vec2<T>& a, const Vec2<T>& b) { return a / b.y; });
+}
+
+template<typename T>
+void BM_Vec2Dot(benchmark::State& state)
+{
+    vectorBenchmark<T>(state, [](const Vec2<T>& a, const Vec2<T>& b) { return Vec2<T>(dot(a, b), 0); });
+}
+
+template<typename T>
+void BM_Vec2Magnitude(benchmark::State& state)
+{
+    vectorBenchmark<T>(state, [](const Vec2<T>& a, const Vec2<T>&) { return Vec2<T>(a.Magnitude(), 0); });
+}
+
+template<typename T>
+void BM_Vec2Normalised(benchmark::State& state)
+{
+    vectorBenchmark<T>(state, [](const Vec2<T>& a, const Vec2<T>&) { return a.Normalised(); });
+}
+
+#define VECTOR_BENCHMARK(name)                                      \
+    BENCHMARK_TEMPLATE(name, float)->Arg(1 << 12);                  \
+    BENCHMARK_TEMPLATE(name, double)->Arg(1 << 12);                 \
+    BENCHMARK_TEMPLATE(name, ldouble)->Arg(1 << 12)
+
+VECTOR_BENCHMARK(BM_Vec2Add);
+VECTOR_BENCHMARK(BM_Vec2Scale);
+VECTOR_BENCHMARK(BM_Vec2Divide);
+VECTOR_BENCHMARK(BM_Vec2Dot);
+VECTOR_BENCHMARK(BM_Vec2Magnitude);
+VECTOR_BENCHMARK(BM_Vec2Normalised);
+
+
+
+
+////////// Forces
+
+/// @brief AttractionForce of every Object on every other one, one item per pair
+template<typename T>
+void BM_AttractionForce(benchmark::State& state)
+{
+    const size_t n = state.range(0);
+    const Bodies<T> bodies = randomBodies<T>(n);
+
+    std::vector<Object<T>> objects;
+    objects.reserve(n);
+    for(size_t i = 0; i < n; i++)
+        objects.emplace_back(bodies.mass[i], bodies.GetPosition(i), bodies.GetVelocity(i));
+
+    for(auto _ : state)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            Vec2<T> force = Vec2<T>::Zero();
+            for(size_t j = 0; j < n; j++)
+                if(j != i)
+                    force += AttractionForce(objects[j], objects[i]);
+            benchmark::DoNotOptimize(force);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * n * (n - 1));
+}
+
+BENCHMARK_TEMPLATE(BM_AttractionForce, float)->RangeMultiplier(4)->Range(64, 1024);
+BENCHMARK_TEMPLATE(BM_AttractionForce, double)->RangeMultiplier(4)->Range(64, 1024);
+BENCHMARK_TEMPLATE(BM_AttractionForce, ldouble)->RangeMultiplier(4)->Range(64, 1024);
+
+/// @brief accelerations of the N-body simulations on one thread, one item per pair
+template<typename T, int D, DirectKernel Kernel>
+void BM_DirectForce(benchmark::State& state)
+{
+    const size_t n = state.range(0);
+    Bodies<T, D> bodies = randomBodies<T, D>(n);
+    ThreadPool pool(1);
+    ParallelDirectForce<T, D> force(pool, Kernel);
+
+    for(auto _ : state)
+    {
+        force(bodies);
+        benchmark::DoNotOptimize(bodies.acc[0].data());
+    }
+    state.SetItemsProcessed(state.iterations() * n * (n - 1));
+}
+
+BENCHMARK_TEMPLATE(BM_DirectForce, float, 2, DirectKernel::Simd)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK_TEMPLATE(BM_DirectForce, double, 2, DirectKernel::Simd)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK_TEMPLATE(BM_DirectForce, double, 2, DirectKernel::Pairs)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK_TEMPLATE(BM_DirectForce, ldouble, 2, DirectKernel::Pairs)->RangeMultiplier(4)->Range(64, 1024);
+BENCHMARK_TEMPLATE(BM_DirectForce, double, 3, DirectKernel::Simd)->RangeMultiplier(4)->Range(64, 4096);
+
+/// @brief accelerations by the quadtree (octree in 3D), one item per body
+template<typename T, int D>
+void BM_BarnesHut(benchmark::State& state)
+{
+    const size_t n = state.range(0);
+    Bodies<T, D> bodies = randomBodies<T, D>(n);
+    BarnesHutTree<T, D> tree;
+
+    for(auto _ : state)
+    {
+        tree.ComputeAccelerations(bodies);
+        benchmark::DoNotOptimize(bodies.acc[0].data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_TEMPLATE(BM_BarnesHut, double, 2)->RangeMultiplier(8)->Range(1 << 10, 1 << 16);
+BENCHMARK_TEMPLATE(BM_BarnesHut, double, 3)->RangeMultiplier(8)->Range(1 << 10, 1 << 16);
+
+
+
+
+////////// Simulations
+
+/// @brief one step of the N-body simulation(), direct summation on one thread
+template<typename T, IntegratorType Type>
+void BM_SimulationStep(benchmark::State& state)
+{
+    const size_t n = state.range(0);
+    Bodies<T> bodies = randomBodies<T>(n);
+    ThreadPool pool(1);
+    ParallelDirectForce<T> force(pool, std::is_same_v<T, ldouble> ? DirectKernel::Pairs : DirectKernel::Simd);
+    Integrator<T> integrator(Type);
+    NullTrajectoryWriter<T> writer;
+    MutedOutput muted;
+
+    for(auto _ : state)
+        simulation<T>(1, bodies, T(3600), integrator, force, writer);
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_TEMPLATE(BM_SimulationStep, float, IntegratorType::Verlet)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_SimulationStep, double, IntegratorType::Euler)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_SimulationStep, double, IntegratorType::Verlet)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_SimulationStep, double, IntegratorType::RK4)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_SimulationStep, double, IntegratorType::Yoshida4)->RangeMultiplier(4)->Range(16, 4096);
+BENCHMARK_TEMPLATE(BM_SimulationStep, ldouble, IntegratorType::Verlet)->RangeMultiplier(4)->Range(16, 1024);
+
+/// @brief the two-body simulation() of the Earth around the Sun, one item per step
+template<typename T, IntegratorType Type>
+void BM_TwoBodySimulation(benchmark::State& state)
+{
+    const size_t nbSteps = state.range(0);
+    const Object<T> sun(T(1.9891e30), Vec2<T>::Zero(), Vec2<T>::Zero());
+    NullTrajectoryWriter<T> writer;
+    MutedOutput muted;
+
+    for(auto _ : state)
+    {
+        Object<T> earth(T(5.9722e24), Vec2<T>(T(150e9), T(0)), Vec2<T>(T(0), T(29.78e3)));
+        Integrator<T> integrator(Type);
+        simulation<T>(nbSteps, sun, earth, T(3600), integrator, writer);
+        benchmark::DoNotOptimize(earth.GetCurrentPosition());
+    }
+    state.SetItemsProcessed(state.iterations() * nbSteps);
+}
+
+BENCHMARK_TEMPLATE(BM_TwoBodySimulation, float, IntegratorType::Verlet)->Arg(8760);
+BENCHMARK_TEMPLATE(BM_TwoBodySimulation, double, IntegratorType::Verlet)->Arg(8760);
+BENCHMARK_TEMPLATE(BM_TwoBodySimulation, double, IntegratorType::RK4)->Arg(8760);
+BENCHMARK_TEMPLATE(BM_TwoBodySimulation, ldouble, IntegratorType::Verlet)->Arg(8760);
+
+/// @brief Object::Update_state, keeping the history of the states or only the current one
+template<typename T>
+void BM_UpdateState(benchmark::State& state)
+{
+    const size_t nbUpdates = state.range(0);
+    const bool recording = state.range(1) != 0;
+    const std::vector<Vec2<T>> positions = randomVectors<T>(nbUpdates);
+
+    for(auto _ : state)
+    {
+        Object<T> object(T(5.9722e24), positions[0], positions[0], recording ? nbUpdates : 0);
+        for(size_t i = 0; i < nbUpdates; i++)
+            object.Update_state(positions[i], positions[i]);
+        benchmark::DoNotOptimize(object.GetCurrentPosition());
+    }
+    state.SetItemsProcessed(state.iterations() * nbUpdates);
+}
+
+BENCHMARK_TEMPLATE(BM_UpdateState, float)->Args({ 1 << 16, 0 })->Args({ 1 << 16, 1 });
+BENCHMARK_TEMPLATE(BM_UpdateState, double)->Args({ 1 << 16, 0 })->Args({ 1 << 16, 1 });
+BENCHMARK_TEMPLATE(BM_UpdateState, ldouble)->Args({ 1 << 16, 0 })->Args({ 1 << 16, 1 });
+
+
+
+
+////////// Analytic orbit
+
+/// @brief newton() solving Kepler's equation, one item per solution
+template<typename T>
+void BM_Newton(benchmark::State& state)
+{
+    const size_t n = state.range(0);
+    const T a = T(189e9), e = T(0.2063492063492063);
+    const T period = periode(a, T(1.9891e30));
+    const T dt = period / T(n);
+
+    for(auto _ : state)
+        for(size_t i = 0; i < n; i++)
+            benchmark::DoNotOptimize(newton<T>(period, T(i) * dt, e, T(0)));
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_TEMPLATE(BM_Newton, float)->Arg(1 << 12);
+BENCHMARK_TEMPLATE(BM_Newton, double)->Arg(1 << 12);
+BENCHMARK_TEMPLATE(BM_Newton, ldouble)->Arg(1 << 12);
+
+/// @brief simu() on one thread, the frames being dropped, one item per sample
+template<typename T>
+void BM_Simu(benchmark::State& state)
+{
+    const size_t nbSamples = state.range(0);
+    ThreadPool pool(1);
+    NullTrajectoryWriter<T> writer;
+
+    for(auto _ : state)
+        simu<T>(T(150e9), T(228e9), T(1.9891e30), nbSamples, T(100), writer, pool);
+    state.SetItemsProcessed(state.iterations() * nbSamples);
+}
+
+BENCHMARK_TEMPLATE(BM_Simu, float)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Simu, double)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Simu, ldouble)->RangeMultiplier(16)->Range(1 << 12, 1 << 20);
+
+
+
+
+////////// Output
+
+/// @brief frames of n bodies written by the text or binary writer to memory, one item per frame
+template<typename T, TrajectoryFormat Format>
+void BM_WriteFrame(benchmark::State& state)
+{
+    const size_t n = state.range(0);
+    const size_t nbFrames = 256;
+    Bodies<T> bodies = randomBodies<T>(n);
+    std::ostringstream stream;
+    const std::unique_ptr<TrajectoryWriter<T>> writer = makeTrajectoryWriter<T>(Format, stream);
+
+    for(auto _ : state)
+    {
+        stream.str(std::string());
+        writer->Begin(n, 2, T(1));
+        for(size_t frame = 0; frame < nbFrames; frame++)
+            writer->WriteFrame(T(frame), bodies);
+        writer->End();
+    }
+    state.SetItemsProcessed(state.iterations() * nbFrames);
+    state.SetBytesProcessed(state.iterations() * int64_t(stream.tellp()));
+}
+
+BENCHMARK_TEMPLATE(BM_WriteFrame, float, TrajectoryFormat::Csv)->RangeMultiplier(8)->Range(1, 512);
+BENCHMARK_TEMPLATE(BM_WriteFrame, double, TrajectoryFormat::Csv)->RangeMultiplier(8)->Range(1, 512);
+BENCHMARK_TEMPLATE(BM_WriteFrame, ldouble, TrajectoryFormat::Csv)->RangeMultiplier(8)->Range(1, 512);
+BENCHMARK_TEMPLATE(BM_WriteFrame, double, TrajectoryFormat::Binary)->RangeMultiplier(8)->Range(1, 512);
+
+
+
+BENCHMARK_MAIN();
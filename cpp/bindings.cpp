@@ -0,0 +1,219 @@
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+#include "Engine.h"
+
+#include <array>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace py = pybind11;
+
+
+////// Python module
+//
+//  import tipe
+//  engine = tipe.Engine(dimension=2, integrator="verlet", threads=0)
+//  engine.add_body(1.9891e30, (0, 0), (0, 0))
+//  engine.add_body(5.9722e24, (150e9, 0), (0, 29780))
+//  engine.record()
+//  engine.step(365 * 24, 3600)
+//  temps, positions = engine.trajectory()
+//
+//  The arrays given to Python are views on the memory of the engine (no copy), which they
+//  keep alive. The positions, velocities and masses follow the bodies from one step to the
+//  next. The trajectory is [t, x0, y0, x1, ...] frames as in the binary files (Trajectory.h).
+//  The engine counts the views still alive, and refuses what would move the memory under
+//  them : add_body and load while the bodies are viewed, record and the steps going past the
+//  frames reserved (record(frames)) while the trajectory is viewed. The views can be copied
+//  (numpy.array(view)) to keep them. The steps release the GIL.
+
+
+/// @brief engine in double precision, the frames being kept in memory when recorded
+template<int D>
+struct PyEngine
+{
+    Engine<double, D> engine;
+    MemoryTrajectoryWriter<double> trajectory;
+
+    // NumPy arrays alive on the bodies and on the frames
+    size_t body_views = 0;
+    size_t trajectory_views = 0;
+
+    explicit PyEngine(const EngineSettings& settings)
+        : engine(settings)
+    {
+    }
+
+    void CheckBodiesFree(const char* action) const
+    {
+        if(body_views != 0)
+            throw std::runtime_error(std::string("Can't ") + action + " while the masses, positions or velocities are viewed : "
+                                     "delete these arrays, or keep copies of them");
+    }
+
+    /// @brief refuse to write frames past the capacity of the trajectory while it is viewed
+    void CheckTrajectoryFits(size_t nbFrames) const
+    {
+        const size_t frame_size = 1 + engine.Size() * D;
+        if(trajectory_views != 0 && nbFrames * frame_size > trajectory.GetCapacity())
+            throw std::runtime_error("The trajectory is viewed and has room for " + std::to_string(trajectory.GetCapacity() / frame_size) +
+                                     " frames, not " + std::to_string(nbFrames) + " : reserve them with record(frames), "
+                                     "or delete the arrays of trajectory()");
+    }
+};
+
+
+/// @brief base of the views of an engine : keeps it alive, and counts the views alive in `views`
+struct ViewGuard
+{
+    py::object engine;
+    size_t* views;
+};
+
+inline py::capsule viewGuard(py::handle engine, size_t& views)
+{
+    views++;
+    return py::capsule(new ViewGuard{ py::reinterpret_borrow<py::object>(engine), &views }, [](void* pointer) {
+        ViewGuard* guard = static_cast<ViewGuard*>(pointer);
+        (*guard->views)--;
+        delete guard;
+    });
+}
+
+/// @brief read-only NumPy view on the scalars at `data`, strides in scalars, `base` being a viewGuard
+inline py::array view(const double* data, std::vector<py::ssize_t> shape, std::vector<py::ssize_t> strides, py::handle base)
+{
+    for(py::ssize_t& stride : strides)
+        stride *= sizeof(double);
+
+    py::array array(py::dtype::of<double>(), shape, strides, data, base);
+    py::detail::array_proxy(array.ptr())->flags &= ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+    return array;
+}
+
+template<int D>
+py::tuple views(const std::vector<double> (&arrays)[D], py::handle base)
+{
+    py::tuple components(D);
+    for(int d = 0; d < D; d++)
+        components[d] = view(arrays[d].data(), { py::ssize_t(arrays[d].size()) }, { 1 }, base);
+    return components;
+}
+
+template<int D>
+VecD<double, D> toVector(const std::array<double, D>& components)
+{
+    if constexpr(D == 3)
+        return VecD<double, D>(components[0], components[1], components[2]);
+    else
+        return VecD<double, D>(components[0], components[1]);
+}
+
+
+template<int D>
+void bindEngine(py::module_& module, const char* name)
+{
+    using Self = PyEngine<D>;
+
+    py::class_<Self>(module, name)
+        .def_property_readonly("dimension", [](const Self&) { return D; })
+        .def_property_readonly("size", [](const Self& self) { return self.engine.Size(); })
+        .def_property_readonly("steps", [](const Self& self) { return self.engine.GetStepCount(); })
+        .def_property("time", [](const Self& self) { return self.engine.GetTime(); },
+                              [](Self& self, double time) { self.engine.SetTime(time); })
+
+        .def("add_body", [](Self& self, double mass, const std::array<double, D>& position, const std::array<double, D>& velocity) {
+                self.CheckBodiesFree("add a body");
+                self.engine.AddBody(mass, toVector<D>(position), toVector<D>(velocity));
+            }, py::arg("mass"), py::arg("position"), py::arg("velocity"))
+
+        .def("load", [](Self& self, const std::string& filepath) {
+                self.CheckBodiesFree("load bodies");
+                if(!self.engine.LoadSystem(filepath.c_str()))
+                    throw py::value_error("Can't read the bodies from " + filepath);
+            }, py::arg("path"))
+
+        .def("step", [](Self& self, size_t nbSteps, double dt) {
+                // a recording not begun yet starts over with the current state
+                if(self.engine.HasWriter())
+                    self.CheckTrajectoryFits((self.engine.IsRecording() ? self.trajectory.GetFrameCount() : 1) + nbSteps);
+
+                py::gil_scoped_release release;
+                self.engine.Step(nbSteps, dt);
+            }, py::arg("n"), py::arg("dt"))
+
+        .def("record", [](Self& self, size_t nbFrames) {
+                if(self.trajectory_views != 0)
+                    throw std::runtime_error("Can't record again while the trajectory is viewed : delete the arrays of trajectory()");
+
+                self.engine.Record(&self.trajectory);
+                self.trajectory.Begin(self.engine.Size(), D, 0);
+                self.trajectory.Reserve(nbFrames);
+            }, py::arg("frames") = 0, "keep the frames of the next steps in memory, the current state being the first one")
+
+        .def("stop_recording", [](Self& self) { self.engine.Record(nullptr); })
+
+        .def_property_readonly("masses", [](py::object owner) {
+                Self& self = owner.cast<Self&>();
+                const std::vector<double>& mass = self.engine.GetBodies().mass;
+                return view(mass.data(), { py::ssize_t(mass.size()) }, { 1 }, viewGuard(owner, self.body_views));
+            })
+        .def_property_readonly("positions", [](py::object owner) {
+                Self& self = owner.cast<Self&>();
+                return views<D>(self.engine.GetBodies().pos, viewGuard(owner, self.body_views));
+            })
+        .def_property_readonly("velocities", [](py::object owner) {
+                Self& self = owner.cast<Self&>();
+                return views<D>(self.engine.GetBodies().vel, viewGuard(owner, self.body_views));
+            })
+
+        .def("trajectory", [](py::object owner) {
+                Self& self = owner.cast<Self&>();
+                const MemoryTrajectoryWriter<double>& trajectory = self.trajectory;
+                const py::ssize_t nbFrames = trajectory.GetFrameCount();
+                const py::ssize_t frame = trajectory.GetFrameSize();
+                const py::ssize_t nbBodies = trajectory.GetBodyCount();
+
+                // (nb_frames,) and (nb_frames, nb_bodies, dimension), as lire_trajectoire
+                const py::capsule base = viewGuard(owner, self.trajectory_views);
+                return py::make_tuple(view(trajectory.GetData(), { nbFrames }, { frame }, base),
+                                      view(trajectory.GetData() + 1, { nbFrames, nbBodies, D }, { frame, D, 1 }, base));
+            }, "(temps, positions), views on the frames recorded");
+}
+
+
+PYBIND11_MODULE(tipe, module)
+{
+    module.doc() = "N-body simulations of Engine.h, in double precision";
+
+    bindEngine<2>(module, "Engine2D");
+    bindEngine<3>(module, "Engine3D");
+
+    module.def("Engine", [](int dimension, const std::string& integrator, const std::string& force, double theta,
+                            double softening, size_t threads, const std::string& kernel) -> py::object {
+            EngineSettings settings;
+            if(!parseIntegrator(integrator, settings.integrator))
+                throw py::value_error("Unknown integrator " + integrator);
+            if(force != "direct" && force != "barneshut")
+                throw py::value_error("Unknown force " + force);
+            if(kernel != "simd" && kernel != "pairs")
+                throw py::value_error("Unknown kernel " + kernel);
+
+            settings.barnes_hut = (force == "barneshut");
+            settings.theta = theta;
+            settings.softening = softening;
+            settings.threads = threads;
+            settings.simd_kernel = (kernel == "simd");
+
+            if(dimension == 3)
+                return py::cast(new PyEngine<3>(settings), py::return_value_policy::take_ownership);
+            if(dimension == 2)
+                return py::cast(new PyEngine<2>(settings), py::return_value_policy::take_ownership);
+            throw py::value_error("The simulations are in 2D or 3D");
+        },
+        py::arg("dimension") = 2, py::arg("integrator") = "verlet", py::arg("force") = "direct", py::arg("theta") = 0.5,
+        py::arg("softening") = 0.0, py::arg("threads") = 1, py::arg("kernel") = "simd");
+}
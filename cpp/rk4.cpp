@@ -2,27 +2,38 @@
 //#include <string>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
 
 #include "Vector.h"
+#include "Constants.h"
 #include "Object.h"
-
-//////////  Constants
-
-/// @brief the constant of gravitation
-constexpr ldouble G = 6.67e-11;
-
-constexpr ldouble PI=3.141592653589793;
-
-
+#include "System.h"
+#include "Integrators.h"
+#include "BarnesHut.h"
+#include "ThreadPool.h"
+#include "Gravity.h"
+#include "Orbit.h"
+#include "Simulation.h"
+#include "Trajectory.h"
+#include "MappedTrajectory.h"
+#include "CompressedTrajectory.h"
+#include "StreamingWriter.h"
+#include "Decimation.h"
+#include "Checkpoint.h"
+#include "Diagnostics.h"
+#include "Profiler.h"
 
 ////////// Structures
 
+template<typename T>
 struct Object_kinematic_info
 {
-    Vec2<ldouble> position;
-    Vec2<ldouble> velocity;
+    Vec2<T> position;
+    Vec2<T> velocity;
 
-    Object_kinematic_info(const Vec2<ldouble>& pos, const Vec2<ldouble>& velo)
+    Object_kinematic_info(const Vec2<T>& pos, const Vec2<T>& velo)
     : position(pos), velocity(velo)
     {}
 };
@@ -31,140 +42,661 @@ struct Object_kinematic_info
 
 
 
-///////// Functions
 
 
+////// Command line
 
-void writeData(std::ofstream& file_stream, const std::vector<Vec2<ldouble>>& data) {
-    if(!file_stream.is_open())
+/// @brief options given as --name=value, anywhere on the command line
+struct Options
+{
+    std::string precision = "long";                     // float, double, long or quad
+    IntegratorType integrator = IntegratorType::Verlet;
+    bool adaptive = false;                              // --integrator=dopri5
+    ldouble rtol = 1e-9;
+    ldouble atol = 1e-3;
+    bool fixed_output = true;                           // --output=fixed|steps
+    bool barnes_hut = false;                            // --force=direct|barneshut
+    ldouble theta = 0.5;
+    size_t threads = 1;                                 // 0 for every core
+    bool simd_kernel = true;                            // --kernel=pairs|simd
+    ldouble softening = 0;                              // Plummer softening length in m
+    TrajectoryFormat format = TrajectoryFormat::Csv;    // --format=csv|bin|mmap|ctj
+    ldouble compression_tolerance = 0;                  // --compression-tolerance=m, 0 for a lossless --format=ctj
+    std::string decompress;                             // --decompress=path, compressed trajectory to write again
+    size_t stream_frames = 0;                           // --stream[=frames], 0 writes from the simulation thread
+    DecimationPolicy decimation;                        // --decimate=all|every:N|interval:s|curvature:tol
+    std::string ensemble;                               // --ensemble=table, one two-body simulation per line
+    bool ensemble_trajectories = false;                 // --ensemble-trajectories
+    int dimension = 2;                                  // --dimension=2|3, of the N-body systems
+    std::string checkpoint;                             // --checkpoint=path, "" for no checkpoint
+    double checkpoint_interval = 600;                   // --checkpoint-interval=seconds, of wall-clock time
+    std::string restart;                                // --restart=path, checkpoint to start from
+    size_t diagnostics = 0;                             // --diagnostics[=steps], 0 for none
+    ldouble timestep_tolerance = 0;                     // --timestep-tolerance=tol, 0 keeps the timestep given
+    std::string profile_json;                           // --profile-json=path, compiled with PROFILE
+    std::string profile_trace;                          // --profile-trace=path, Chrome trace of the phases
+};
+
+/// @brief extract the options from argv, the remaining arguments are moved to the front of argv
+bool parseOptions(int& argc, char** argv, Options& options)
+{
+    int nbArguments = 1;
+    for(int i = 1; i < argc; i++)
     {
-        std::runtime_error("The file cannot be opened !\n");
-        return;
+        const std::string argument(argv[i]);
+        if(argument.rfind("--", 0) != 0)
+        {
+            argv[nbArguments++] = argv[i];
+            continue;
+        }
+
+        const size_t equal = argument.find('=');
+        const std::string name = argument.substr(2, equal == std::string::npos ? std::string::npos : equal - 2);
+        const std::string value = equal == std::string::npos ? std::string() : argument.substr(equal + 1);
+
+        if(name == "precision")
+            options.precision = value;
+        else if(name == "integrator")
+        {
+            options.adaptive = (value == "dopri5");
+            if(!options.adaptive && !parseIntegrator(value, options.integrator))
+            {
+                std::cout << "Unknown integrator " << value << " !" << std::endl;
+                return false;
+            }
+        }
+        else if(name == "rtol")
+            options.rtol = strtold(value.c_str(), nullptr);
+        else if(name == "atol")
+            options.atol = strtold(value.c_str(), nullptr);
+        else if(name == "force" && (value == "direct" || value == "barneshut"))
+            options.barnes_hut = (value == "barneshut");
+        else if(name == "threads")
+            options.threads = strtoul(value.c_str(), nullptr, 10);
+        else if(name == "kernel" && (value == "pairs" || value == "simd"))
+            options.simd_kernel = (value == "simd");
+        else if(name == "softening")
+            options.softening = strtold(value.c_str(), nullptr);
+        else if(name == "stream")
+            options.stream_frames = value.empty() ? 1024 : strtoul(value.c_str(), nullptr, 10);
+        else if(name == "decimate")
+        {
+            if(!parseDecimationPolicy(value, options.decimation))
+            {
+                std::cout << "Unknown decimation " << value << " !" << std::endl;
+                return false;
+            }
+        }
+        else if(name == "ensemble" && !value.empty())
+            options.ensemble = value;
+        else if(name == "ensemble-trajectories")
+            options.ensemble_trajectories = true;
+        else if(name == "dimension" && (value == "2" || value == "3"))
+            options.dimension = (value == "3") ? 3 : 2;
+        else if(name == "theta")
+            options.theta = strtold(value.c_str(), nullptr);
+        else if(name == "format")
+        {
+            if(!parseTrajectoryFormat(value, options.format))
+            {
+                std::cout << "Unknown format " << value << " !" << std::endl;
+                return false;
+            }
+        }
+        else if(name == "compression-tolerance")
+            options.compression_tolerance = strtold(value.c_str(), nullptr);
+        else if(name == "decompress" && !value.empty())
+            options.decompress = value;
+        else if(name == "output" && (value == "fixed" || value == "steps"))
+            options.fixed_output = (value == "fixed");
+        else if(name == "checkpoint" && !value.empty())
+            options.checkpoint = value;
+        else if(name == "checkpoint-interval")
+            options.checkpoint_interval = strtod(value.c_str(), nullptr);
+        else if(name == "restart" && !value.empty())
+            options.restart = value;
+        else if(name == "diagnostics")
+            options.diagnostics = value.empty() ? 1000 : strtoul(value.c_str(), nullptr, 10);
+        else if(name == "timestep-tolerance")
+            options.timestep_tolerance = strtold(value.c_str(), nullptr);
+        else if(name == "profile-json" && !value.empty())
+            options.profile_json = value;
+        else if(name == "profile-trace" && !value.empty())
+            options.profile_trace = value;
+        else
+        {
+            std::cout << "Unknown option " << argument << " !" << std::endl;
+            return false;
+        }
     }
 
-    std::cout << "Starting writing data into the file\n";
+    argc = nbArguments;
+    return true;
+}
 
 
-    for(auto& pos : data)
+/// @brief extension of the trajectory files
+inline const char* trajectoryExtension(TrajectoryFormat format)
+{
+    switch(format)
     {
-        const ldouble x = pos.x;
-        const ldouble y = pos.y;
-
-        file_stream << std::to_string(x) << ';' << std::to_string(y) << '\n';
+        case TrajectoryFormat::Csv:         return ".log";
+        case TrajectoryFormat::Binary:      return ".bin";
+        case TrajectoryFormat::Mapped:      return ".bin";
+        case TrajectoryFormat::Compressed:  return ".ctj";
     }
+    return ".log";
+}
 
-    std::cout << "Data have been writen in the file" << std::endl;
+/// @brief file of the trajectory, or of the summaries of an ensemble (always text)
+inline std::string trajectoryPath(const Options& options)
+{
+    return std::string("simulation_data") + (options.ensemble.empty() ? trajectoryExtension(options.format) : ".log");
 }
 
-Vec2<ldouble> AttractionForce(const Object& source, const Object& target)
+/// @brief writer of the trajectory file at `path`, `stream` being this file opened
+///
+/// With --format=mmap the writer maps the file itself, nothing is written to the stream.
+template<typename T>
+std::unique_ptr<TrajectoryWriter<T>> openTrajectoryWriter(const Options& options, const std::string& path, std::ostream& stream)
 {
-    const Vec2<ldouble> deplacement_vector = source.GetCurrentPosition() - target.GetCurrentPosition();
-    const Vec2<ldouble> force = (G * source.mass * target.mass / deplacement_vector.Magnitude_squared()) * deplacement_vector.Normalised();
-    
-    return force;
+    if(options.format == TrajectoryFormat::Mapped)
+        return std::unique_ptr<TrajectoryWriter<T>>(new MappedTrajectoryWriter<T>(path));
+    if(options.format == TrajectoryFormat::Compressed)
+        return std::unique_ptr<TrajectoryWriter<T>>(new CompressedTrajectoryWriter<T>(stream, static_cast<T>(options.compression_tolerance)));
+
+    return makeTrajectoryWriter<T>(options.format, stream);
 }
 
-ldouble periode(ldouble a,ldouble masse_central){
-    return sqrt(4*PI*PI*a*a*a/(G*masse_central));
+
+/// @brief load the checkpoint given by --restart, if any
+template<typename T, int D>
+bool loadCheckpoint(const Options& options, Checkpointer<T, D>& checkpointer, size_t nbBodies, uint32_t integrator, T timestep,
+                    std::ofstream& file_stream)
+{
+    std::string error;
+    if(options.restart.empty() || checkpointer.Load(options.restart, nbBodies, integrator, timestep, error))
+        return true;
+
+    std::cout << "Can't restart : " << error << " !" << std::endl;
+    file_stream << "Error - Invalid checkpoint";
+    return false;
 }
 
-ldouble suite_psi(ldouble T,ldouble t,ldouble e,ldouble psi){
-    return -(psi-e*sin(psi)-2*PI*t/T)/(1-e*cos(psi))+psi;
+template<typename T, int D>
+void printCheckpoints(const Options& options, Checkpointer<T, D>& checkpointer)
+{
+    checkpointer.Finish();
+    if(!options.checkpoint.empty())
+        std::cout << "Checkpoints : " << checkpointer.GetWrittenCount() << " written in " << options.checkpoint
+                  << ", " << checkpointer.GetSkippedCount() << " skipped while the previous one was written\n";
 }
 
-ldouble newton(ldouble T,ldouble t,ldouble e,ldouble psi){
-    ldouble psi_precedent=psi;
-    ldouble psi_nouveau=psi+1;  //valeur arbitraire pour entrer dans la boucle
-    int i=0;
-    while(i<1000 && abs(psi_precedent-psi_nouveau)>0.00001){
-        psi_nouveau=suite_psi(T,t,e,psi_precedent);
-        i=i+1;
+
+////// Diagnostics
+
+/// @brief largest relative energy error over `duration` seconds integrated with the timestep dt, on a copy of the bodies
+template<typename T, int D, typename Force>
+T trialEnergyError(Bodies<T, D> bodies, const T dt, const T duration, const IntegratorType type, Force& force, Diagnostics<T, D>& diagnostics)
+{
+    Integrator<T, D> integrator(type);
+    const size_t nbSteps = std::max<size_t>(1, static_cast<size_t>(duration / dt));
+
+    diagnostics.Reset(1, nullptr);
+    diagnostics.Record(0, bodies, integrator, force);
+    for(size_t i = 0; i < nbSteps; i++)
+    {
+        diagnostics.Capture();
+        integrator.Step(bodies, dt, force);
+        diagnostics.Record((i + 1) * dt, bodies, integrator, force);
+    }
+    return diagnostics.GetMaxEnergyError();
+}
+
+/// @brief largest timestep among `timestep` times a power of 2 keeping the energy error under `tolerance`
+///
+/// The trials integrate the first 16th of the simulation, the error being measured after each step.
+/// The timestep is doubled while the error stays under the tolerance (and the trial has 64 steps
+/// at least), or halved until it does.
+template<typename T, int D, typename Force>
+T pickTimestep(const Bodies<T, D>& bodies, T timestep, const T duration, const IntegratorType type, const T tolerance,
+               Force& force, Diagnostics<T, D>& diagnostics)
+{
+    const T window = duration / 16;
+    std::cout << "Choosing the timestep, |dE/E| < " << tolerance << " over " << window << " s :\n";
+
+    const auto trial = [&](T dt) {
+        const T error = trialEnergyError(bodies, dt, window, type, force, diagnostics);
+        std::cout << "\ttimestep " << dt << " s : |dE/E| = " << error << "\n";
+        return error;
+    };
+
+    if(trial(timestep) <= tolerance)
+    {
+        while(2 * timestep * 64 <= window && trial(2 * timestep) <= tolerance)
+            timestep *= 2;
+    }
+    else
+    {
+        for(int halving = 0; halving < 30; halving++)
+        {
+            timestep /= 2;
+            if(trial(timestep) <= tolerance)
+                break;
+        }
     }
-    return psi_nouveau;
+
+    std::cout << "\ttimestep chosen : " << timestep << " s" << std::endl;
+    return timestep;
 }
 
-ldouble conv_psi_en_phi(ldouble e,ldouble psi){
-    return 2*atan(abs(tan(psi/2))*sqrt((1+e)/(1-e)));
+template<typename T, int D>
+void printDiagnostics(const Options& options, const Diagnostics<T, D>& diagnostics)
+{
+    if(options.diagnostics == 0)
+        return;
+
+    std::cout << "Diagnostics : " << diagnostics.GetRecordCount() << " records in diagnostics.log, max |dE/E| = " << diagnostics.GetMaxEnergyError()
+              << ", max |dL/L| = " << diagnostics.GetMaxAngularMomentumError();
+    if(diagnostics.GetInitial().eccentricity.Magnitude() != 0)
+        std::cout << ", periapsis turned by " << diagnostics.GetMaxPrecession() << " rad";
+    std::cout << "\n";
 }
 
-ldouble calcul_rayon(ldouble e,ldouble phi,ldouble p){
-    return p/(1+e*cos(phi));
+#ifdef PROFILE
+/// @brief print the time of each phase (compiled with PROFILE), and write it to the files of --profile-json and --profile-trace
+void printProfile(const Options& options)
+{
+    g_Profiler.Report(std::cout);
+
+    if(!options.profile_json.empty())
+    {
+        std::ofstream json(options.profile_json, std::fstream::trunc);
+        g_Profiler.WriteJson(json);
+        std::cout << "Profile written in " << options.profile_json << "\n";
+    }
+    if(!options.profile_trace.empty())
+    {
+        std::ofstream trace(options.profile_trace, std::fstream::trunc);
+        g_Profiler.WriteTrace(trace);
+        std::cout << "Trace of the phases written in " << options.profile_trace << "\n";
+    }
 }
+#else
+void printProfile(const Options&) {}
+#endif
+
+
+
+////// Compressed trajectories
+
+/// @brief write the frames of the compressed trajectory given by --decompress to `writer`
+///
+/// The frames are decoded a few blocks per thread at a time, so the memory does not depend on the length of the trajectory.
+template<typename T>
+int decompressTrajectory(const Options& options, TrajectoryWriter<T>& writer, std::ofstream& file_stream)
+{
+    CompressedTrajectoryReader<T> reader;
+    std::string error;
+    if(!reader.Open(options.decompress, error))
+    {
+        std::cout << "Can't decompress : " << error << " !" << std::endl;
+        file_stream << "Error - Invalid compressed trajectory";
+        return EXIT_FAILURE;
+    }
 
-void simu(ldouble r1,ldouble r2,ldouble masse_central,int nombre_iteration,ldouble pas, std::ofstream& file_stream){
-    ldouble a=(r1+r2)/2;
-    ldouble e= abs((r1-r2)/(r1+r2));
-    ldouble c=e*a;
-    ldouble b=sqrt(a*a - c*c);
-    ldouble p=b*b/a;
-    ldouble T=periode(a,masse_central);
-    ldouble psi;
-    ldouble phi;
-    ldouble rayon;
-    ldouble x,y;
-    std::vector<Vec2<ldouble>> polaire; //polaire(phi,rayon)
-    std::vector<Vec2<ldouble>> cartesien; //cartesien(x,y)
-
-    polaire.reserve(nombre_iteration);
-    cartesien.reserve(nombre_iteration);
-
-    constexpr int step = 1;
-    for(int i=0;i<nombre_iteration;i++){
-        psi=newton(T,i*pas,e,0);
-        phi=conv_psi_en_phi(e,psi);
-        rayon=calcul_rayon(e,phi,p);
-        polaire.push_back(Vec2<ldouble>(phi,rayon));
-        cartesien.push_back(Vec2<ldouble>(rayon*cos(phi),rayon*sin(phi)));
+    ThreadPool pool(options.threads);
+    const size_t nbFrames = reader.GetFrameCount();
+    const size_t nbBodies = reader.GetBodyCount();
+    const int dimension = reader.GetDimension();
+    const size_t frame_size = reader.GetFrameSize();
+    std::cout << "Decompressing " << nbFrames << " frames of " << nbBodies << " bodies on " << pool.Size() << " threads...\n";
+
+    const size_t batch = std::max<size_t>(1, std::min<size_t>(nbFrames, reader.GetHeader().block_frames * 4 * pool.Size()));
+    std::vector<T> frames(batch * frame_size);
+    std::vector<T> components[3];
+    const T* position[3];
+    for(int d = 0; d < dimension; d++)
+    {
+        components[d].resize(nbBodies);
+        position[d] = components[d].data();
     }
 
-    writeData(file_stream, cartesien);
+    for(size_t first = 0; first < nbFrames; first += batch)
+    {
+        const size_t count = std::min(batch, nbFrames - first);
+        if(!reader.ReadFrames(first, count, frames.data(), &pool))
+        {
+            std::cout << "Can't decode the frames from " << first << " !" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if(first == 0)
+            writer.Begin(nbBodies, dimension, reader.GetTimestep());
+
+        for(size_t k = 0; k < count; k++)
+        {
+            const T* frame = frames.data() + k * frame_size;
+            for(size_t i = 0; i < nbBodies; i++)
+                for(int d = 0; d < dimension; d++)
+                    components[d][i] = frame[1 + i * dimension + d];
+
+            writer.WriteFrame(frame[0], position, nbBodies);
+        }
+    }
+    if(nbFrames == 0)
+        writer.Begin(nbBodies, dimension, reader.GetTimestep());
+    writer.End();
+
+    std::cout << "Decompression finished.\n";
+    return EXIT_SUCCESS;
 }
 
 
-void simulation(const size_t nbIteration, const Object& source, Object& target, const ldouble dt, std::ofstream& file_stream)
+
+////// Ensemble
+
+/// @brief one line of an ensemble table, the same parameters as the two-body command line
+template<typename T>
+struct EnsembleCase
 {
-    // Using Euler method
-    std::cout << "Starting the simulation...\n";
-    for(size_t i = 0; i < nbIteration; i++)
+    T days;
+    T timestep;
+    T source_mass;
+    T mass;
+    Vec2<T> position = Vec2<T>(0, 0);
+    Vec2<T> velocity = Vec2<T>(0, 0);
+};
+
+/// @brief what is left of a simulation of the ensemble
+template<typename T>
+struct EnsembleSummary
+{
+    size_t steps = 0;
+    Vec2<T> position = Vec2<T>(0, 0);
+    Vec2<T> velocity = Vec2<T>(0, 0);
+    T r_min = 0;
+    T r_max = 0;
+    T energy_drift = 0;     // relative change of the specific orbital energy
+};
+
+/// @brief read the cases of an ensemble, one per line : "days timestep source_mass mass x y vx vy",
+/// lines starting with '#' are ignored
+template<typename T>
+bool loadEnsemble(const char* filepath, std::vector<EnsembleCase<T>>& cases)
+{
+    std::ifstream table_stream(filepath);
+    if(!table_stream.is_open())
+        return false;
+
+    std::string line;
+    while(std::getline(table_stream, line))
     {
-        const Vec2<ldouble> acceleration = AttractionForce(source, target) / target.mass;
+        if(line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream line_stream(line);
+        std::string fields[8];
+        for(std::string& field : fields)
+        {
+            if(!(line_stream >> field))
+                return false;
+        }
+
+        EnsembleCase<T> parameters;
+        parameters.days =           parseScalar<T>(fields[0].c_str());
+        parameters.timestep =       parseScalar<T>(fields[1].c_str());
+        parameters.source_mass =    parseScalar<T>(fields[2].c_str());
+        parameters.mass =           parseScalar<T>(fields[3].c_str());
+        parameters.position =       Vec2<T>(parseScalar<T>(fields[4].c_str()), parseScalar<T>(fields[5].c_str()));
+        parameters.velocity =       Vec2<T>(parseScalar<T>(fields[6].c_str()), parseScalar<T>(fields[7].c_str()));
+        cases.push_back(parameters);
+    }
 
-        Vec2<ldouble> velocity = target.GetCurrentVelocity() + acceleration * dt * static_cast<ldouble>(0.5f);
-        Vec2<ldouble> position = target.GetCurrentPosition() + velocity * dt;
-        
-        velocity += (dt * static_cast<ldouble>(0.5f)) * acceleration;
-        
+    return !cases.empty();
+}
 
-        target.Update_state(position, velocity);
+/// @brief the two-body simulation of one case, silently, the trajectory going to `writer` if not null
+///
+/// The planet and the forces are the same as with the two-body command line, so a case gives
+/// the same trajectory as the corresponding run of the program.
+template<typename T>
+EnsembleSummary<T> runEnsembleCase(const EnsembleCase<T>& parameters, const Options& options, TrajectoryWriter<T>* writer)
+{
+    const Vec2<T> source_position(0, 0);
+    const T mu = G<T> * parameters.source_mass;
+
+    Bodies<T> bodies;
+    bodies.AddBody(parameters.mass, parameters.position, parameters.velocity);
+
+    const auto force = [&parameters, &source_position](Bodies<T>& state) {
+        const Vec2<T> acceleration = AttractionForce(parameters.source_mass, source_position, state.mass[0], state.GetPosition(0)) / state.mass[0];
+        state.acc[0][0] = acceleration.x;
+        state.acc[1][0] = acceleration.y;
+    };
+
+    // distance to the source, at the origin
+    const auto radius = [](const Bodies<T>& state) {
+        const T x = state.pos[0][0], y = state.pos[1][0];
+        return sqrt(x*x + y*y);
+    };
+
+    // specific orbital energy
+    const auto energy = [mu, &radius](const Bodies<T>& state) {
+        const T vx = state.vel[0][0], vy = state.vel[1][0];
+        return (vx*vx + vy*vy) / 2 - mu / radius(state);
+    };
+
+    EnsembleSummary<T> summary;
+    const T initial_energy = energy(bodies);
+    summary.r_min = summary.r_max = radius(bodies);
+
+    const auto record = [&summary, &bodies, &radius, writer](T time) {
+        const T r = radius(bodies);
+        summary.r_min = std::min(summary.r_min, r);
+        summary.r_max = std::max(summary.r_max, r);
+        summary.steps++;
+        if(writer != nullptr)
+            writer->WriteFrame(time, bodies);
+    };
+
+    if(writer != nullptr)
+    {
+        writer->Begin(1, 2, parameters.timestep);
+        writer->WriteFrame(0, bodies);
+    }
+
+    const size_t nbIteration = static_cast<size_t>(parameters.days * 24 * 60 * 60 / parameters.timestep);
+    const T duration = nbIteration * parameters.timestep;
+
+    if(options.adaptive)
+    {
+        // one frame per accepted step
+        AdaptiveIntegrator<T> integrator(static_cast<T>(options.rtol), static_cast<T>(options.atol), parameters.timestep);
+        T t = 0;
+        while(t < duration)
+        {
+            const T dt = integrator.Step(bodies, duration - t, force, t);
+            t = (duration - t <= dt) ? duration : t + dt;
+            record(t);
+        }
+    }
+    else
+    {
+        Integrator<T> integrator(options.integrator);
+        for(size_t i = 0; i < nbIteration; i++)
+        {
+            integrator.Step(bodies, parameters.timestep, force);
+            record((i + 1) * parameters.timestep);
+        }
     }
-    std::cout << "Simulation finished.\n";
 
-    writeData(file_stream, target.GetPositionsArray());
+    if(writer != nullptr)
+        writer->End();
+
+    summary.position = bodies.GetPosition(0);
+    summary.velocity = bodies.GetVelocity(0);
+    summary.energy_drift = (energy(bodies) - initial_energy) / abs(initial_energy);
+    return summary;
 }
 
+/// @brief run every case of the table given by --ensemble on the threads of the pool
+///
+/// The cases are taken one after another by the threads as soon as they are free, their
+/// durations being different. One summary line per case is written to `file_stream`, in the
+/// order of the table, and with --ensemble-trajectories the trajectory of case i goes to
+/// ensemble_i.log (or .bin).
+template<typename T>
+int runEnsemble(const Options& options, std::ofstream& file_stream)
+{
+    std::vector<EnsembleCase<T>> cases;
+    if(!loadEnsemble(options.ensemble.c_str(), cases))
+    {
+        std::cout << "Can't read the ensemble from " << options.ensemble << " !" << std::endl;
+        file_stream << "Error - Invalid ensemble file";
+        return EXIT_FAILURE;
+    }
+
+    ThreadPool pool(options.threads);
+    std::cout << "Starting the simulation of " << cases.size() << " cases on " << pool.Size() << " threads ("
+              << (options.adaptive ? "dopri5" : integratorName(options.integrator)) << ")...\n";
+
+    std::vector<EnsembleSummary<T>> summaries(cases.size());
+    std::atomic<size_t> next_case(0);
+
+    pool.Run([&](size_t) {
+        for(size_t c = next_case++; c < cases.size(); c = next_case++)
+        {
+            if(!options.ensemble_trajectories)
+            {
+                summaries[c] = runEnsembleCase<T>(cases[c], options, nullptr);
+                continue;
+            }
+
+            const bool binary = (options.format != TrajectoryFormat::Csv);
+            const std::string filepath = "ensemble_" + std::to_string(c) + trajectoryExtension(options.format);
+            std::ofstream trajectory_stream(filepath, binary ? std::fstream::trunc | std::fstream::binary : std::fstream::trunc);
+
+            const std::unique_ptr<TrajectoryWriter<T>> file_writer = openTrajectoryWriter<T>(options, filepath, trajectory_stream);
+            DecimatingTrajectoryWriter<T> decimating_writer(*file_writer, options.decimation);
+            summaries[c] = runEnsembleCase(cases[c], options, &decimating_writer);
+        }
+    });
+
+    file_stream << "case;steps;x;y;vx;vy;r_min;r_max;energy_drift\n";
+    for(size_t c = 0; c < cases.size(); c++)
+    {
+        const EnsembleSummary<T>& summary = summaries[c];
+        file_stream << c << ';' << summary.steps << ';'
+                    << toString(summary.position.x) << ';' << toString(summary.position.y) << ';'
+                    << toString(summary.velocity.x) << ';' << toString(summary.velocity.y) << ';'
+                    << toString(summary.r_min) << ';' << toString(summary.r_max) << ';'
+                    << summary.energy_drift << '\n';
+    }
+
+    std::cout << "Simulation finished.\n";
+    return EXIT_SUCCESS;
+}
 
 
+/// @brief N-body simulation of the system read from argv[3], in D dimensions
+template<typename T, int D>
+int runSystem(char** argv, const Options& options, TrajectoryWriter<T>& writer, std::ofstream& file_stream)
+{
+    T timestep = parseScalar<T>(argv[2]);           // timestep of the simulation
+    const T duration = parseScalar<T>(argv[1]) * 24 * 60 * 60;
 
+    Bodies<T, D> bodies;
+    if(!loadSystem(argv[3], bodies))
+    {
+        std::cout << "Can't read the bodies from " << argv[3] << " !" << std::endl;
+        file_stream << "Error - Invalid bodies file";
+        return EXIT_FAILURE;
+    }
 
+    std::cout << "\tnumber of bodies : " << bodies.Size() << " (" << D << "D)" << std::endl;
 
+    ThreadPool pool(options.threads);
+    std::cout << "\tthreads : " << pool.Size() << std::endl;
 
-////// Entry point
+    // the SIMD kernel computes every pair twice, only worth it with SIMD registers
+    const bool simd = options.simd_kernel && (std::is_same<T, float>::value || std::is_same<T, double>::value);
+    if(!options.barnes_hut)
+        std::cout << "\tkernel : " << (simd ? simdLevelName(detectSimdLevel()) : "pairs") << std::endl;
 
-#ifndef TESTS
-int main(int argc, char** argv) {
+    BarnesHutTree<T, D> tree(static_cast<T>(options.theta), static_cast<T>(options.softening));
+    ParallelDirectForce<T, D> direct(pool, simd ? DirectKernel::Simd : DirectKernel::Pairs, static_cast<T>(options.softening));
 
-    std::cout << "Starting the program ... \n";
-    const char* filepath = "simulation_data.log";
+    // the force evaluations give the potential of the bodies when the diagnostics need it
+    std::ofstream diagnostics_stream;
+    if(options.diagnostics != 0)
+        diagnostics_stream.open("diagnostics.log", std::fstream::trunc);
+    Diagnostics<T, D> diagnostics(options.diagnostics, 0, &diagnostics_stream);
 
-    std::ofstream file_stream(filepath, std::fstream::trunc);
+    const auto force = [&options, &tree, &direct, &pool, &diagnostics](Bodies<T, D>& state) {
+        T* const potential = diagnostics.Potential(state.Size());
+        if(options.barnes_hut)
+            tree.ComputeAccelerations(state, &pool, potential);
+        else
+            direct(state, potential);
+    };
 
-    if(!file_stream.is_open())
+    if(options.timestep_tolerance > 0 && !options.adaptive)
     {
-        std::cout << "Can't open " << filepath << " !\nData have not been generated!" << std::endl;
+        timestep = pickTimestep(bodies, timestep, duration, options.integrator, static_cast<T>(options.timestep_tolerance), force, diagnostics);
+        diagnostics.Reset(options.diagnostics, &diagnostics_stream);
+    }
+
+    const uint nbIteration = duration / timestep;
+    std::cout << "\tNbIteration : " << nbIteration;
+    std::cout << "\n\ttimestep : " << timestep << std::endl;
+
+    Checkpointer<T, D> checkpointer(options.checkpoint, options.checkpoint_interval, &file_stream);
+    const uint32_t integrator_code = options.adaptive ? CheckpointDopri5 : checkpointIntegrator(options.integrator);
+    if(!loadCheckpoint(options, checkpointer, bodies.Size(), integrator_code, timestep, file_stream))
         return EXIT_FAILURE;
+
+    if(options.adaptive)
+    {
+        AdaptiveIntegrator<T, D> integrator(options.rtol, options.atol, timestep);
+        simulation(nbIteration * timestep, timestep, options.fixed_output, bodies, integrator, force, writer, &checkpointer,
+                   options.diagnostics != 0 ? &diagnostics : nullptr);
+    }
+    else
+    {
+        Integrator<T, D> integrator(options.integrator);
+        simulation(nbIteration, bodies, timestep, integrator, force, writer, &checkpointer, options.diagnostics != 0 ? &diagnostics : nullptr);
     }
-    std::cout << filepath << " is open\n";
 
+    printCheckpoints(options, checkpointer);
+    printDiagnostics(options, diagnostics);
+    return EXIT_SUCCESS;
+}
+
+
+/// @brief run the simulation asked by the positional arguments, with T as scalar type
+template<typename T>
+int run(int argc, char** argv, const Options& options, std::ofstream& file_stream)
+{
+    std::cout << "Scalar type : " << scalarName<T>() << "\n";
+
+    if(!options.ensemble.empty())
+        return runEnsemble<T>(options, file_stream);
+
+    // with --stream, the frames are formatted and written by a background thread
+    const std::unique_ptr<TrajectoryWriter<T>> file_writer = openTrajectoryWriter<T>(options, trajectoryPath(options), file_stream);
+    std::unique_ptr<StreamingTrajectoryWriter<T>> streaming_writer;
+    if(options.stream_frames != 0)
+        streaming_writer.reset(new StreamingTrajectoryWriter<T>(*file_writer, options.stream_frames));
+
+    TrajectoryWriter<T>& output_writer = streaming_writer ? *streaming_writer : *file_writer;
+
+    // the frames not needed are dropped before being copied or formatted
+    DecimatingTrajectoryWriter<T> decimating_writer(output_writer, options.decimation);
+    TrajectoryWriter<T>& writer = options.decimation.type == DecimationType::All ? output_writer : decimating_writer;
+
+    if(!options.decompress.empty())
+        return decompressTrajectory<T>(options, writer, file_stream);
 
     if(argc == 9)
     {
@@ -185,19 +717,41 @@ int main(int argc, char** argv) {
         
         std::cout << "Initialising variables\n";
 
-        char* _stopstring;
-
-        const ldouble timestep =    strtold(argv[2], &_stopstring);     // timestep of the simulation
-        const ldouble m_sun =       strtold(argv[3], &_stopstring);     // mass of the sun in kg
-        const ldouble m =           strtold(argv[4], &_stopstring);     // mass of the moving planet in kg
-        const Vec2<ldouble> initial_position (
-                                    strtold(argv[5], &_stopstring),     // initial x position
-                                    strtold(argv[6], &_stopstring));    // initial y position
-        const Vec2<ldouble> initial_speed (
-                                    strtold(argv[7], &_stopstring),     // initial x speed
-                                    strtold(argv[8], &_stopstring));    // initial y speed
-        
-        const uint nbIteration = (strtold(argv[1], &_stopstring) * 24 * 60 * 60) / timestep;
+        T timestep =                parseScalar<T>(argv[2]);     // timestep of the simulation
+        const T m_sun =             parseScalar<T>(argv[3]);     // mass of the sun in kg
+        const T m =                 parseScalar<T>(argv[4]);     // mass of the moving planet in kg
+        const Vec2<T> initial_position (
+                                    parseScalar<T>(argv[5]),     // initial x position
+                                    parseScalar<T>(argv[6]));    // initial y position
+        const Vec2<T> initial_speed (
+                                    parseScalar<T>(argv[7]),     // initial x speed
+                                    parseScalar<T>(argv[8]));    // initial y speed
+        const T duration =          parseScalar<T>(argv[1]) * 24 * 60 * 60;
+
+        // the planet is integrated alone, the sun does not move
+        Object<T> sun(m_sun, Vec2<T>(0, 0), Vec2<T>(0,0));
+        Bodies<T> bodies;
+        bodies.AddBody(m, initial_position, initial_speed);
+
+        const auto force = [&sun](Bodies<T>& state) {
+            profileCount(Counter::Interactions, 1);
+            const Vec2<T> acceleration = AttractionForce(sun.mass, sun.GetCurrentPosition(), state.mass[0], state.GetPosition(0)) / state.mass[0];
+            state.acc[0][0] = acceleration.x;
+            state.acc[1][0] = acceleration.y;
+        };
+
+        std::ofstream diagnostics_stream;
+        if(options.diagnostics != 0)
+            diagnostics_stream.open("diagnostics.log", std::fstream::trunc);
+        Diagnostics<T, 2> diagnostics(options.diagnostics, m_sun, &diagnostics_stream);
+
+        if(options.timestep_tolerance > 0 && !options.adaptive)
+        {
+            timestep = pickTimestep(bodies, timestep, duration, options.integrator, static_cast<T>(options.timestep_tolerance), force, diagnostics);
+            diagnostics.Reset(options.diagnostics, &diagnostics_stream);
+        }
+
+        const uint nbIteration = duration / timestep;
 
         std::cout << "All variables have been initialised :" << std::endl;
         std::cout << "\tNbIteration : " << nbIteration;
@@ -208,10 +762,28 @@ int main(int argc, char** argv) {
         std::cout << "\n\tinitial velocity : " << initial_speed << std::endl;
 
 
-        Object planet(m, initial_position, initial_speed, nbIteration);
-        Object sun(m_sun, Vec2<ldouble>(0, 0), Vec2<ldouble>(0,0), nbIteration);
-
-        simulation(nbIteration, sun, planet, timestep, file_stream);
+        // the frames are written as they are computed, the objects don't keep their history
+        Object<T> planet(m, initial_position, initial_speed);
+
+        Checkpointer<T, 2> checkpointer(options.checkpoint, options.checkpoint_interval, &file_stream);
+        const uint32_t integrator_code = options.adaptive ? CheckpointDopri5 : checkpointIntegrator(options.integrator);
+        if(!loadCheckpoint(options, checkpointer, size_t(1), integrator_code, timestep, file_stream))
+            return EXIT_FAILURE;
+
+        Diagnostics<T, 2>* const recorded = options.diagnostics != 0 ? &diagnostics : nullptr;
+        if(options.adaptive)
+        {
+            AdaptiveIntegrator<T> integrator(options.rtol, options.atol, timestep);
+            simulation(nbIteration * timestep, timestep, options.fixed_output, bodies, integrator, force, writer, &checkpointer, recorded);
+        }
+        else
+        {
+            Integrator<T> integrator(options.integrator);
+            simulation(nbIteration, sun, planet, timestep, integrator, writer, &checkpointer, recorded);
+        }
+
+        printCheckpoints(options, checkpointer);
+        printDiagnostics(options, diagnostics);
     }
     else if(argc == 6)
     {
@@ -228,31 +800,194 @@ int main(int argc, char** argv) {
         * 
         * */
 
-        char* _stopstring;
-
-        const ldouble pas =                 strtold(argv[2], &_stopstring);     // timestep of the simulation
-        const ldouble masse_central =       strtold(argv[3], &_stopstring);     // mass of the sun in kg
-        const ldouble r1 =                  strtold(argv[4], &_stopstring);     // Rayon dbt
-        const ldouble r2 =                  strtold(argv[5], &_stopstring);     // Rayon fin
+        const T pas =                 parseScalar<T>(argv[2]);     // timestep of the simulation
+        const T masse_central =       parseScalar<T>(argv[3]);     // mass of the sun in kg
+        const T r1 =                  parseScalar<T>(argv[4]);     // Rayon dbt
+        const T r2 =                  parseScalar<T>(argv[5]);     // Rayon fin
         
-        const uint nombre_iteration = (strtold(argv[1], &_stopstring) * 24 * 60 * 60) / pas;
+        const uint nombre_iteration = (parseScalar<T>(argv[1]) * 24 * 60 * 60) / pas;
+
 
+        ThreadPool pool(options.threads);
+        std::cout << "\tthreads : " << pool.Size() << std::endl;
 
-        simu(r1, r2, masse_central, nombre_iteration, pas, file_stream);
+        simu<T>(r1, r2, masse_central, nombre_iteration, pas, writer, pool);
+
+    }
+    else if(argc == 4)
+    {
+        /*
+        * Argv :
+        *   0) name of the command
+        *   1) Nombre de jours à simuler
+        *   2) timestep in second
+        *   3) fichier des corps (une ligne par corps : masse x y vx vy, ou masse x y z vx vy vz avec --dimension=3)
+        * 
+        * */
 
+        if(options.dimension == 3)
+            return runSystem<T, 3>(argv, options, writer, file_stream);
+        return runSystem<T, 2>(argv, options, writer, file_stream);
     }
     else
     {
         // errors, there should have been more parameters send to the program
         std::cout << "Not enough data have been sended to the program !" << std::endl;
         file_stream << "Error - Not enough data";
-        file_stream.close();
         return EXIT_FAILURE;
     }
-    
 
-    file_stream.close();
     return EXIT_SUCCESS;
 }
 
+
+
+
+
+////// Entry point
+
+#ifndef TESTS
+int main(int argc, char** argv) {
+
+    std::cout << "Starting the program ... \n";
+
+    /*
+    * Options :
+    *   --precision=float|double|long|quad      scalar type of the simulation (long double by default,
+    *                                           quad needs to be compiled with -DUSE_QUAD -lquadmath)
+    *   --integrator=euler|verlet|rk4|yoshida4  integration scheme of the simulations (verlet by default)
+    *   --integrator=dopri5                     adaptive timestep, the timestep argument is the first trial step
+    *       --rtol=1e-9 --atol=1e-3             tolerances on each position (m) and velocity (m/s) component
+    *       --output=fixed|steps                one frame every timestep (interpolated) or at each accepted step
+    *   --force=direct|barneshut                N-body accelerations by direct summation (default) or quadtree (octree in 3D)
+    *       --theta=0.5                         opening angle of the quadtree, smaller is more accurate
+    *   --threads=1                             threads computing the N-body accelerations or the analytic orbit, 0 for every core
+    *   --kernel=simd|pairs                     direct summation in SIMD registers (float and double only, default)
+    *                                           or each pair once with Newton's third law
+    *   --softening=0                           Plummer softening length of the N-body interactions in m
+    *   --stream[=1024]                         write the frames from a background thread, through a ring of 1024 frames
+    *   --decimate=all|every:N|interval:s|curvature:tol
+    *                                           frames written : all of them (default), one every N steps, the first
+    *                                           after every s seconds, or when a body has turned enough for a straight
+    *                                           line between two frames to be off by more than tol times its length
+    *   --ensemble=table                        one two-body simulation per line of the table ("days timestep
+    *                                           source_mass mass x y vx vy"), shared between the --threads, with
+    *                                           one summary line per case in simulation_data.log
+    *       --ensemble-trajectories             also write the trajectory of case i to ensemble_i.log (or .bin)
+    *   --dimension=2|3                         N-body systems in the plane (default) or in space, the bodies file
+    *                                           then giving "mass x y z vx vy vz"
+    *   --format=csv|bin|mmap                   "x0;y0;x1;y1..." lines in simulation_data.log (default) or
+    *                                           binary frames in simulation_data.bin (see Trajectory.h), mmap writing
+    *                                           them through a memory mapping of the file, which can be read while
+    *                                           the simulation runs (see MappedTrajectory.h)
+    *   --format=ctj                            frames predicted from the previous ones, only the difference being
+    *                                           stored, in blocks, in simulation_data.ctj (see CompressedTrajectory.h)
+    *       --compression-tolerance=0           largest error on the positions in m, 0 for a lossless compression
+    *   --decompress=path                       write the frames of the compressed trajectory in path (from
+    *                                           --precision, the blocks decoded by the --threads) in the --format given
+    *   --checkpoint=path                       save the state of the simulation in path, written by a background thread
+    *       --checkpoint-interval=600           wall-clock seconds between two checkpoints
+    *   --restart=path                          go on from the checkpoint in path, with the same arguments and options :
+    *                                           the trajectory is cut back to the frames of the checkpoint and continued
+    *   --diagnostics[=1000]                    energy, angular momentum and eccentricity vector every 1000 steps
+    *                                           in diagnostics.log, with their drift since the start
+    *   --timestep-tolerance=tol                largest timestep (the one given times a power of 2) keeping the relative
+    *                                           energy error under tol over the first 16th of the simulation
+    *   --profile-json=path                     with rk4 compiled with PROFILE (cmake -DPROFILE=ON), the time of each
+    *                                           phase of the steps is printed at the end, and written in path as JSON
+    *   --profile-trace=path                    every phase timed, thread by thread, in the Chrome trace format
+    * */
+    Options options;
+    if(!parseOptions(argc, argv, options))
+        return EXIT_FAILURE;
+
+    if(!profiling() && (!options.profile_json.empty() || !options.profile_trace.empty()))
+    {
+        std::cout << "The phases are only timed when compiled with PROFILE !" << std::endl;
+        return EXIT_FAILURE;
+    }
+#ifdef PROFILE
+    if(!options.profile_trace.empty())
+        g_Profiler.EnableTrace();
+#endif
+
+    // the summaries of an ensemble are always text
+    const bool binary = (options.format != TrajectoryFormat::Csv) && options.ensemble.empty();
+    const std::string filepath = trajectoryPath(options);
+
+    // only the simulations integrated step by step can be checkpointed
+    const bool restart = !options.restart.empty();
+    if((restart || !options.checkpoint.empty()) && (!options.ensemble.empty() || argc == 6))
+    {
+        std::cout << "The ensembles and the analytic orbits can't be checkpointed !" << std::endl;
+        return EXIT_FAILURE;
+    }
+    if((restart || !options.checkpoint.empty()) && (options.format == TrajectoryFormat::Mapped || options.format == TrajectoryFormat::Compressed))
+    {
+        std::cout << "The memory-mapped and the compressed trajectories can't be checkpointed !" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // a restart keeps the frames written before the checkpoint, and appends the next ones
+    CheckpointHeader checkpoint_header;
+    if(restart)
+    {
+        std::error_code error;
+        if(!readCheckpointHeader(options.restart, checkpoint_header))
+        {
+            std::cout << "Can't read the checkpoint " << options.restart << " !" << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::filesystem::resize_file(filepath, checkpoint_header.output_size, error);
+        if(error)
+        {
+            std::cout << "Can't cut " << filepath << " back to the checkpoint : " << error.message() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    const std::ios::openmode mode = (restart ? std::fstream::in : std::fstream::trunc) | (binary ? std::fstream::binary : std::ios::openmode());
+    std::ofstream file_stream(filepath, mode);
+    if(restart)
+        file_stream.seekp(0, std::ios::end);
+
+    if(!file_stream.is_open())
+    {
+        std::cout << "Can't open " << filepath << " !\nData have not been generated!" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << filepath << " is open\n";
+
+    // a step that can't be made (AdaptiveIntegrator) or a file that can't be grown (MappedTrajectory.h) stops the simulation
+    int result = EXIT_FAILURE;
+    try
+    {
+        if(options.precision == "float")
+            result = run<float>(argc, argv, options, file_stream);
+        else if(options.precision == "double")
+            result = run<double>(argc, argv, options, file_stream);
+        else if(options.precision == "long")
+            result = run<ldouble>(argc, argv, options, file_stream);
+#ifdef USE_QUAD
+        else if(options.precision == "quad")
+            result = run<quad>(argc, argv, options, file_stream);
+#endif
+        else
+        {
+            std::cout << "Unknown precision " << options.precision << " !" << std::endl;
+            file_stream << "Error - Unknown precision";
+        }
+    }
+    catch(const std::exception& error)
+    {
+        std::cout << "\nThe simulation stopped : " << error.what() << " !" << std::endl;
+        result = EXIT_FAILURE;
+    }
+
+    file_stream.close();
+    if(result == EXIT_SUCCESS)
+        printProfile(options);
+    return result;
+}
+
 #endif
\ No newline at end of file
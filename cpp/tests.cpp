@@ -3,9 +3,741 @@
 
 
 #include <cassert>
+#include <cstdio>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+
+
+////// Checks
+//
+//  assert is compiled out of the Release build : the checks count their failures instead,
+//  and the program fails (for ctest) if one of them did.
+
+static int g_Failures = 0;
+
+inline void check(bool condition, const char* expression, const char* file, int line)
+{
+    if(condition)
+        return;
+
+    std::cout << file << ":" << line << " : check failed : " << expression << std::endl;
+    g_Failures++;
+}
+
+#define CHECK(condition) check((condition), #condition, __FILE__, __LINE__)
+
+
+template<typename T, int D>
+VecD<T, D> vector(T x, T y, T z = 0)
+{
+    if constexpr(D == 3)
+        return VecD<T, D>(x, y, z);
+    else
+        return VecD<T, D>(x, y);
+}
+
+/// @brief sun and earth on a circular orbit
+template<typename T, int D = 2>
+Bodies<T, D> sunAndEarth()
+{
+    Bodies<T, D> bodies;
+    bodies.AddBody(T(1.9891e30), vector<T, D>(0, 0), vector<T, D>(0, 0));
+    bodies.AddBody(T(5.9722e24), vector<T, D>(T(1.496e11), 0), vector<T, D>(0, T(29780)));
+    return bodies;
+}
+
+/// @brief n bodies of random masses, positions and velocities, the same for a given seed
+template<typename T, int D = 2>
+Bodies<T, D> randomBodies(size_t n, unsigned seed = 1)
+{
+    std::mt19937 generator(seed);
+    std::uniform_real_distribution<double> mass(1e22, 1e25), coordinate(-1e11, 1e11), speed(-1e4, 1e4);
+
+    Bodies<T, D> bodies;
+    for(size_t i = 0; i < n; i++)
+    {
+        const T m = T(mass(generator));
+        const T x = T(coordinate(generator)), y = T(coordinate(generator)), z = T(coordinate(generator));
+        const T vx = T(speed(generator)), vy = T(speed(generator)), vz = T(speed(generator));
+        bodies.AddBody(m, vector<T, D>(x, y, z), vector<T, D>(vx, vy, vz));
+    }
+    return bodies;
+}
+
+template<typename T, int D>
+T totalEnergy(Bodies<T, D> bodies)
+{
+    std::vector<T> potential(bodies.Size());
+    ComputeAccelerations(bodies, T(0), potential.data());
+
+    T energy = 0;
+    for(size_t i = 0; i < bodies.Size(); i++)
+        energy += bodies.mass[i] * (bodies.GetVelocity(i).Magnitude_squared() / 2 + potential[i] / 2);
+    return energy;
+}
+
+/// @brief largest |a - b| over the accelerations of the bodies, relative to the mean |b|
+/// (the acceleration of a body can nearly cancel out)
+template<typename T, int D>
+T accelerationError(const Bodies<T, D>& a, const Bodies<T, D>& b)
+{
+    T error = 0, mean = 0;
+    for(size_t i = 0; i < a.Size(); i++)
+    {
+        error = std::max(error, (a.GetAcceleration(i) - b.GetAcceleration(i)).Magnitude());
+        mean += b.GetAcceleration(i).Magnitude() / a.Size();
+    }
+    return error / mean;
+}
+
+/// @brief largest |a - b| over the potentials of the bodies, relative to the mean |b|
+template<typename T>
+T potentialError(const std::vector<T>& a, const std::vector<T>& b)
+{
+    T error = 0, mean = 0;
+    for(size_t i = 0; i < a.size(); i++)
+    {
+        error = std::max(error, std::abs(a[i] - b[i]));
+        mean += std::abs(b[i]) / a.size();
+    }
+    return error / mean;
+}
+
+/// @brief softened accelerations and potentials of every SIMD level of this CPU against the pairs kernel
+template<typename T, int D>
+void checkSoftenedKernels(size_t n, T softening, T tolerance)
+{
+    Bodies<T, D> reference = randomBodies<T, D>(n);
+    std::vector<T> reference_potential(n);
+    ComputeAccelerations(reference, softening * softening, reference_potential.data());
+
+    const SimdLevel detected = detectSimdLevel();
+    for(SimdLevel level : { SimdLevel::Portable, SimdLevel::AVX2, SimdLevel::AVX512 })
+    {
+        if(level > detected)
+            break;
+
+        Bodies<T, D> bodies = reference;
+        std::vector<T> potential(n);
+        const T* pos[D];
+        T* acc[D];
+        for(int d = 0; d < D; d++)
+        {
+            pos[d] = bodies.pos[d].data();
+            acc[d] = bodies.acc[d].data();
+        }
+        gravityRows(level, pos, bodies.mass.data(), n, G<T>, softening * softening, 0, n, acc, potential.data());
+
+        CHECK(accelerationError(bodies, reference) < tolerance);
+        CHECK(potentialError(potential, reference_potential) < tolerance);
+    }
+}
+
+
+/// @brief frames [t, x0, y0, x1, ...] of n random bodies over nbFrames steps of dt
+std::vector<double> orbitFrames(size_t n, size_t nbFrames, double dt)
+{
+    Bodies<double> bodies = randomBodies<double>(n);
+    Integrator<double> integrator(IntegratorType::Verlet);
+    const auto force = [](Bodies<double>& state) { ComputeAccelerations(state); };
+
+    std::vector<double> frames;
+    for(size_t k = 0; k < nbFrames; k++)
+    {
+        frames.push_back(k * dt);
+        for(size_t i = 0; i < n; i++)
+            for(int d = 0; d < 2; d++)
+                frames.push_back(bodies.pos[d][i]);
+        integrator.Step(bodies, dt, force);
+    }
+    return frames;
+}
+
+/// @brief the frames written to `path` by a CompressedTrajectoryWriter
+void writeCompressed(const std::string& path, const std::vector<double>& frames, size_t n, double dt, double tolerance, size_t block_frames)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    CompressedTrajectoryWriter<double> writer(file, tolerance, block_frames);
+    writer.Begin(n, 2, dt);
+
+    const size_t frame_size = 1 + 2 * n;
+    for(size_t k = 0; k < frames.size() / frame_size; k++)
+    {
+        std::vector<double> x(n), y(n);
+        for(size_t i = 0; i < n; i++)
+        {
+            x[i] = frames[k * frame_size + 1 + 2 * i];
+            y[i] = frames[k * frame_size + 2 + 2 * i];
+        }
+        const double* components[2] = { x.data(), y.data() };
+        writer.WriteFrame(frames[k * frame_size], components, n);
+    }
+    writer.End();
+}
+
+/// @brief the whole file at `path`
+std::string readFile(const std::string& path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    return std::string((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+}
+
+
+////// Engine
+
+void testIntegrators()
+{
+    const double dt = 3600;
+    const size_t nbSteps = 365 * 24;
+    const auto force = [](Bodies<double>& bodies) { ComputeAccelerations(bodies); };
+
+    for(IntegratorType type : { IntegratorType::Verlet, IntegratorType::RK4, IntegratorType::Yoshida4 })
+    {
+        Bodies<double> bodies = sunAndEarth<double>();
+        const double initial = totalEnergy(bodies);
+        const Vec2<double> start = bodies.GetPosition(1) - bodies.GetPosition(0);
+
+        Integrator<double> integrator(type);
+        for(size_t i = 0; i < nbSteps; i++)
+            integrator.Step(bodies, dt, force);
+
+        // 365 days : a quarter of a day short of the orbit
+        const Vec2<double> end = bodies.GetPosition(1) - bodies.GetPosition(0);
+        CHECK(abs(totalEnergy(bodies) - initial) / abs(initial) < 1e-6);
+        CHECK((end - start).Magnitude() / start.Magnitude() < 1e-2);
+    }
+}
+
+void testAdaptiveIntegrator()
+{
+    Bodies<double> bodies = sunAndEarth<double>();
+    const double initial = totalEnergy(bodies);
+    const auto force = [](Bodies<double>& state) { ComputeAccelerations(state); };
+
+    AdaptiveIntegrator<double> integrator(1e-10, 1e-3, 3600);
+    const double duration = 365.0 * 24 * 3600;
+    double t = 0;
+    while(t < duration)
+        t += integrator.Step(bodies, duration - t, force, t);
+
+    CHECK(abs(totalEnergy(bodies) - initial) / abs(initial) < 1e-7);
+    CHECK(integrator.GetAcceptedSteps() > 10);
+
+    // two bodies at the same place : infinite accelerations
+    Bodies<double> collision = sunAndEarth<double>();
+    collision.pos[0][1] = collision.pos[1][1] = 0;
+    AdaptiveIntegrator<double> stopped(1e-10, 1e-3, 3600);
+    bool thrown = false;
+    try { stopped.Step(collision, 3600, force, 0.0); }
+    catch(const std::runtime_error&) { thrown = true; }
+    CHECK(thrown);
+
+    // accelerations changing sign at each evaluation : no timestep is small enough
+    size_t evaluations = 0;
+    const auto noise = [&evaluations](Bodies<double>& state) {
+        const double a = (evaluations++ % 2 == 0) ? 1e20 : -1e20;
+        for(size_t i = 0; i < state.Size(); i++)
+            state.acc[0][i] = state.acc[1][i] = a;
+    };
+    Bodies<double> noisy = sunAndEarth<double>();
+    AdaptiveIntegrator<double> shrinking(1e-10, 1e-3, 3600);
+    thrown = false;
+    try { shrinking.Step(noisy, 3600, noise, 1e9); }
+    catch(const std::runtime_error&) { thrown = true; }
+    CHECK(thrown && shrinking.GetRejectedSteps() > 10);
+}
+
+void testForces()
+{
+    Bodies<double> reference = randomBodies<double>(300);
+    ComputeAccelerations(reference);
+
+    // theta = 0 opens every cell : the direct summation
+    Bodies<double> bodies = randomBodies<double>(300);
+    BarnesHutTree<double> exact(0);
+    exact.ComputeAccelerations(bodies);
+    CHECK(accelerationError(bodies, reference) < 1e-9);
+
+    BarnesHutTree<double> tree(0.5);
+    tree.ComputeAccelerations(bodies);
+    CHECK(accelerationError(bodies, reference) < 5e-2);
+
+    ThreadPool pool(4);
+    for(DirectKernel kernel : { DirectKernel::Pairs, DirectKernel::Simd })
+    {
+        ParallelDirectForce<double> direct(pool, kernel);
+        direct(bodies);
+        CHECK(accelerationError(bodies, reference) < 1e-10);
+    }
+
+    // with a softening the body itself is at the distance eps : it must still be skipped.
+    // 301 bodies so the rows also end with bodies that don't fill a register
+    checkSoftenedKernels<double, 2>(301, 1e9, 1e-10);
+    checkSoftenedKernels<double, 3>(301, 1e9, 1e-10);
+    checkSoftenedKernels<float, 2>(301, 1e9f, 1e-3f);
+
+    Bodies<double, 3> space = randomBodies<double, 3>(200);
+    Bodies<double, 3> space_reference = space;
+    ComputeAccelerations(space_reference);
+    BarnesHutTree<double, 3> octree(0);
+    octree.ComputeAccelerations(space, &pool);
+    CHECK(accelerationError(space, space_reference) < 1e-9);
+}
+
+
+////// Trajectories
+
+void testBinaryTrajectory()
+{
+    const Bodies<double> bodies = randomBodies<double>(3);
+    std::ostringstream stream;
+
+    BinaryTrajectoryWriter<double> writer(stream);
+    writer.Begin(bodies.Size(), 2, 60);
+    for(int k = 0; k < 4; k++)
+        writer.WriteFrame(60 * k, bodies);
+    writer.End();
+
+    const std::string file = stream.str();
+    CHECK(file.size() == sizeof(TrajectoryHeader) + 4 * (1 + 2 * 3) * sizeof(double));
+
+    TrajectoryHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    CHECK(std::memcmp(header.magic, "TIPETRAJ", 8) == 0);
+    CHECK(header.nb_frames == 4 && header.nb_bodies == 3 && header.dimension == 2 && header.timestep == 60);
+
+    // frame 3 : [t, x0, y0, x1, ...]
+    double frame[1 + 2 * 3];
+    std::memcpy(frame, file.data() + sizeof(TrajectoryHeader) + 3 * sizeof(frame), sizeof(frame));
+    CHECK(frame[0] == 180);
+    CHECK(frame[1 + 2 * 2 + 1] == bodies.pos[1][2]);
+}
+
+
+void testMappedTrajectory()
+{
+    const Bodies<double> bodies = randomBodies<double>(3);
+    const double* position[2] = { bodies.pos[0].data(), bodies.pos[1].data() };
+    const std::string path = "tests_trajectory.bin";
+    std::string error;
+
+    // followed while it is written : no frame in the zeros of the chunk, even before the first one
+    {
+        MappedTrajectoryWriter<double> writer(path);
+        writer.Begin(bodies.Size(), 2, 60);
+        MappedTrajectoryReader<double> reader;
+        CHECK(reader.Open(path, error));
+        CHECK(reader.GetFrameCount() == 0);
+
+        writer.WriteFrame(0, position, bodies.Size());
+        writer.WriteFrame(60, position, bodies.Size());
+        CHECK(reader.Refresh() && reader.GetFrameCount() == 2 && reader.GetTime(1) == 60);
+        writer.End();
+    }
+    {
+        MappedTrajectoryReader<double> reader;
+        CHECK(reader.Open(path, error));
+        CHECK(reader.GetFrameCount() == 2 && reader.GetPosition(1, 2, 1) == bodies.pos[1][2]);
+    }
+
+    // written by a stream and not ended : the frames in the file
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        BinaryTrajectoryWriter<double> writer(file);
+        writer.Begin(bodies.Size(), 2, 60);
+        for(int k = 0; k < 3; k++)
+            writer.WriteFrame(60 * k, bodies);
+        writer.Flush();
+
+        MappedTrajectoryReader<double> reader;
+        CHECK(reader.Open(path, error));
+        CHECK(reader.GetFrameCount() == 3);
+    }
+
+    std::remove(path.c_str());
+}
+
+
+/// @brief writer failing at its frame `failure`, as a full disk would
+struct FailingWriter : TrajectoryWriter<double>
+{
+    using TrajectoryWriter<double>::WriteFrame;
+
+    size_t failure, frames = 0;
+    bool ended = false;
+
+    explicit FailingWriter(size_t failure) : failure(failure) {}
+
+    void Begin(size_t, int, double) override {}
+    void WriteFrame(double, const double* const*, size_t) override
+    {
+        if(frames++ == failure)
+            throw std::runtime_error("disk full");
+    }
+    void End() override { ended = true; }
+};
+
+void testStreamingTrajectory()
+{
+    const Bodies<double> bodies = randomBodies<double>(3);
+
+    {
+        MemoryTrajectoryWriter<double> memory;
+        StreamingTrajectoryWriter<double> streaming(memory, 4);
+        streaming.Begin(bodies.Size(), 2, 60);
+        for(int k = 0; k < 10; k++)
+            streaming.WriteFrame(60 * k, bodies);
+        streaming.End();
+        CHECK(memory.GetFrameCount() == 10);
+    }
+
+    // the error of the writer thread is thrown on the simulation thread, by WriteFrame or End
+    FailingWriter failing(5);
+    StreamingTrajectoryWriter<double> streaming(failing, 4);
+    streaming.Begin(bodies.Size(), 2, 60);
+    std::string message;
+    try
+    {
+        for(int k = 0; k < 1000; k++)
+            streaming.WriteFrame(60 * k, bodies);
+        streaming.End();
+    }
+    catch(const std::runtime_error& error)
+    {
+        message = error.what();
+    }
+    CHECK(message == "disk full");
+    CHECK(failing.frames == 6);
+
+    message.clear();
+    try
+    {
+        streaming.End();
+    }
+    catch(const std::runtime_error& error)
+    {
+        message = error.what();
+    }
+    CHECK(message == "disk full" && !failing.ended);
+}
+
+
+void testCompressedTrajectory()
+{
+    const size_t n = 4, nbFrames = 50, block_frames = 16;
+    const size_t frame_size = 1 + 2 * n;
+    const double dt = 3600;
+    const std::vector<double> frames = orbitFrames(n, nbFrames, dt);
+    const std::string path = "tests_trajectory.ctj";
+    ThreadPool pool(3);
+
+    // lossless : the same bytes, from the start or from the middle of a block
+    writeCompressed(path, frames, n, dt, 0, block_frames);
+    {
+        CompressedTrajectoryReader<double> reader;
+        std::string error;
+        CHECK(reader.Open(path, error));
+        CHECK(reader.GetFrameCount() == nbFrames && reader.GetBlockCount() == 4 && reader.GetTimestep() == dt);
+
+        std::vector<double> decoded(nbFrames * frame_size);
+        CHECK(reader.ReadFrames(0, nbFrames, decoded.data(), &pool));
+        CHECK(std::memcmp(decoded.data(), frames.data(), decoded.size() * sizeof(double)) == 0);
+
+        const size_t first = 21, count = 20;
+        std::vector<double> middle(count * frame_size);
+        CHECK(reader.ReadFrames(first, count, middle.data()));
+        CHECK(std::memcmp(middle.data(), frames.data() + first * frame_size, middle.size() * sizeof(double)) == 0);
+        CHECK(!reader.ReadFrames(40, 20, middle.data()));
+    }
+
+    // lossy : the positions within the tolerance, the time exact
+    const double tolerance = 1e3;
+    writeCompressed(path, frames, n, dt, tolerance, block_frames);
+    {
+        CompressedTrajectoryReader<double> reader;
+        std::string error;
+        CHECK(reader.Open(path, error));
+
+        std::vector<double> decoded(nbFrames * frame_size);
+        CHECK(reader.ReadFrames(0, nbFrames, decoded.data(), &pool));
+        double largest = 0;
+        for(size_t k = 0; k < nbFrames; k++)
+        {
+            CHECK(decoded[k * frame_size] == frames[k * frame_size]);
+            for(size_t c = 1; c < frame_size; c++)
+                largest = std::max(largest, std::abs(decoded[k * frame_size + c] - frames[k * frame_size + c]));
+        }
+        CHECK(largest <= tolerance);
+    }
+
+    // a jump too large for the varint is stored raw (code 0)
+    {
+        const TrajectoryCodec<double> codec(2, 3, tolerance);
+        const double column[] = { 0, 0, 1, 1e4, 2, 2e4, 3, 1e30, 4, 4e4, 5, 5e4 };
+        std::vector<uint8_t> block;
+        codec.Encode(column, 6, block);
+
+        double decoded[12];
+        CHECK(codec.Decode(block.data(), block.size(), 6, decoded));
+        CHECK(decoded[7] == 1e30);
+        for(size_t k = 0; k < 6; k++)
+            CHECK(std::abs(decoded[2 * k + 1] - column[2 * k + 1]) <= tolerance);
+    }
+
+    // the truncated or corrupt blocks are refused
+    {
+        const TrajectoryCodec<double> codec(frame_size, 3, 0);
+        std::vector<uint8_t> block;
+        codec.Encode(frames.data(), block_frames, block);
+        std::vector<double> decoded(block_frames * frame_size);
+
+        CHECK(codec.Decode(block.data(), block.size(), block_frames, decoded.data()));
+        CHECK(!codec.Decode(block.data(), block.size() - 1, block_frames, decoded.data()));
+
+        // a count of zero bytes larger than a double
+        std::vector<uint8_t> corrupt = block;
+        corrupt[0] |= 0x0F;
+        CHECK(!codec.Decode(corrupt.data(), corrupt.size(), block_frames, decoded.data()));
+    }
+
+    // a file cut before its index, and an index pointing into the middle of a block (the third
+    // one begins earlier : the second and the third are refused, not the last)
+    writeCompressed(path, frames, n, dt, 0, block_frames);
+    {
+        std::ifstream input(path, std::ios::binary);
+        std::string file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        input.close();
+
+        CompressedTrajectoryHeader header;
+        std::memcpy(&header, file.data(), sizeof(header));
+        CHECK(header.version == 2);
+
+        std::string other_version = file;
+        const uint32_t version = 1;
+        std::memcpy(&other_version[offsetof(CompressedTrajectoryHeader, version)], &version, sizeof(version));
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(other_version.data(), other_version.size());
+        CompressedTrajectoryReader<double> unknown;
+        std::string error;
+        CHECK(!unknown.Open(path, error));
+
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(file.data(), header.index_offset + 8);
+        CompressedTrajectoryReader<double> truncated;
+        CHECK(!truncated.Open(path, error));
+
+        uint64_t offset;
+        std::memcpy(&offset, file.data() + header.index_offset + 2 * sizeof(uint64_t), sizeof(offset));
+        offset -= 3;
+        std::memcpy(&file[header.index_offset + 2 * sizeof(uint64_t)], &offset, sizeof(offset));
+        std::ofstream(path, std::ios::binary | std::ios::trunc).write(file.data(), file.size());
+
+        CompressedTrajectoryReader<double> corrupt;
+        CHECK(corrupt.Open(path, error));
+        std::vector<double> decoded(nbFrames * frame_size);
+        CHECK(!corrupt.ReadFrames(0, nbFrames, decoded.data(), &pool));
+        CHECK(corrupt.ReadFrames(48, 2, decoded.data()));
+    }
+
+    // many bodies : blocks of 8 MiB of frames, not of DefaultBlockFrames frames
+    {
+        const size_t many = 100000, large_frame = 1 + 2 * many, nbLarge = 12;
+        std::vector<double> large(nbLarge * large_frame);
+        for(size_t k = 0; k < nbLarge; k++)
+        {
+            large[k * large_frame] = k * dt;
+            for(size_t i = 0; i < many; i++)
+            {
+                large[k * large_frame + 1 + 2 * i] = 1e9 * i + 1e4 * k;
+                large[k * large_frame + 2 + 2 * i] = -1e9 * i;
+            }
+        }
+        writeCompressed(path, large, many, dt, 0, CompressedTrajectoryWriter<double>::DefaultBlockFrames);
+
+        CompressedTrajectoryReader<double> reader;
+        std::string error;
+        CHECK(reader.Open(path, error));
+        CHECK(reader.GetHeader().block_frames == CompressedTrajectoryWriter<double>::BlockBytes / (large_frame * sizeof(double)));
+        CHECK(reader.GetBlockCount() == 3);
+
+        std::vector<double> decoded(large.size());
+        CHECK(reader.ReadFrames(0, nbLarge, decoded.data(), &pool));
+        CHECK(std::memcmp(decoded.data(), large.data(), decoded.size() * sizeof(double)) == 0);
+    }
+
+    std::remove(path.c_str());
+}
+
+
+/// @brief the trajectory of the sun and the earth over `length` steps of an hour (dopri5 : `length` hours),
+/// a checkpoint being saved after 64 steps in `checkpoint` if not empty, or the simulation going on from
+/// the checkpoint `restart` if not empty, the way rk4 does
+std::string restartedTrajectory(bool csv, int integrator, size_t length, const std::string& checkpoint, const std::string& restart)
+{
+    const std::string path = csv ? "tests_restart.log" : "tests_restart.bin";
+    const std::ios::openmode binary = csv ? std::ios::openmode() : std::ios::binary;
+    if(!restart.empty())
+    {
+        CheckpointHeader header;
+        CHECK(readCheckpointHeader(restart, header));
+        std::filesystem::resize_file(path, header.output_size);
+    }
+
+    {
+        std::ofstream file(path, binary | (restart.empty() ? std::ios::trunc : std::ios::in));
+        if(!restart.empty())
+            file.seekp(0, std::ios::end);
+
+        std::unique_ptr<TrajectoryWriter<double>> writer;
+        if(csv)
+            writer.reset(new CsvTrajectoryWriter<double>(file));
+        else
+            writer.reset(new BinaryTrajectoryWriter<double>(file));
+
+        // the checkpoints are due every 64 steps, the interval being 0
+        Checkpointer<double, 2> checkpointer(checkpoint, 0, &file);
+        Bodies<double> bodies = sunAndEarth<double>();
+        const auto force = [](Bodies<double>& state) { ComputeAccelerations(state); };
+        const double dt = 3600;
+        std::string error;
+
+        if(integrator == 0)
+        {
+            Integrator<double> fixed(IntegratorType::Yoshida4);
+            CHECK(restart.empty() || checkpointer.Load(restart, 2, checkpointIntegrator(IntegratorType::Yoshida4), dt, error));
+            simulation(length, bodies, dt, fixed, force, *writer, &checkpointer);
+        }
+        else
+        {
+            AdaptiveIntegrator<double> dopri5(1e-12, 1e-3, dt);
+            CHECK(restart.empty() || checkpointer.Load(restart, 2, CheckpointDopri5, dt, error));
+            simulation(length * dt, dt, integrator == 2, bodies, dopri5, force, *writer, &checkpointer);
+        }
+
+        checkpointer.Finish();
+        CHECK(checkpoint.empty() || checkpointer.GetWrittenCount() != 0);
+    }
+
+    return readFile(path);
+}
+
+void testRestart()
+{
+    const std::string checkpoint = "tests_restart.ckpt";
+
+    // fixed step, dopri5 with a frame per step, dopri5 with a frame per hour
+    for(int integrator = 0; integrator < 3; integrator++)
+    {
+        for(bool csv : { false, true })
+        {
+            const size_t length = integrator == 0 ? 200 : 4000;
+            const std::string uninterrupted = restartedTrajectory(csv, integrator, length, "", "");
+
+            // stopped after the checkpoint, its last frames are written again
+            const std::string stopped = restartedTrajectory(csv, integrator, length / 2, checkpoint, "");
+            CHECK(stopped.size() < uninterrupted.size());
+
+            const std::string restarted = restartedTrajectory(csv, integrator, length, "", checkpoint);
+            CHECK(restarted == uninterrupted);
+        }
+    }
+
+    // the last checkpoint is of dopri5 with a frame per hour : not for another output interval or integrator
+    Checkpointer<double, 2> checkpointer("", 0, nullptr);
+    std::string error;
+    CHECK(checkpointer.Load(checkpoint, 2, CheckpointDopri5, 3600, error));
+    CHECK(!checkpointer.Load(checkpoint, 2, CheckpointDopri5, 1800, error));
+    CHECK(!checkpointer.Load(checkpoint, 2, checkpointIntegrator(IntegratorType::Yoshida4), 3600, error));
+
+    std::remove(checkpoint.c_str());
+    std::remove("tests_restart.log");
+    std::remove("tests_restart.bin");
+}
+
+
+////// Simulations
+
+/// @brief heap allocations after the first step of run(writer), the frames going to a file
+template<typename Writer, typename Run>
+size_t steadyAllocations(Run&& run)
+{
+    std::ofstream file("tests_allocations.log", std::ios::binary | std::ios::trunc);
+    Writer writer(file);
+    return run(writer);
+}
+
+void testSteadyAllocations()
+{
+    CHECK(allocationsCounted());
+
+    ThreadPool pool(3);
+    BarnesHutTree<double> tree(0.5);
+    ParallelDirectForce<double> direct(pool, DirectKernel::Simd);
+    Checkpointer<double, 2>* const noCheckpoint = nullptr;
+
+    // the forces write the potential when the diagnostics ask for it, as in rk4
+    Diagnostics<double, 2> diagnostics(5);
+    const auto tree_force = [&](Bodies<double>& state) { tree.ComputeAccelerations(state, &pool, diagnostics.Potential(state.Size())); };
+    const auto direct_force = [&](Bodies<double>& state) { direct(state, diagnostics.Potential(state.Size())); };
+
+    const auto two_body = [noCheckpoint](TrajectoryWriter<double>& writer) {
+        const Object<double> sun(1.9891e30, Vec2<double>(0, 0), Vec2<double>(0, 0));
+        Object<double> earth(5.9722e24, Vec2<double>(1.496e11, 0), Vec2<double>(0, 29780));
+        Integrator<double> integrator(IntegratorType::RK4);
+        Diagnostics<double, 2> central(50, sun.mass);
+        return simulation(200, sun, earth, 3600.0, integrator, writer, noCheckpoint, &central);
+    };
+    const auto fixed_step = [&](auto& force) {
+        return [&](TrajectoryWriter<double>& writer) {
+            Bodies<double> bodies = randomBodies<double>(100);
+            Integrator<double> integrator(IntegratorType::Yoshida4);
+            diagnostics.Reset(5, nullptr);
+            return simulation(size_t(20), bodies, 3600.0, integrator, force, writer, noCheckpoint, &diagnostics);
+        };
+    };
+    const auto dopri5 = [&](auto& force, bool fixed_output) {
+        return [&, fixed_output](TrajectoryWriter<double>& writer) {
+            Bodies<double> bodies = randomBodies<double>(100);
+            AdaptiveIntegrator<double> integrator(1e-8, 1e-3, 3600);
+            diagnostics.Reset(5, nullptr);
+            return simulation(20 * 3600.0, 3600.0, fixed_output, bodies, integrator, force, writer, noCheckpoint, &diagnostics);
+        };
+    };
+
+    for(int csv = 0; csv < 2; csv++)
+    {
+        const auto allocations = [csv](auto&& run) {
+            return csv ? steadyAllocations<CsvTrajectoryWriter<double>>(run) : steadyAllocations<BinaryTrajectoryWriter<double>>(run);
+        };
+
+        CHECK(allocations(two_body) == 0);
+        CHECK(allocations(fixed_step(tree_force)) == 0);
+        CHECK(allocations(fixed_step(direct_force)) == 0);
+        CHECK(allocations(dopri5(tree_force, true)) == 0);
+        CHECK(allocations(dopri5(direct_force, false)) == 0);
+    }
+
+    std::remove("tests_allocations.log");
+}
 
 
 int main() {
+    testIntegrators();
+    testAdaptiveIntegrator();
+    testForces();
+    testBinaryTrajectory();
+    testMappedTrajectory();
+    testStreamingTrajectory();
+    testCompressedTrajectory();
+    testRestart();
+    testSteadyAllocations();
 
-}
\ No newline at end of file
+    if(g_Failures != 0)
+    {
+        std::cout << g_Failures << " checks failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Every check passed" << std::endl;
+    return EXIT_SUCCESS;
+}
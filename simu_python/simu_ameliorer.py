@@ -1,19 +1,42 @@
 import matplotlib.pyplot as plt
 import numpy as np
 import os
+import sys
 import matplotlib.animation as animation
 
-# Exécuter la simulation en C++
-os.system(".\\cpp\\out.exe 2000 100 1.9891e30 5.9722e24 75e9 0 0 57000")
+from trajectoire import lire_trajectoire
 
-# Charger les données
-data = np.genfromtxt("simulation_data.log", delimiter=';', dtype=float)
+# le module tipe (cpp/bindings.cpp) est construit par cmake dans build/, à côté du programme
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "build"))
+try:
+    import tipe
+except ImportError:
+    tipe = None
 
-print(f"Data shape: {data.shape}")
-print(f"First rows of data:\n{data[:5]}")
+if tipe is not None:
+    # Simulation dans le processus : les positions sont lues dans la mémoire du moteur, sans fichier.
+    # Le Soleil est un corps du système, il bouge donc un peu (autour du centre de masse)
+    moteur = tipe.Engine(dimension=2, integrator="verlet")
+    moteur.add_body(1.9891e30, (0, 0), (0, 0))
+    moteur.add_body(5.9722e24, (75e9, 0), (0, 57000))
 
-X = data[:, 0]
-Y = data[:, 1]
+    nb_pas = 2000 * 24 * 60 * 60 // 100
+    moteur.record(frames=nb_pas + 1)
+    moteur.step(nb_pas, 100)
+    temps, positions = moteur.trajectory()
+    positions = positions[:, 1:]    # la planète
+else:
+    # Exécuter la simulation en C++
+    os.system(".\\cpp\\out.exe --format=bin --precision=double 2000 100 1.9891e30 5.9722e24 75e9 0 0 57000")
+
+    # Charger les données
+    temps, positions = lire_trajectoire("simulation_data.bin")
+
+print(f"Data shape: {positions.shape}")
+print(f"First rows of data:\n{positions[:5]}")
+
+X = positions[:, 0, 0]
+Y = positions[:, 0, 1]
 
 # Création de la figure
 fig, ax = plt.subplots(figsize=(6, 6))
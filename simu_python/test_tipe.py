@@ -0,0 +1,112 @@
+import gc
+import os
+import sys
+
+import pytest
+
+# le module tipe (cpp/bindings.cpp) est construit par cmake dans build/, ctest donne son dossier par PYTHONPATH
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "build"))
+tipe = pytest.importorskip("tipe")
+np = pytest.importorskip("numpy")
+
+
+def soleil_terre(**options):
+    moteur = tipe.Engine(dimension=2, integrator="verlet", **options)
+    moteur.add_body(1.9891e30, (0, 0), (0, 0))
+    moteur.add_body(5.9722e24, (150e9, 0), (0, 29780))
+    return moteur
+
+
+def test_les_vues_suivent_les_pas():
+    moteur = soleil_terre()
+    x, y = moteur.positions
+    moteur.step(24, 3600)
+    assert y[1] > 0
+    assert not x.flags.writeable
+
+
+def test_ajouter_un_corps_pendant_une_vue():
+    moteur = soleil_terre()
+    positions = moteur.positions
+    with pytest.raises(RuntimeError):
+        moteur.add_body(6.39e23, (228e9, 0), (0, 24077))
+    assert positions[0][1] == 150e9
+
+    # une copie reste valable, la vue doit disparaître
+    copie = np.array(positions)
+    del positions
+    gc.collect()
+    moteur.add_body(6.39e23, (228e9, 0), (0, 24077))
+    assert moteur.size == 3
+    assert copie[0][1] == 150e9
+
+
+def test_charger_pendant_une_vue(tmp_path):
+    fichier = tmp_path / "corps.txt"
+    fichier.write_text("6.39e23 228e9 0 0 24077\n")
+
+    moteur = soleil_terre()
+    masses = moteur.masses
+    with pytest.raises(RuntimeError):
+        moteur.load(str(fichier))
+    del masses
+    gc.collect()
+    moteur.load(str(fichier))
+    assert moteur.size == 3
+
+
+def test_une_tranche_garde_la_vue():
+    moteur = soleil_terre()
+    vitesse_x = moteur.velocities[0][1:]
+    gc.collect()
+    with pytest.raises(RuntimeError):
+        moteur.add_body(6.39e23, (228e9, 0), (0, 24077))
+    del vitesse_x
+    gc.collect()
+    moteur.add_body(6.39e23, (228e9, 0), (0, 24077))
+
+
+def test_la_vue_garde_le_moteur():
+    moteur = soleil_terre()
+    x, y = moteur.positions
+    del moteur
+    gc.collect()
+    assert x[1] == 150e9
+
+
+def test_trajectoire_au_dela_de_la_reserve():
+    moteur = soleil_terre()
+    moteur.record()
+    moteur.step(10, 3600)
+    temps, positions = moteur.trajectory()
+    assert temps.shape == (11,)
+    assert positions.shape == (11, 2, 2)
+
+    # les pas déplaceraient les images sous les vues
+    with pytest.raises(RuntimeError):
+        moteur.step(100000, 3600)
+    with pytest.raises(RuntimeError):
+        moteur.record()
+    assert temps[10] == 36000
+
+    del temps, positions
+    gc.collect()
+    moteur.step(100000, 3600)
+    assert moteur.trajectory()[0].shape == (100011,)
+
+
+def test_trajectoire_dans_la_reserve():
+    moteur = soleil_terre()
+    moteur.record(frames=1000)
+    moteur.step(10, 3600)
+    temps, positions = moteur.trajectory()
+    avant = positions.copy()
+
+    moteur.step(900, 3600)
+    assert np.array_equal(positions, avant)
+    with pytest.raises(RuntimeError):
+        moteur.step(100, 3600)
+
+    temps, positions = moteur.trajectory()
+    assert temps.shape == (911,)
+    assert temps[910] == 910 * 3600
@@ -0,0 +1,51 @@
+import numpy as np
+
+# Lecture des trajectoires binaires écrites par le programme C++ avec --format=bin
+# (voir cpp/Trajectory.h) : un en-tête de 64 octets puis les frames [t, x0, y0, x1, y1, ...]
+# ([t, x0, y0, z0, x1, ...] pour les simulations en 3D, --dimension=3)
+
+HEADER = np.dtype([
+    ("magic", "S8"),
+    ("version", "<u4"),
+    ("header_size", "<u4"),
+    ("dtype", "S8"),
+    ("scalar_size", "<u4"),
+    ("nb_bodies", "<u4"),
+    ("dimension", "<u4"),
+    ("columns", "<u4"),
+    ("nb_frames", "<u8"),
+    ("timestep", "<f8"),
+    ("flags", "<u4"),
+    ("padding", "V4"),
+])
+
+
+def lire_entete(chemin):
+    header = np.fromfile(chemin, dtype=HEADER, count=1)[0]
+    if header["magic"] != b"TIPETRAJ":
+        raise ValueError(f"{chemin} n'est pas une trajectoire binaire")
+    return header
+
+
+def lire_trajectoire(chemin):
+    """Renvoie (temps, positions) sans copier le fichier en mémoire (np.memmap)
+
+    temps : (nb_frames,)
+    positions : (nb_frames, nb_bodies, dimension)
+    """
+    header = lire_entete(chemin)
+    dtype = np.dtype(header["dtype"].decode())
+    nb_bodies = int(header["nb_bodies"])
+    dimension = int(header["dimension"])
+    frame = 1 + nb_bodies * dimension
+
+    # nb_frames vaut 0 si la simulation a été interrompue : on le déduit de la taille du fichier.
+    # Avec --format=mmap (flags & 1), il compte les frames déjà écrites, même à 0 (la suite du fichier
+    # n'est que des zéros), et le fichier peut être lu pendant la simulation
+    data = np.memmap(chemin, dtype=dtype, mode="r", offset=int(header["header_size"]))
+    nb_frames = int(header["nb_frames"])
+    if nb_frames == 0 and not int(header["flags"]) & 1:
+        nb_frames = data.size // frame
+    data = data[:nb_frames * frame].reshape(nb_frames, frame)
+
+    return data[:, 0], data[:, 1:].reshape(nb_frames, nb_bodies, dimension)